@@ -39,6 +39,18 @@
     m( 8, '?', NOTSET,    "notset", A_NORMAL | A_REVERSE, __VA_ARGS__ ) \
     /* ... */
 
+/* Multibyte keys as they are read in raw mode into the keycode (unsigned int)
+ * on little-endian machine */
+#define NCRM_KEYSEQ(a, b, c, d) \
+    ((unsigned int) (a) | ((unsigned int) (b) << 8) \
+    | ((unsigned int) (c) << 16) | ((unsigned int) (d) << 24))
+#define NCRM_KEY_UP     NCRM_KEYSEQ(0x1b, '[', 'A',   0)
+#define NCRM_KEY_DOWN   NCRM_KEYSEQ(0x1b, '[', 'B',   0)
+#define NCRM_KEY_HOME   NCRM_KEYSEQ(0x1b, '[', 'H',   0)
+#define NCRM_KEY_END    NCRM_KEYSEQ(0x1b, '[', 'F',   0)
+#define NCRM_KEY_PGUP   NCRM_KEYSEQ(0x1b, '[', '5', '~')
+#define NCRM_KEY_PGDN   NCRM_KEYSEQ(0x1b, '[', '6', '~')
+
 extern const attr_t gSpecialAttrs[];
 extern const int gNSpecialAttrs;
 
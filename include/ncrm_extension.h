@@ -20,14 +20,21 @@
 #include <stdint.h>
 
 struct ncrm_Event;
+struct ncrm_Model;
 
 /**\brief Represents extension of monitoring app.
  *
  * Extension are shown as switchable tabs composed in multiple windows+panels.
  * Besides of this, extension some lifetime logic (possibly asynchronious):
  *  1. init() -- allocates resources based on app's configuration
- *  2. redraw() -- shall update content of the windows/panels
+ *  2. update() -- shall update content of the windows/panels
  *  3. shutdown() -- frees resources at the end of lifetime
+ *
+ * Instead of `update()`, extension may provide `prepare()` and `present()`
+ * pair to keep expensive rendering out of main thread (see
+ * `ncrm_renderer.h`): `prepare()` handles events and renders content into
+ * one of two buffers on the render thread (without ncurses calls), while
+ * `present()` just copies prepared buffer into windows on the main thread.
  * */
 struct ncrm_Extension {
     /** An unique name to be shown in header as a tab name */
@@ -45,8 +52,25 @@ struct ncrm_Extension {
                , uint16_t top, uint16_t left, uint16_t nLines, uint16_t nCols );
     /** Invoked to update GUI content of a tab */
     int (*update)(struct ncrm_Extension *, struct ncrm_Event *);
+    /** (optional) Invoked on render thread with events accumulated since
+     * previous call to render content into buffer number `nBuffer` (0 or 1).
+     * Must not call ncurses. Shall return non-zero if buffer has to be
+     * presented. */
+    int (*prepare)( struct ncrm_Extension *
+                  , const struct ncrm_Event * events, unsigned int nEvents
+                  , int nBuffer );
+    /** (optional) Invoked on main thread to put content of buffer
+     * `nBuffer` into windows */
+    void (*present)(struct ncrm_Extension *, int nBuffer);
+    /** (optional) Invoked on main thread when tab gets shown (`shown` is
+     * set) or hidden, to show or hide extension's panels */
+    void (*show)(struct ncrm_Extension *, int shown);
     /** Invoked at application shutdown */
     int (*shutdown)(struct ncrm_Extension *);
+
+    /** Numeric ID assigned by app at registration (set before `init()`);
+     * events are addressed to extension by it (see `ncrm_Event`) */
+    uint16_t id;
 };
 
 #endif  /* H_NCRM_EXTENSION_H */
@@ -35,23 +35,57 @@
  * existing as a single-linked list.
  * */
 
+#include "ncrm_timestampFormat.h"
+
 #include <stdint.h>
 
 /** Reallocation stride in case of new block needed */
 #define NCRM_NENTRIES_INC 1024
-/** Size of static destination buffer to recieve the entries */
-#define NCRM_JOURNAL_MAX_BUFFER_LENGTH (5*1024*1024)
+/** Max number of threads decoding received messages */
+#define NCRM_JOURNAL_MAX_DECODE_WORKERS 16
+/** Capacity of queues between ingest pipeline stages, messages */
+#define NCRM_JOURNAL_PIPELINE_DEPTH 64
+/** Time sources have to be quiet for receiver to let appender release
+ * entries held back for merge, msec */
+#define NCRM_JOURNAL_IDLE_PERIOD_MSEC 100
+/** Max number of endpoints journal messages are received from */
+#define NCRM_JOURNAL_MAX_SOURCES 64
+/** Time snapshot service of a source may stay silent before its snapshot
+ * is given up, msec */
+#define NCRM_JOURNAL_SNAPSHOT_TIMEOUT_MSEC 5000
+/** Max number of missed messages of a single gap requested to be re-sent
+ * (larger gaps are just counted) */
+#define NCRM_JOURNAL_MAX_RESEND 4096
+/** Max length of topic prefix subscribed to */
+#define NCRM_JOURNAL_MAX_TOPIC_LEN 64
+/** Number of level classes (level rounded up to hundreds; 9 for levels
+ * above 800) */
+#define NCRM_JOURNAL_N_LEVEL_CLASSES 10
+/** The least severe level class never shed by ingest budget (warnings) */
+#define NCRM_JOURNAL_KEPT_LEVEL_CLASS 4
+/** Period ingest budget is accounted for, msec */
+#define NCRM_JOURNAL_BUDGET_PERIOD_MSEC 1000
+/** Every N-th entry over ingest budget is still kept (sampled) */
+#define NCRM_JOURNAL_SAMPLING_RATE 100
+/** Size of a chunk of arena keeping strings of received entries */
+#define NCRM_JOURNAL_ARENA_CHUNK_SIZE (1024*1024)
 /** Name of extension */
 #define NCRM_JOURNAL_EXTENSION_NAME "log"
-/** Maximum log entries shown in window */
+/** Maximum lines shown in view's body (height of the body pad) */
 #define NCRM_JOURNAL_MAX_LINES_SHOWN 256
+/** Time span to jump over by time navigation keys, msec */
+#define NCRM_JOURNAL_TIME_JUMP 10000
 /** Max length of timestamp string */
 #define NCRM_JOURNAL_MAX_TIMESTAMP_LEN 64
+/** Number of formatted timestamps cached by a view */
+#define NCRM_JOURNAL_TIMESTAMP_CACHE_SIZE 1024
+/** Max length of formatted timestamp to be cached */
+#define NCRM_JOURNAL_TIMESTAMP_CACHE_LEN 32
+/** Max number of views (queries evaluated in a single pass) */
+#define NCRM_JOURNAL_MAX_VIEWS 8
 /** Max length of a single message shown in window */
 #define NCRM_JOURNAL_MAX_LEN (5*1024)
 
-/** A journal message timestamp type */
-typedef unsigned long ncrm_Timestamp_t;
 /** A journal message level type */
 typedef int ncrm_JournalEntryLevel_t;
 
@@ -61,6 +95,8 @@ struct ncrm_JournalEntry {
     ncrm_Timestamp_t timest;
     /** Level (severity) of the message (debug, warning, error, etc) */
     ncrm_JournalEntryLevel_t level;
+    /** Number of the source (endpoint) message was received from */
+    uint16_t source;
     /** Message category (functional block, affiliation) */
     char * category;
     /** Text of the message */
@@ -152,33 +188,134 @@ ncrm_je_query( const struct ncrm_JournalEntries * src
              , struct ncrm_JournalEntry *** dest
              );
 
-/**\brief Timestamp formatting settings */
-struct ncrm_JournalTimestampFormat {
-    /** Shall format timestamp string for given entry `entry`, write the string
-     * to `dest` and return count of meaningful bytes (zero termination is not
-     * necessary).*/
-    uint16_t (*callback)( struct ncrm_JournalTimestampFormat *
-                        , char * dest
-                        , ncrm_Timestamp_t //const struct ncrm_JournalEntry * entry
-                        );
-    // ...
+/**\brief Growing array of journal entries selected by a query
+ *
+ * Keeps copies of entries sorted by time, so selection stays valid when
+ * journal blocks get merged (message strings are never reallocated). */
+struct ncrm_JournalSelection {
+    struct ncrm_JournalEntry * entries;
+    unsigned long n, nAllocated;
 };
 
+/** Initializes empty selection */
+void
+ncrm_je_selection_init(struct ncrm_JournalSelection *);
+
+/** Frees selection's entries (not the messages) */
+void
+ncrm_je_selection_free(struct ncrm_JournalSelection *);
+
+/** Appends copies of entries to the selection, not maintaining order */
+void
+ncrm_je_selection_append( struct ncrm_JournalSelection *
+                        , const struct ncrm_JournalEntry * entries
+                        , unsigned long nEntries );
+
+/**\brief Applies multiple queries in a single pass over entries
+ *
+ * Entries matching `i`-th query are merged into `i`-th selection. Each
+ * entry is checked against all the queries at once; distinct patterns are
+ * matched once per entry, so queries sharing a pattern (or not having it)
+ * cost little.
+ *
+ * Source entries are expected to be sorted by time. They may be late wrt
+ * entries already selected, so `nCommon[i]` is set to number of leading
+ * entries of `i`-th selection that were kept in place.
+ *
+ * \param src[in] entries to evaluate
+ * \param nEntries[in] number of entries in `src`
+ * \param qps[in] queries to apply, at most `NCRM_JOURNAL_MAX_VIEWS`
+ * \param dests[out] selections to merge matching entries into
+ * \param nCommon[out] number of unchanged entries in every selection
+ * \param nQueries[in] number of queries and selections
+ * */
+void
+ncrm_je_select( const struct ncrm_JournalEntry * src
+              , unsigned long nEntries
+              , const struct ncrm_QueryParams * const * qps
+              , struct ncrm_JournalSelection * const * dests
+              , unsigned long * nCommon
+              , unsigned int nQueries
+              );
 
 struct ncrm_Extension;
 
+/**\brief Initial configuration of a journal view */
+struct ncrm_JournalViewConfig {
+    /** Query parameters of the view */
+    struct ncrm_QueryParams query;
+    /** Relative height of the view, in parts of extension's height */
+    uint16_t heightShare;
+};
+
+/**\brief Configuration of journal extension
+ *
+ * Sources publish journal messages (0MQ PUB): msgpack maps of journal
+ * entries (`j`), status items (`status`, `progress`, `elapsedTime`) and an
+ * optional sequence number of the message (`seq`, counted by source from 1).
+ *
+ * A source may provide snapshot service (0MQ ROUTER) to let late subscriber
+ * catch up with its recent history. Once subscribed, ncrm sends request
+ * `{"snapshot": <span>, "levels": [<min>, <max>]}` for entries of the last
+ * `span` msec (0 for whole backlog) of given levels (-1 for no limit).
+ * Service replies with messages of the same form as published ones, the last
+ * one being `{"snapshotEnd": <seq>}` with sequence number of the latest
+ * message snapshot covers. Published messages received meanwhile are held
+ * back; ones not covered by snapshot are applied after it.
+ *
+ * Gaps in sequence numbers of published messages are counted. Missed
+ * messages are requested from snapshot service with
+ * `{"resend": [<first seq>, <last seq>]}`, the service replies with them
+ * (messages of the same form as published ones).
+ *
+ * Published message may be prefixed with topic (the first part, a string)
+ * `<level class>:<category>`, where level class is a single digit: level
+ * rounded up to hundreds (0-8, 9 for levels above 800), as its priority
+ * glyph shows. Then ncrm subscribes only to topics that views' queries may
+ * match (by levels range and literal prefix of category pattern), so the
+ * rest is filtered out by publisher. Messages of no topic (the first part
+ * is msgpack map) are always received. Sequence gaps are not counted while
+ * messages are filtered.
+ * */
 struct ncrm_JournalExtensionConfig {
     /** Pointer to model config */
     struct ncrm_Model * modelPtr;
-    /** Address of the socket to connect to (0MQ SUB)
+    /** Addresses of the sockets to connect to (0MQ PUB), one per source;
+     * entries are tagged with number of the source in this list.
      * Example: "tcp://127.0.0.1:5555" */
-    char * address;
-    /** Check updates unce per msec (zero for blocking recv) */
-    unsigned int recvIntervalMSec;
+    char * addresses[NCRM_JOURNAL_MAX_SOURCES];
+    uint16_t nAddresses;
+    /** Time entries of multiple sources are held back to be merged in
+     * order, msec. Entries are released once every source sent a later
+     * one, or once they are older than the latest received by this
+     * window */
+    ncrm_Timestamp_t reorderWindow;
+    /** Addresses of sources' snapshot services (0MQ ROUTER), null if
+     * source has none */
+    char * snapshotAddresses[NCRM_JOURNAL_MAX_SOURCES];
+    /** Backlog requested from snapshot services: time span back from the
+     * latest entry, msec (0 for whole backlog), and range of levels (-1 to
+     * unset) */
+    ncrm_Timestamp_t snapshotSpan;
+    ncrm_JournalEntryLevel_t snapshotLevelRange[2];
+    /** Max number of messages appended to journal at once (in a batch) */
+    unsigned int maxMsgsPerBatch;
+    /** Number of threads decoding received messages, up to
+     * `NCRM_JOURNAL_MAX_DECODE_WORKERS` */
+    unsigned int nDecodeWorkers;
+    /** Ingest budget per level class, entries per second, 0 for no limit.
+     * Entries over budget are sampled, the rest is counted into "N
+     * suppressed" entries. Warnings and more severe entries are always
+     * kept */
+    unsigned int levelBudgets[NCRM_JOURNAL_N_LEVEL_CLASSES];
     /** Default (starting) query parameters for new view */
     struct ncrm_QueryParams defaultQueryParameters;
     /** Default (starting) timestamp formatter settings */
     struct ncrm_JournalTimestampFormat defaultTimestampFormatter;
+    /** Views shown, top to bottom. If none, a single view with default query
+     * parameters is shown */
+    struct ncrm_JournalViewConfig views[NCRM_JOURNAL_MAX_VIEWS];
+    uint16_t nViews;
     /** Dimensions (set automatically at extension initialization, updated
      * by resize event)*/
     uint16_t dims[2][2];
@@ -0,0 +1,65 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef H_NCRM_LATENCY_H
+#define H_NCRM_LATENCY_H
+
+/**\file
+ * \brief Log-bucketed latency histograms
+ *
+ * Used to measure how long events wait in the queue and how long their
+ * handling takes. Values are in microseconds. Every power of two is split
+ * into four buckets, so quantiles are estimated with relative error below
+ * 25% while histogram takes fixed half of kilobyte. Values of 2^33 usec and
+ * longer (~2.4h) fall into the last bucket.
+ * */
+
+#include <stdint.h>
+#include <time.h>
+
+/** Number of buckets per power of two (must be a power of two as well) */
+#define NCRM_LATENCY_SUB_BUCKETS_LOG2 2
+#define NCRM_LATENCY_SUB_BUCKETS (1 << NCRM_LATENCY_SUB_BUCKETS_LOG2)
+/** Overall number of buckets */
+#define NCRM_LATENCY_N_BUCKETS (32*NCRM_LATENCY_SUB_BUCKETS)
+
+struct ncrm_LatencyHistogram {
+    /** Counts of values, per bucket */
+    uint32_t counts[NCRM_LATENCY_N_BUCKETS];
+    /** Number of values added */
+    unsigned long n;
+    /** Max value added, usec */
+    unsigned long maxUSec;
+};
+
+/** Clears the histogram */
+void ncrm_lh_reset( struct ncrm_LatencyHistogram * );
+/** Adds a value, usec */
+void ncrm_lh_add( struct ncrm_LatencyHistogram *, unsigned long usec );
+/** Adds time passed between two moments (zero if `to` precedes `from`) */
+void ncrm_lh_add_interval( struct ncrm_LatencyHistogram *
+                         , const struct timespec * from
+                         , const struct timespec * to );
+/** Adds counts of another histogram */
+void ncrm_lh_merge( struct ncrm_LatencyHistogram *
+                  , const struct ncrm_LatencyHistogram * );
+
+/** Returns estimation of quantile `q` (0..1), usec: upper bound of the
+ * bucket containing it, but not more than max. Zero for empty histogram. */
+unsigned long ncrm_lh_quantile( const struct ncrm_LatencyHistogram *, double q );
+
+#endif  /* H_NCRM_LATENCY_H */
@@ -18,6 +18,7 @@
 #define H_NCRM_MONITOR_MODEL_H
 
 #include "ncrm_defs.h"
+#include "ncrm_queue.h"
 
 #include <pthread.h>
 
@@ -48,6 +49,10 @@ struct ncrm_Model {
 
     /** Null-terminated array of errors occured */
     char ** errors;
+
+    /** Monitor's own event queue counters, updated periodically. Drops or
+     * high depth mean that monitor can not keep up with events */
+    struct ncrm_QueueStats queueStats;
 };
 
 /** Adds an error to the list of errors */
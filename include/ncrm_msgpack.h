@@ -0,0 +1,94 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef H_NCRM_MSGPACK_H
+#define H_NCRM_MSGPACK_H
+
+/**\file
+ * \brief Streaming msgpack reader and writer
+ *
+ * Reads msgpack-encoded values one by one right from the buffer, without
+ * building an object tree: strings are returned as pointers into the
+ * buffer. Every function returns zero on success; on malformed data or type
+ * mismatch non-zero is returned and cursor is left unchanged.
+ *
+ * Writer appends values one by one to a growing buffer, using the shortest
+ * format for every value.
+ * */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Max depth of nested containers `ncrm_mp_skip()` accepts (data comes from
+ * network, so recursion must be bounded) */
+#define NCRM_MP_MAX_SKIP_DEPTH 32
+
+/** Position within buffer being read */
+struct ncrm_MsgpackCursor {
+    const uint8_t * cur
+                , * end;
+};
+
+/** Sets cursor to the beginning of the buffer */
+void ncrm_mp_cursor_init( struct ncrm_MsgpackCursor *
+                        , const void * data, size_t size );
+/** Returns non-zero if whole buffer was read */
+static inline int
+ncrm_mp_at_end( const struct ncrm_MsgpackCursor * c ) { return c->cur >= c->end; }
+
+/** Reads map header, number of key-value pairs following */
+int ncrm_mp_read_map( struct ncrm_MsgpackCursor *, uint32_t * n );
+/** Reads array header, number of items following */
+int ncrm_mp_read_array( struct ncrm_MsgpackCursor *, uint32_t * n );
+/** Reads string (not null-terminated, points into the buffer) */
+int ncrm_mp_read_str( struct ncrm_MsgpackCursor *
+                    , const char ** ptr, uint32_t * len );
+/** Reads non-negative integer */
+int ncrm_mp_read_uint( struct ncrm_MsgpackCursor *, uint64_t * );
+/** Reads signed integer (of any msgpack integer format fitting in) */
+int ncrm_mp_read_int( struct ncrm_MsgpackCursor *, int64_t * );
+/** Skips a value of any type (including nested ones, less than
+ * `NCRM_MP_MAX_SKIP_DEPTH` levels deep) */
+int ncrm_mp_skip( struct ncrm_MsgpackCursor * );
+
+/** Growing buffer msgpack values are written to */
+struct ncrm_MsgpackBuffer {
+    uint8_t * data;
+    size_t size, nAllocated;
+};
+
+/** Initializes empty buffer */
+void ncrm_mp_buffer_init( struct ncrm_MsgpackBuffer * );
+/** Frees buffer's data */
+void ncrm_mp_buffer_free( struct ncrm_MsgpackBuffer * );
+/** Empties buffer, keeping its allocation */
+static inline void
+ncrm_mp_buffer_reset( struct ncrm_MsgpackBuffer * b ) { b->size = 0; }
+
+/** Writes map header; `n` key-value pairs have to follow */
+void ncrm_mp_write_map( struct ncrm_MsgpackBuffer *, uint32_t n );
+/** Writes array header; `n` items have to follow */
+void ncrm_mp_write_array( struct ncrm_MsgpackBuffer *, uint32_t n );
+/** Writes string of given length */
+void ncrm_mp_write_str( struct ncrm_MsgpackBuffer *
+                      , const char * s, uint32_t len );
+/** Writes non-negative integer */
+void ncrm_mp_write_uint( struct ncrm_MsgpackBuffer *, uint64_t );
+/** Writes signed integer */
+void ncrm_mp_write_int( struct ncrm_MsgpackBuffer *, int64_t );
+
+#endif  /* H_NCRM_MSGPACK_H */
@@ -0,0 +1,65 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef H_NCRM_PAYLOAD_H
+#define H_NCRM_PAYLOAD_H
+
+/**\file
+ * \brief Reference-counted event payloads
+ *
+ * Payload is a heap block handed from producer to consumer(s) within events,
+ * without copying. Whoever keeps pointer to payload owns a reference;
+ * payload is freed when the last reference is released. Once shared,
+ * payload data must not be modified.
+ *
+ * Ownership of a reference is transferred with event to the queue
+ * (`ncrm_enqueue()`, even if event is dropped), the queue releases it after
+ * event was handled. Handlers keeping the payload for later have to take
+ * own reference with `ncrm_payload_ref()`.
+ * */
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+struct ncrm_Payload {
+    /** Number of references */
+    atomic_uint nRefs;
+    /** (optional) Invoked with payload data when the last reference is
+     * released, before payload is freed */
+    void (*dtor)(void * data);
+    /** Size of data, bytes */
+    size_t size;
+    /** Payload data */
+    max_align_t data[];
+};
+
+/** Allocates payload with given data size; caller owns the only
+ * reference */
+struct ncrm_Payload * ncrm_payload_new( size_t size, void (*dtor)(void *) );
+/** Changes data size of payload not shared yet (single reference), returns
+ * new pointer */
+struct ncrm_Payload * ncrm_payload_resize( struct ncrm_Payload *, size_t size );
+/** Takes reference, returns the same payload (null-safe) */
+struct ncrm_Payload * ncrm_payload_ref( struct ncrm_Payload * );
+/** Releases reference, frees payload if it was the last one (null-safe) */
+void ncrm_payload_unref( struct ncrm_Payload * );
+
+/** Returns pointer to payload data */
+static inline void *
+ncrm_payload_data( struct ncrm_Payload * p ) { return p->data; }
+
+#endif  /* H_NCRM_PAYLOAD_H */
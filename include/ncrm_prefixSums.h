@@ -0,0 +1,68 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_NCRM_PREFIX_SUMS_H
+#define H_NCRM_PREFIX_SUMS_H
+
+/**\file
+ * \brief Prefix sums index (a Fenwick, or binary indexed tree)
+ *
+ * Used by views to map wrapped (screen) lines to items they're shown for. For
+ * a sequence of N non-negative values provides sum of first n values, point
+ * update and lookup of item by position in O(log N) time. Appending new value
+ * is O(log N) as well, so the index may grow together with query results.
+ * */
+
+#include <stdint.h>
+
+/** Reallocation stride for prefix sums index */
+#define NCRM_PREFIX_SUMS_INC 1024
+
+struct ncrm_PrefixSums {
+    /** Tree nodes, 1-based (zeroth element is unused) */
+    uint32_t * tree;
+    /** Number of items indexed */
+    unsigned long n;
+    /** Number of allocated nodes */
+    unsigned long nAllocated;
+};
+
+/** Initializes empty index */
+void ncrm_ps_init( struct ncrm_PrefixSums * );
+/** Frees the index */
+void ncrm_ps_free( struct ncrm_PrefixSums * );
+
+/** (Re-)builds index from given array of values in O(N) */
+void ncrm_ps_build( struct ncrm_PrefixSums *
+                  , const uint16_t * values
+                  , unsigned long n );
+/** Appends value to the index */
+void ncrm_ps_push( struct ncrm_PrefixSums *, uint32_t value );
+/** Adds (possibly negative) `delta` to `nItem`-th value */
+void ncrm_ps_add( struct ncrm_PrefixSums *, unsigned long nItem, int32_t delta );
+
+/** Returns sum of first `n` values */
+unsigned long ncrm_ps_sum( const struct ncrm_PrefixSums *, unsigned long n );
+/** Returns sum of all values */
+unsigned long ncrm_ps_total( const struct ncrm_PrefixSums * );
+
+/**\brief Finds item by position in the sum
+ *
+ * Returns index of an item which range `[sum(i), sum(i+1))` contains `pos`.
+ * If `pos` is beyond the total, number of items is returned. */
+unsigned long ncrm_ps_find( const struct ncrm_PrefixSums *, unsigned long pos );
+
+#endif  /* H_NCRM_PREFIX_SUMS_H */
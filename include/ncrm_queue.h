@@ -20,8 +20,23 @@
 /**\file
  * \brief Defines event queue objects and API of ncrm. */
 
+#include "ncrm_payload.h"
+
+#include <stdint.h>
+#include <time.h>
+#include <stdatomic.h>
+
 /** Max size of the event queue */
 #define NCRM_MAX_EVENTS_IN_QUEUE 1024
+/** Queue capacity is split between event classes, so flood of events of one
+ * class can not starve others. Must be powers of two. */
+#define NCRM_MAX_INPUT_EVENTS 256
+#define NCRM_MAX_CONTROL_EVENTS 256
+#define NCRM_MAX_DATA_EVENTS (NCRM_MAX_EVENTS_IN_QUEUE \
+                             - NCRM_MAX_INPUT_EVENTS - NCRM_MAX_CONTROL_EVENTS)
+/** Max number of distinct targets (event type and extension) of coalesced
+ * events */
+#define NCRM_MAX_COALESCING_TARGETS 32
 
 enum ncrm_EventType {
     ncrm_kEventUnknown = 0x0,
@@ -30,6 +45,78 @@ enum ncrm_EventType {
     ncrm_kEventExtension = 0x3,
     ncrm_kEventHeaderUpdate = 0x4,
     ncrm_kEventFooterUpdate = 0x5,
+    ncrm_kEventExtensionReady = 0x6,
+};
+/** Number of event types (to index per-type data) */
+#define NCRM_N_EVENT_TYPES 7
+
+/** Event classes, in order of priority: consumer handles all pending events
+ * of higher class first */
+enum ncrm_EventClass {
+    /** User input (keypresses) */
+    ncrm_kEventClassInput = 0,
+    /** UI control: timer ticks, header/footer updates, etc */
+    ncrm_kEventClassControl = 1,
+    /** Bulk data updates for extensions */
+    ncrm_kEventClassData = 2,
+};
+#define NCRM_N_EVENT_CLASSES 3
+
+/** What producer does when the ring of its event's class is full */
+enum ncrm_OverflowPolicy {
+    /** Event being enqueued is dropped (default) */
+    ncrm_kOverflowDropNewest = 0,
+    /** Oldest pending event of the same type (and extension) is replaced
+     * with the new one, in place */
+    ncrm_kOverflowDropOldest = 1,
+    /** Event is counted in `nCoalesced` of the latest pending event of the
+     * same type (and extension); payload of the new event is lost */
+    ncrm_kOverflowCoalesce = 2,
+    /** Producer waits for free slot not longer than `blockTimeoutMSec` (if
+     * zero, till producer is cancelled), then drops the event */
+    ncrm_kOverflowBlock = 3,
+};
+
+/**\brief Source of events with its overflow policy and counters
+ *
+ * Producers are registered once by `ncrm_producer_init()` and never
+ * released (usually they are static objects of the threads emitting
+ * events). Counters are updated atomically and can be read from any
+ * thread. */
+struct ncrm_Producer {
+    /** Name shown in diagnostics */
+    const char * name;
+    enum ncrm_OverflowPolicy overflowPolicy;
+    /** Max time to wait for free slot, for `ncrm_kOverflowBlock`; zero for
+     * no limit */
+    unsigned int blockTimeoutMSec;
+    /** Set by `ncrm_producer_cancel()`, blocked producer gives up waiting */
+    atomic_int cancelled;
+
+    /** Number of events accepted by queue (including coalesced ones) */
+    atomic_ulong nEnqueued;
+    /** Number of events lost due to overflow (for "drop oldest" policy,
+     * these are pending events replaced by this producer) */
+    atomic_ulong nDropped;
+    /** Number of events coalesced into pending ones due to overflow */
+    atomic_ulong nOverflowMerged;
+
+    /** Next registered producer */
+    struct ncrm_Producer * next;
+};
+
+/** Snapshot of queue counters */
+struct ncrm_QueueStats {
+    /** Number of pending events, per class */
+    unsigned long depth[NCRM_N_EVENT_CLASSES];
+    /** Max number of pending events ever observed, per class */
+    unsigned long highWater[NCRM_N_EVENT_CLASSES];
+    /** Capacity of ring, per class */
+    unsigned long capacity[NCRM_N_EVENT_CLASSES];
+    /** Total number of events lost due to overflow (all producers) */
+    unsigned long nDropped;
+    /** Total number of events coalesced due to overflow */
+    unsigned long nOverflowMerged;
 };
 
 /**\brief Representation of asynchroneous event (subject of event queue) */
@@ -41,6 +128,7 @@ struct ncrm_Event {
      *  0x3  -- to be dispatched to an extension
      *  0x4  -- header update
      *  0x5  -- footer update
+     *  0x6  -- extension's content prepared by render thread is ready
      *  ...
      * */
     enum ncrm_EventType type;
@@ -48,10 +136,18 @@ struct ncrm_Event {
     union Payload {
         unsigned int keycode;
         struct {
-            char extensionName[16];
-            void * data;
+            /** ID of addressed extension (see `ncrm_Extension::id`) */
+            uint16_t extensionID;
+            /** (optional) Data for extension (see `ncrm_payload.h`), queue
+             * owns one reference of it */
+            struct ncrm_Payload * data;
         } forExtension;
     } payload;
+    /** Number of events coalesced into this one (set by queue) */
+    unsigned int nCoalesced;
+    /** Time event was enqueued, `CLOCK_MONOTONIC` (set by queue); for
+     * coalesced events -- time of the first one */
+    struct timespec enqueueTime;
 };
 
 /** Initializes global internal event queue object */
@@ -59,11 +155,63 @@ void ncrm_queue_init();
 /** Properly releases event queue object */
 void ncrm_queue_free();
 
-/** Adds event to queue; event instance is copied once call (ownership not
- * transferred). */
+/** Returns class (priority) of the event */
+enum ncrm_EventClass ncrm_event_class(const struct ncrm_Event *);
+/** Returns non-zero for idempotent event types (ticks, header and footer
+ * updates, extension updates without payload). At most one event of such
+ * type (per extension) is pending in the queue: repeated ones are only
+ * counted in its `nCoalesced` */
+int ncrm_event_is_coalescing(const struct ncrm_Event *);
+/** Returns payload of extension event, if any */
+struct ncrm_Payload * ncrm_event_payload(const struct ncrm_Event *);
+
+/** Initializes and registers producer with given overflow policy */
+void ncrm_producer_init( struct ncrm_Producer *
+                       , const char * name
+                       , enum ncrm_OverflowPolicy
+                       , unsigned int blockTimeoutMSec );
+/** Makes producer give up waiting for free slot, now and further on (for
+ * producing threads to be stopped while consumer does not drain the queue
+ * anymore) */
+void ncrm_producer_cancel( struct ncrm_Producer * );
+/** Returns first registered producer (iterate with `next`), including
+ * default one used by `ncrm_enqueue()` */
+struct ncrm_Producer * ncrm_producers();
+
+/** Adds event to queue; event instance is copied once call, while
+ * reference of event's payload (if any) is transferred to the queue. If the
+ * ring of the event's class is full, producer's overflow policy is applied
+ * (events with payload are never coalesced). Returns -1 if event was
+ * dropped. */
+int ncrm_enqueue_from( struct ncrm_Producer *, struct ncrm_Event * );
+/** Same as `ncrm_enqueue_from()` for default producer (drops newest) */
 int ncrm_enqueue( struct ncrm_Event * );
+/** Fills in the snapshot of queue counters */
+void ncrm_queue_stats( struct ncrm_QueueStats * );
 /** For non-empty queue, a callback will be called for each event (with user
- * data provided). Event queue is cleared. */
+ * data provided), higher classes first. Events are taken from the queue
+ * before callbacks are invoked, so producers do not wait for event
+ * handling. Payloads of events are released after callback returns. */
 int ncrm_do_with_events( void(*)(struct ncrm_Event *, void*), void *);
+/** Same as `ncrm_do_with_events()`, but waits for events not longer than
+ * till given deadline (`CLOCK_MONOTONIC`, null for no limit). Returns 1 if
+ * deadline expired with no events. */
+int ncrm_do_with_events_until( void(*)(struct ncrm_Event *, void*), void *
+                             , const struct timespec * deadline );
+/** Handles pending events without waiting. Returns number of events
+ * handled. */
+unsigned int ncrm_do_with_events_nowait( void(*)(struct ncrm_Event *, void*)
+                                       , void * );
+
+/** Returns descriptor becoming readable when event is enqueued while
+ * consumer sleeps, for consumers waiting in their own poll/epoll loop (see
+ * `ncrm_queue_sleep_begin()`) */
+int ncrm_queue_fd();
+/** Shall be called by consumer right before it goes to sleep on
+ * `ncrm_queue_fd()`, so producers know they have to wake it up. Returns
+ * non-zero if events are pending already (then consumer must not sleep) */
+int ncrm_queue_sleep_begin();
+/** Shall be called by consumer after it woke up */
+void ncrm_queue_sleep_end();
 
 #endif  /* H_NCRM_QUEUE_H */
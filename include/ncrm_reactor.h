@@ -0,0 +1,63 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef H_NCRM_REACTOR_H
+#define H_NCRM_REACTOR_H
+
+/**\file
+ * \brief Main thread's reactor multiplexing all event sources with epoll
+ *
+ * Sources are file descriptors: stdin, timers (timerfd) and event queue's
+ * wakeup eventfd. Main thread sleeps in `ncrm_reactor_run_until()` until any
+ * of them becomes readable and callbacks are invoked right on the main
+ * thread, so no helper threads poll for input or ticks. 0MQ sockets are
+ * served by the journal's ingest threads, which deliver data through the
+ * queue.
+ *
+ * Sources are level-triggered: callback may handle part of available data,
+ * it is invoked again at the next run while descriptor stays readable.
+ * */
+
+#include <time.h>
+
+/** Max number of sources */
+#define NCRM_REACTOR_MAX_SOURCES 16
+
+/** Invoked when descriptor is readable */
+typedef void (*ncrm_ReactorCallback)(int fd, void * userData);
+
+/** Creates reactor's epoll instance */
+void ncrm_reactor_init();
+/** Closes reactor's epoll instance and timers created by reactor */
+void ncrm_reactor_free();
+
+/** Adds readable source. Returns -1 on failure. */
+int ncrm_reactor_add( int fd, ncrm_ReactorCallback, void * userData );
+/** Removes source (may be called from within callback) */
+void ncrm_reactor_remove( int fd );
+/** Creates periodic timer (timerfd) and adds it as source. Callback has to
+ * read expirations count (`uint64_t`) from the descriptor. Returns
+ * descriptor or -1 on failure. */
+int ncrm_reactor_add_timer( unsigned int periodMSec
+                          , ncrm_ReactorCallback, void * userData );
+
+/** Waits till at least one source is ready, but not longer than till the
+ * deadline (`CLOCK_MONOTONIC`, null for no limit), and invokes callbacks of
+ * ready sources. Returns 1 if deadline expired with no source ready. */
+int ncrm_reactor_run_until( const struct timespec * deadline );
+
+#endif  /* H_NCRM_REACTOR_H */
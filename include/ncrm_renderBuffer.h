@@ -0,0 +1,100 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_NCRM_RENDER_BUFFER_H
+#define H_NCRM_RENDER_BUFFER_H
+
+/**\file
+ * \brief Render buffer -- window content prepared apart from ncurses
+ *
+ * Since ncurses is not thread-safe, extensions that prepare their content
+ * on a render thread (see `ncrm_Extension::prepare()`) put it into a render
+ * buffer instead of the window. Buffer keeps what has to be changed in the
+ * window: optional scroll and erase, rows to be cleared and spans of text of
+ * the same attributes. Drawing the buffer (done on main thread) is then a
+ * plain copy.
+ * */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <curses.h>
+
+/** Reallocation stride for spans and text of render buffer */
+#define NCRM_RENDER_BUFFER_INC 1024
+
+/** Span of text of the same attributes within a row */
+struct ncrm_RenderSpan {
+    /** Row and column the span starts at */
+    uint16_t row, col;
+    /** Attributes of the span */
+    attr_t attrs;
+    /** If non-zero, a line-drawing character (as in `acs_map`, e.g. 'x'
+     * for `ACS_VLINE`) is drawn instead of the text */
+    char acs;
+    /** Length of the span text (bytes) */
+    uint16_t len;
+    /** Offset of the span text in buffer's text */
+    uint32_t textOffset;
+};
+
+struct ncrm_RenderBuffer {
+    /** Number of rows of the window */
+    uint16_t nRows;
+    /** Set if whole window has to be erased before drawing */
+    uint16_t erase:1;
+    /** Number of lines to scroll the window by (positive is up) before
+     * drawing */
+    int32_t scroll;
+    /** Flags of rows to be cleared before drawing the spans */
+    uint8_t * clearRows;
+    /** Spans to draw, in order */
+    struct ncrm_RenderSpan * spans;
+    uint32_t nSpans, nSpansAllocated;
+    /** Text of the spans (not null-terminated) */
+    char * text;
+    uint32_t textLen, textAllocated;
+};
+
+/** Initializes empty buffer */
+void ncrm_rb_init( struct ncrm_RenderBuffer * );
+/** Frees the buffer */
+void ncrm_rb_free( struct ncrm_RenderBuffer * );
+
+/** Drops buffer content, making it a buffer of `nRows` with nothing to
+ * change in the window */
+void ncrm_rb_reset( struct ncrm_RenderBuffer *, uint16_t nRows );
+/** Returns non-zero if buffer does not change anything */
+int ncrm_rb_is_empty( const struct ncrm_RenderBuffer * );
+
+/** Marks row to be cleared before drawing */
+void ncrm_rb_clear_row( struct ncrm_RenderBuffer *, uint16_t row );
+/** Adds (UTF-8) text span, returns number of columns it occupies */
+uint16_t ncrm_rb_put( struct ncrm_RenderBuffer *
+                    , uint16_t row, uint16_t col, attr_t attrs
+                    , const char * text, size_t nBytes );
+/** Adds span of `n` same (ASCII) characters */
+void ncrm_rb_fill( struct ncrm_RenderBuffer *
+                 , uint16_t row, uint16_t col, attr_t attrs
+                 , char c, uint16_t n );
+/** Adds line-drawing character */
+void ncrm_rb_put_acs( struct ncrm_RenderBuffer *
+                    , uint16_t row, uint16_t col, attr_t attrs
+                    , char acs );
+
+/** Applies buffer to the window. Must be called from main thread */
+void ncrm_rb_draw( const struct ncrm_RenderBuffer *, WINDOW * );
+
+#endif  /* H_NCRM_RENDER_BUFFER_H */
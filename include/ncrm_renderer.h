@@ -0,0 +1,80 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_NCRM_RENDERER_H
+#define H_NCRM_RENDERER_H
+
+/**\file
+ * \brief Render thread preparing extensions' content off the main thread
+ *
+ * Extensions implementing `ncrm_Extension::prepare()` get their events
+ * (keypresses and updates) on the render thread. Content is prepared into
+ * one of two buffers (back buffer) while main thread presents the other
+ * (front buffer) with ncurses. Extension is prepared again only after its
+ * previous buffer was presented, so frames are never lost -- which is
+ * important for buffers describing incremental changes. Meanwhile, events
+ * coming for the extension are accumulated till the next prepare call.
+ *
+ * Only the active extension (shown tab) is prepared as soon as events come
+ * and only its buffers are presented. Inbox of a background extension just
+ * absorbs events (plain updates are coalesced, payloads are kept by
+ * reference) and is prepared at once when extension gets activated, or
+ * earlier if many payloads are pending; then its buffer is kept ready till
+ * activation. Events with payload (e.g. journal entries) are never
+ * rejected: inbox grows till the extension is prepared.
+ * */
+
+#include "ncrm_queue.h"
+#include "ncrm_latency.h"
+
+#include <stdint.h>
+
+/** Max number of events without payload accumulated for an extension till
+ * prepare call */
+#define NCRM_RENDERER_MAX_EVENTS 64
+/** Number of events with payload accumulated by background extension at
+ * which it is prepared (if it has no ready buffer), releasing them */
+#define NCRM_RENDERER_BACKGROUND_PAYLOADS 512
+
+struct ncrm_Extension;
+
+/** Starts render thread serving given (null-terminated) extensions */
+void ncrm_renderer_init( struct ncrm_Extension ** extensions );
+/** Stops render thread */
+void ncrm_renderer_free();
+
+/**\brief Posts event to be handled by extension's `prepare()`
+ *
+ * Keypresses and events with payload are accumulated in order, other events
+ * of the same type are coalesced (the latest is kept). Renderer takes own
+ * reference of the payload and releases it after `prepare()`. Returns
+ * non-zero if event was dropped due to overflow (events with payload are
+ * never dropped). */
+int ncrm_renderer_post( uint16_t nExt, const struct ncrm_Event * );
+
+/** Marks extension as active (shown) or background one. Events absorbed by
+ * extension in background get prepared on activation */
+void ncrm_renderer_activate( uint16_t nExt, int active );
+
+/** Returns number of buffer prepared for an extension to be presented, or -1
+ * if there is none */
+int ncrm_renderer_ready( uint16_t nExt );
+/** Notifies render thread that ready buffer of an extension was presented */
+void ncrm_renderer_presented( uint16_t nExt );
+/** Copies histogram of extension's `prepare()` durations */
+void ncrm_renderer_latency( uint16_t nExt, struct ncrm_LatencyHistogram * );
+
+#endif  /* H_NCRM_RENDERER_H */
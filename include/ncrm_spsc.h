@@ -0,0 +1,67 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef H_NCRM_SPSC_H
+#define H_NCRM_SPSC_H
+
+/**\file
+ * \brief Bounded single-producer single-consumer queue of pointers
+ *
+ * Connects stages of a pipeline run by threads. Push and pop are lock-free;
+ * blocking variants sleep on a condition only when queue is full (empty),
+ * and the other side takes the lock only if somebody sleeps.
+ *
+ * Once queue is closed, producer's pushes fail, consumer gets what was left
+ * and then fails too.
+ * */
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <pthread.h>
+
+struct ncrm_SPSCQueue {
+    void ** items;
+    size_t mask;
+    /** Next position to pop (modified by consumer only) */
+    _Alignas(64) atomic_size_t head;
+    /** Next position to push (modified by producer only) */
+    _Alignas(64) atomic_size_t tail;
+    _Alignas(64) atomic_int nSleeping;
+    atomic_int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t cv;
+};
+
+/** Initializes queue of given capacity (rounded up to power of 2) */
+void ncrm_spsc_init( struct ncrm_SPSCQueue *, size_t capacity );
+/** Frees queue; items left are not touched */
+void ncrm_spsc_free( struct ncrm_SPSCQueue * );
+
+/** Pushes item, returns non-zero if queue is full */
+int ncrm_spsc_try_push( struct ncrm_SPSCQueue *, void * item );
+/** Pops item, returns non-zero if queue is empty */
+int ncrm_spsc_try_pop( struct ncrm_SPSCQueue *, void ** item );
+/** Pushes item waiting for free place; returns non-zero if queue was
+ * closed (item is not pushed) */
+int ncrm_spsc_push( struct ncrm_SPSCQueue *, void * item );
+/** Pops item waiting for one; returns non-zero if queue was closed and
+ * nothing is left */
+int ncrm_spsc_pop( struct ncrm_SPSCQueue *, void ** item );
+/** Closes queue, waking up both sides */
+void ncrm_spsc_close( struct ncrm_SPSCQueue * );
+
+#endif  /* H_NCRM_SPSC_H */
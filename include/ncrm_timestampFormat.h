@@ -0,0 +1,123 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_NCRM_TIMESTAMP_FORMAT_H
+#define H_NCRM_TIMESTAMP_FORMAT_H
+
+/**\file
+ * \brief Timestamp formatting engine for journal entries
+ *
+ * Formatter is set up from a strftime-like specification string once,
+ * "compiling" it into a sequence of operations. Supported conversions:
+ *  - `%D` -- days (day of month in wall-clock mode)
+ *  - `%H` -- hours (total hours in relative/elapsed mode, if spec has
+ *    no `%D`)
+ *  - `%M`, `%S` -- minutes and seconds
+ *  - `%f` -- milliseconds
+ *  - `%%` -- percent sign
+ * Other characters are copied as is.
+ *
+ * Since consecutive timestamps usually differ only in seconds and
+ * milliseconds, formatter keeps the high-order part (up to minutes)
+ * of last formatted timestamp and re-uses it if the minute did not change.
+ * */
+
+#include <stdint.h>
+#include <limits.h>
+
+/** A journal message timestamp type (msec) */
+typedef unsigned long ncrm_Timestamp_t;
+
+/** Max number of operations in compiled timestamp format */
+#define NCRM_TIMESTAMP_FORMAT_MAX_OPS 16
+/** Max number of literal chars in timestamp format */
+#define NCRM_TIMESTAMP_FORMAT_MAX_LITERALS 32
+/** Max length of high-order part of the formatted timestamp kept */
+#define NCRM_TIMESTAMP_FORMAT_MAX_PREFIX 32
+/** Special value of timestamp meaning "no preceding timestamp" */
+#define NCRM_TIMESTAMP_NONE ULONG_MAX
+
+/** How timestamp is shown */
+enum ncrm_TimestampMode {
+    /** Local time of the day (timestamp is msec since epoch) */
+    ncrm_kTimestampWallClock = 0,
+    /** Time since reference point (timestamp is msec since reference) */
+    ncrm_kTimestampRelative = 1,
+    /** Time since preceding entry */
+    ncrm_kTimestampElapsed = 2,
+};
+
+/** Single operation of compiled timestamp format */
+struct ncrm_TimestampFormatOp {
+    /** Conversion char (`D`, `H`, `M`, `S`, `f`) or zero for literal */
+    char code;
+    /** Literal: offset and length in the literals buffer */
+    uint8_t litOffset, litLen;
+};
+
+/**\brief Timestamp formatting settings */
+struct ncrm_JournalTimestampFormat {
+    /** Shall format given timestamp, write the string to `dest` and return
+     * count of meaningful bytes (zero termination is not necessary). Second
+     * timestamp is the preceding one (if any, `NCRM_TIMESTAMP_NONE`
+     * otherwise). Set by `ncrm_tsf_compile()`, but might be overriden by
+     * custom function. */
+    uint16_t (*callback)( struct ncrm_JournalTimestampFormat *
+                        , char * dest
+                        , ncrm_Timestamp_t
+                        , ncrm_Timestamp_t
+                        );
+    /** Timestamp mode */
+    enum ncrm_TimestampMode mode;
+    /** Reference point for relative mode */
+    ncrm_Timestamp_t reference;
+
+    /** Compiled format */
+    struct ncrm_TimestampFormatOp ops[NCRM_TIMESTAMP_FORMAT_MAX_OPS];
+    uint8_t nOps;
+    /** Number of leading operations forming high-order part (up to
+     * minutes) */
+    uint8_t nPrefixOps;
+    /** Set if spec has days conversion */
+    uint8_t hasDays;
+    char literals[NCRM_TIMESTAMP_FORMAT_MAX_LITERALS];
+
+    /** Cached high-order part of last formatted timestamp and minute it was
+     * formatted for */
+    unsigned long prefixMinute;
+    char prefix[NCRM_TIMESTAMP_FORMAT_MAX_PREFIX];
+    uint8_t prefixLen;
+};
+
+/**\brief Compiles timestamp format specification
+ *
+ * Returns zero on success, -1 if format is too long or has unsupported
+ * conversion. */
+int ncrm_tsf_compile( struct ncrm_JournalTimestampFormat *
+                    , const char * spec
+                    , enum ncrm_TimestampMode mode );
+
+/** Switches formatter to another mode (drops cached high-order part) */
+void ncrm_tsf_set_mode( struct ncrm_JournalTimestampFormat *
+                      , enum ncrm_TimestampMode mode );
+
+/** Formats timestamp according to compiled spec, used as `callback` */
+uint16_t ncrm_tsf_format( struct ncrm_JournalTimestampFormat *
+                        , char * dest
+                        , ncrm_Timestamp_t timest
+                        , ncrm_Timestamp_t prevTimest );
+
+#endif  /* H_NCRM_TIMESTAMP_FORMAT_H */
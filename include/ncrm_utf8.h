@@ -0,0 +1,55 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_NCRM_UTF8_H
+#define H_NCRM_UTF8_H
+
+/**\file
+ * \brief Display width of UTF-8 strings
+ *
+ * Log messages and status strings are UTF-8 encoded, so number of bytes
+ * differs from number of columns they occupy on the screen. Routines here
+ * compute display width (with `wcwidth()`, so locale has to be set) and
+ * detect pure-ASCII runs word-by-word, so the common case of ASCII text
+ * costs roughly as much as plain byte counting.
+ * */
+
+#include <stddef.h>
+
+/** Returns length of leading run of ASCII chars within the first `nBytes`
+ * of the string, not including newline or null character. Never reads past
+ * `nBytes` */
+size_t ncrm_u8_ascii_run( const char * s, size_t nBytes );
+
+/** Decodes single UTF-8 char, returns number of bytes consumed (at least 1
+ * for non-null char; malformed sequences are taken as single byte) and sets
+ * display width of the char. */
+int ncrm_u8_next( const char * s, int * width );
+
+/** Returns number of columns occupied by (at most) `nBytes` of the string
+ * (up to null char, if any) */
+size_t ncrm_u8_width( const char * s, size_t nBytes );
+
+/**\brief Finds part of a line fitting given number of columns
+ *
+ * Returns number of bytes of the leading part of string's first line (i.e.
+ * up to a newline or null char, within `nBytes`) which fits into `maxCols`
+ * columns. Number of columns it occupies is written into `cols` (if not
+ * null). */
+size_t ncrm_u8_fit( const char * s, size_t nBytes
+                  , size_t maxCols, size_t * cols );
+
+#endif  /* H_NCRM_UTF8_H */
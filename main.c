@@ -3,6 +3,10 @@
 #include "ncrm_queue.h"
 
 #include "ncrm_journalEntries.h"
+#include "ncrm_utf8.h"
+#include "ncrm_renderer.h"
+#include "ncrm_latency.h"
+#include "ncrm_reactor.h"
 
 #include <panel.h>
 #include <assert.h>
@@ -11,8 +15,17 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <limits.h>
+#include <time.h>
+#include <locale.h>
 
 #define NCRM_MAX_STATUSBAR_TXT_LEN 128
+/** Default limit of screen updates per second */
+#define NCRM_DEFAULT_MAX_FPS 30
+/** Period of timer ticks (animations, footer updates), msec */
+#define NCRM_TICK_PERIOD_MSEC 100
+/** Max number of events kept for `update()`-style extension till next frame
+ * (or till activation, for background tab) */
+#define NCRM_EXTENSION_INBOX_SIZE 64
 
 /* A draft for curses-based pipeline monitoring application
  *
@@ -33,6 +46,18 @@ ____________________________/ handlers /_calibrations_
  * Note: currently, only progress/journal messages supported.
  * */
 
+/** Events pending for `update()`-style extension (extensions with
+ * `prepare()` use renderer's inbox instead). Updates without payload are
+ * coalesced, events with payload are kept in order; on overflow the oldest
+ * one is dropped */
+struct ExtensionInbox {
+    struct ncrm_Event events[NCRM_EXTENSION_INBOX_SIZE];
+    uint16_t nEvents;
+    /** Number of events dropped on overflow (of this inbox, or of
+     * renderer's one for extensions with `prepare()`) */
+    unsigned long nDropped;
+};
+
 static struct App {
     /** Model to show */
     struct ncrm_Model * model;
@@ -43,7 +68,20 @@ static struct App {
     uint16_t lines:10
            , columns:10
            , exitFlag:1
+           /* set when header/footer has to be redrawn at next frame */
+           , pendingHeader:1
+           , pendingFooter:1
+           /* set when render thread has prepared content to present */
+           , pendingPresent:1
+           /* set when windows were modified and screen has to be updated */
+           , screenDirty:1
+           /* set when diagnostics screen is shown */
+           , diagnosticsShown:1
            ;
+    /** Max number of frames (screen updates) per second */
+    uint16_t maxFPS;
+    /** Time of next frame allowed */
+    struct timespec nextFrame;
 
     /** A window/panel showing tabs. It is always of full width and
      * of 1 height. It is always visible and can not be cycled. */
@@ -54,34 +92,29 @@ static struct App {
      * can not be cycled */
     WINDOW * w_statusFooter;
     PANEL * p_statusFooter;
+    /** A window/panel showing diagnostics (event dispatch latency and
+     * queue counters) above the extensions. Toggled with 'D' */
+    WINDOW * w_diagnostics;
+    PANEL * p_diagnostics;
 
-    /** Null-terminated set of extensions */
+    /** Null-terminated set of extensions, indexed by their IDs */
     struct ncrm_Extension ** extensions;
+    uint16_t nExtensions;
     /** Number of active extension */
     int8_t nActiveExtension;
-} gApp;
+    /** Events pending for extensions till the next frame (active one) or
+     * till activation (background ones), per extension */
+    struct ExtensionInbox * extInboxes;
 
-/** This function just emits updates periodically. */
-static void *
-_idle_updater(void * _) {
-    for(;;) {
-        struct ncrm_Event event = { ncrm_kEventIncrementUpdateCount };
-        ncrm_enqueue(&event);
-        usleep(1.e5);
-    }
-    return NULL;
-}
-
-static void *
-_user_input(void * _) {
-    struct ncrm_Event event = { ncrm_kEventKeypress };
-    while(read( STDIN_FILENO
-              , &event.payload.keycode
-              , sizeof(event.payload.keycode)) != 0) {
-        ncrm_enqueue(&event);
-    }
-    return NULL;
-}
+    /** Time events wait in the queue and time of their handling, per event
+     * type */
+    struct ncrm_LatencyHistogram queueWait[NCRM_N_EVENT_TYPES]
+                               , handling[NCRM_N_EVENT_TYPES];
+    /** Per extension: time events addressed to extension wait in the queue,
+     * and durations of its `update()` or `present()` calls */
+    struct ncrm_LatencyHistogram * extQueueWait
+                               , * extHandling;
+} gApp;
 
 void
 init_wins() {
@@ -97,9 +130,13 @@ init_wins() {
                                 , gApp.lines - 1  /* Y of LT corner */
                                 , 0  /* X of LT corner */
                                 );
+    /* Create the "diagnostics" window, shown on demand */
+    gApp.w_diagnostics = newwin( gApp.lines - 2, gApp.columns, 1, 0 );
     /* Create panels for header and footer */
     gApp.p_tabsHeader   = new_panel(gApp.w_tabsHeader);
     gApp.p_statusFooter = new_panel(gApp.w_statusFooter);
+    gApp.p_diagnostics  = new_panel(gApp.w_diagnostics);
+    hide_panel(gApp.p_diagnostics);
 }
 
 void
@@ -201,7 +238,7 @@ static int _progress__percentage(char * bf) {
     /* calc progress estimation */
     const float p = gApp.model->currentProgress / ((float) gApp.model->maxProgress);
     return snprintf( bf, NCRM_MAX_STATUSBAR_TXT_LEN
-                   , " %4.1f%%%% ", p*100);
+                   , " %4.1f%% ", p*100);
 }
 
 static int _progress__nprocessed(char * bf) {
@@ -242,38 +279,6 @@ static int _status_format_time(unsigned long timeMSec, char * bf) {
     return nUsed;
 }
 
-/* A simple timestamp formatter for journal entries wrapping the main one.
- * Not much customizable. Assumes timestamp to be in microseconds. */
-static uint16_t
-_journal_timestamp_formatter( struct ncrm_JournalTimestampFormat * fmtObj
-                            , char * bf
-                            , uint64_t timeMSec
-                            ) {
-    unsigned long epsTimeSec = timeMSec / 1e3;  /* msec to sec */
-    if(!epsTimeSec)
-        return snprintf( bf, NCRM_MAX_STATUSBAR_TXT_LEN
-                       , "%lums", timeMSec );
-    int days = epsTimeSec/(24*60*60)
-      , hours = (epsTimeSec - days*(24*60*60))/(60*60)
-      , mins = (epsTimeSec - days*(24*60*60) - hours*(60*60) )/60
-      , sec = epsTimeSec%60
-      , msec = timeMSec%1000;
-      ;
-    int32_t nUsed = 0;
-    if( days )
-        nUsed += snprintf( bf, NCRM_MAX_STATUSBAR_TXT_LEN, "%dd,", days );
-    if( hours || days )
-        nUsed += snprintf( bf + nUsed, (NCRM_MAX_STATUSBAR_TXT_LEN - nUsed)
-                         , "%02d:", hours );
-    nUsed += snprintf( bf + nUsed, (NCRM_MAX_STATUSBAR_TXT_LEN - nUsed)
-                     , "%02d:", mins );
-    nUsed += snprintf( bf + nUsed, (NCRM_MAX_STATUSBAR_TXT_LEN - nUsed)
-                     , "%02d:", sec );
-    nUsed += snprintf( bf + nUsed, (NCRM_MAX_STATUSBAR_TXT_LEN - nUsed)
-                     , "%03d", msec );
-    return nUsed;
-}
-
 static int _progress__elapsed(char * bf) {
     /* produces elapsed time string, like " 3d,01:02:03 eps. " (days, hours,
      * minutes, seconds) */
@@ -414,6 +419,27 @@ static int _progress__status_msg(char * bf) {
                    );
 }
 
+static int _progress__queue_stats(char * bf) {
+    /* produces monitor's own queue status, like " Q:12/1020 drop:34 ", only
+     * if events were lost or queue was close to overflow */
+    assert(gApp.model);
+    const struct ncrm_QueueStats * qs = &gApp.model->queueStats;
+    unsigned long depth = 0, highWater = 0;
+    int nearlyFull = 0;
+    for( int nClass = 0; nClass < NCRM_N_EVENT_CLASSES; ++nClass ) {
+        depth += qs->depth[nClass];
+        highWater += qs->highWater[nClass];
+        if( qs->highWater[nClass]*4 >= qs->capacity[nClass]*3 )
+            nearlyFull = 1;
+    }
+    if( !(nearlyFull || qs->nDropped || qs->nOverflowMerged) ) return 0;
+    if( !qs->nDropped )
+        return snprintf( bf, NCRM_MAX_STATUSBAR_TXT_LEN
+                       , " Q:%lu/%lu ", depth, highWater );
+    return snprintf( bf, NCRM_MAX_STATUSBAR_TXT_LEN
+                   , " Q:%lu/%lu drop:%lu ", depth, highWater, qs->nDropped );
+}
+
 static const struct ProgressInfoEntry {
     /* Priority and order number: in progress bar mode, in spinner mode.
      * Zero priority means that entry is not used in this mode */
@@ -433,13 +459,17 @@ static const struct ProgressInfoEntry {
     { {{ 5, 6}, { 3,  4}}, _progress__proc_speed     , A_NORMAL },
     { {{98,-1}, { 1,  1}}, _progress__spinner        , A_NORMAL },
     { {{ 0, 0}, { 0,  0}}, _progress__status_msg     , A_REVERSE | A_BOLD },
+    { {{ 7, 7}, { 5,  5}}, _progress__queue_stats    , A_BOLD },
     { {{99,-1}, {99, -1}}, NULL }  /* sentinel */
 };
 
 struct ProgressInfoEntryHandle {
     const struct ProgressInfoEntry * pie;
     char buf[NCRM_MAX_STATUSBAR_TXT_LEN];
+    /* number of columns occupied by the string */
     int occupied;
+    /* length of the (UTF-8) string in bytes */
+    int nBytes;
 };
 
 static int _process__sort_by_pbar_priority(const void * a_, const void * b_) {
@@ -489,9 +519,12 @@ update_footer( int maxlen ) {
     wattrset(gApp.w_statusFooter, footerAttrs );
     whline(gApp.w_statusFooter, ACS_S1, gApp.columns);
 
+    if(!gApp.model) return;
     pthread_mutex_lock(&gApp.model->lock);
-
-    if((!gApp.model) || !gApp.model->currentProgress) return;
+    if(!gApp.model->currentProgress) {
+        pthread_mutex_unlock(&gApp.model->lock);
+        return;
+    }
     static const int nWidgets = sizeof(gProgressInfoEntries)/sizeof(*gProgressInfoEntries);
     struct ProgressInfoEntryHandle piehs[sizeof(gProgressInfoEntries)/sizeof(*gProgressInfoEntries)];
     int pIdx = gApp.model->maxProgress ? 0 : 1
@@ -503,6 +536,7 @@ update_footer( int maxlen ) {
        ; ++pce, ++i ) {
         piehs[i].pie = pce;
         piehs[i].buf[0] = '\0';
+        piehs[i].nBytes = 0;
 
         if(pce->orp[pIdx][1] == -1) {  /* widget is not used */
             /* ^^^ valgrind complains about uninitialized value here, but how
@@ -526,16 +560,17 @@ update_footer( int maxlen ) {
             continue;
         }
         if( overallChars < maxlen ) {
-            piehs[i].occupied = piehs[i].pie->print_callback(piehs[i].buf);
+            piehs[i].nBytes = piehs[i].pie->print_callback(piehs[i].buf);
+            piehs[i].occupied = ncrm_u8_width(piehs[i].buf, piehs[i].nBytes);
             overallChars += piehs[i].occupied;
             if( overallChars >= maxlen ) {
                 /* cancel this string */
                 piehs[i].buf[0] = '\0';
-                piehs[i].occupied = 0;
+                piehs[i].occupied = piehs[i].nBytes = 0;
             }
         } else {
             piehs[i].buf[0] = '\0';
-            piehs[i].occupied = 0;
+            piehs[i].occupied = piehs[i].nBytes = 0;
         }
     }
     /* sort handles according their order */
@@ -547,24 +582,20 @@ update_footer( int maxlen ) {
     for( struct ProgressInfoEntryHandle * pieh = piehs
        ; pieh->pie
        ; ++pieh ) {
-        if(pieh->occupied != strlen(pieh->buf)) {  // XXX, won't work in unicode case
-            printf("len(\"%s\") != %d\n", pieh->buf, pieh->occupied);
-            assert( 0 );
-        }
         if( pieh->occupied && overallChars + pieh->occupied <= maxlen ) {
             overallChars += pieh->occupied;
             wattrset(gApp.w_statusFooter, pieh->pie->attrs );
-            if(  piehs[i].occupied > NCRM_MAX_STATUSBAR_TXT_LEN - 3
-              || piehs[i].buf[piehs[i].occupied+1] != 0xAF
+            if(  pieh->nBytes > NCRM_MAX_STATUSBAR_TXT_LEN - 3
+              || ((unsigned char) pieh->buf[pieh->nBytes+1]) != 0xAF
               ) {
                 wattrset(gApp.w_statusFooter, pieh->pie->attrs );
             } else {
-                const int n = piehs[i].buf[piehs[i].occupied+2];
+                const int n = pieh->buf[pieh->nBytes+2];
                 assert(n < gNSpecialAttrs);
                 wattron(gApp.w_statusFooter, pieh->pie->attrs | gSpecialAttrs[n]);
             }
             
-            wprintw(gApp.w_statusFooter, pieh->buf);
+            waddnstr(gApp.w_statusFooter, pieh->buf, pieh->nBytes);
         }
     }
     waddch(gApp.w_statusFooter, '/');
@@ -572,52 +603,431 @@ update_footer( int maxlen ) {
     pthread_mutex_unlock(&gApp.model->lock);
 }
 
+/*
+ * Diagnostics screen
+ */
+
+static const char * gEventTypeNames[NCRM_N_EVENT_TYPES] = {
+    "unknown", "tick", "keypress", "extension", "header", "footer", "ready"
+};
+
+static void
+_diag_format_usec( char * bf, size_t n, unsigned long usec ) {
+    if( usec < 1000 )
+        snprintf(bf, n, "%luus", usec);
+    else if( usec < 1000000 )
+        snprintf(bf, n, "%.1fms", usec/1e3);
+    else
+        snprintf(bf, n, "%.2fs", usec/1e6);
+}
+
+static void
+_diag_print_histogram( int * row, const char * what, const char * name
+                     , const struct ncrm_LatencyHistogram * h ) {
+    if( !h->n ) return;
+    char p50[16], p99[16], max[16];
+    _diag_format_usec(p50, sizeof(p50), ncrm_lh_quantile(h, .5));
+    _diag_format_usec(p99, sizeof(p99), ncrm_lh_quantile(h, .99));
+    _diag_format_usec(max, sizeof(max), h->maxUSec);
+    mvwprintw( gApp.w_diagnostics, (*row)++, 1
+             , "%-10s %-16.16s %10lu %9s %9s %9s"
+             , what, name, h->n, p50, p99, max );
+}
+
+/* Redraws diagnostics screen */
 void
-process_event(struct ncrm_Event * eventPtr, void * _) {
-    /* Calls curses routines to update the GUI, may forward execution to
-     * extension's updating function */
+update_diagnostics() {
+    werase(gApp.w_diagnostics);
+    int row = 0;
+    wattrset(gApp.w_diagnostics, A_DIM);
+    mvwprintw(gApp.w_diagnostics, row++, 1, "Diagnostics (D to close)");
+    wattrset(gApp.w_diagnostics, A_BOLD);
+    mvwprintw( gApp.w_diagnostics, row++, 1
+             , "%-10s %-16s %10s %9s %9s %9s"
+             , "latency", "of", "n", "p50", "p99", "max" );
+    wattrset(gApp.w_diagnostics, A_NORMAL);
+    for( int nType = 0; nType < NCRM_N_EVENT_TYPES; ++nType )
+        _diag_print_histogram( &row, "in queue", gEventTypeNames[nType]
+                             , gApp.queueWait + nType );
+    for( int nType = 0; nType < NCRM_N_EVENT_TYPES; ++nType )
+        _diag_print_histogram( &row, "handling", gEventTypeNames[nType]
+                             , gApp.handling + nType );
+    uint16_t nExt = 0;
+    for( struct ncrm_Extension ** extPtr = gApp.extensions
+       ; *extPtr
+       ; ++extPtr, ++nExt ) {
+        _diag_print_histogram( &row, "in queue", (*extPtr)->name
+                             , gApp.extQueueWait + nExt );
+        _diag_print_histogram( &row, (*extPtr)->prepare ? "present" : "update"
+                             , (*extPtr)->name, gApp.extHandling + nExt );
+        if( gApp.extInboxes[nExt].nDropped )
+            mvwprintw( gApp.w_diagnostics, row++, 1
+                     , "%-10s %-16.16s %lu events dropped"
+                     , "inbox", (*extPtr)->name
+                     , gApp.extInboxes[nExt].nDropped );
+        if( (*extPtr)->prepare ) {
+            struct ncrm_LatencyHistogram h;
+            ncrm_renderer_latency(nExt, &h);
+            _diag_print_histogram(&row, "prepare", (*extPtr)->name, &h);
+        }
+    }
+    /* queue counters */
+    ++row;
+    struct ncrm_QueueStats qs;
+    ncrm_queue_stats(&qs);
+    wattrset(gApp.w_diagnostics, A_BOLD);
+    mvwprintw( gApp.w_diagnostics, row++, 1
+             , "%-27s %10s %9s %9s %9s", "queue", "enqueued", "dropped"
+             , "coalesced", "" );
+    wattrset(gApp.w_diagnostics, A_NORMAL);
+    for( struct ncrm_Producer * p = ncrm_producers(); p; p = p->next ) {
+        mvwprintw( gApp.w_diagnostics, row++, 1
+                 , "%-10s %-16.16s %10lu %9lu %9lu"
+                 , "producer", p->name
+                 , atomic_load(&p->nEnqueued)
+                 , atomic_load(&p->nDropped)
+                 , atomic_load(&p->nOverflowMerged) );
+    }
+    static const char * classNames[NCRM_N_EVENT_CLASSES]
+        = { "input", "control", "data" };
+    for( int nClass = 0; nClass < NCRM_N_EVENT_CLASSES; ++nClass ) {
+        mvwprintw( gApp.w_diagnostics, row++, 1
+                 , "%-10s %-16s depth %lu, high-water %lu of %lu"
+                 , "ring", classNames[nClass]
+                 , qs.depth[nClass], qs.highWater[nClass]
+                 , qs.capacity[nClass] );
+    }
+}
+
+/* Returns number of extension event is addressed to, or -1 */
+static int
+_event_extension( const struct ncrm_Event * eventPtr ) {
+    if( ncrm_kEventExtension != eventPtr->type
+     && ncrm_kEventExtensionReady != eventPtr->type ) return -1;
+    if( eventPtr->payload.forExtension.extensionID >= gApp.nExtensions )
+        return -1;
+    return eventPtr->payload.forExtension.extensionID;
+}
+
+/* Puts event into inbox of `update()`-style extension, taking reference of
+ * its payload */
+static void
+_inbox_put( struct ExtensionInbox * inbox, const struct ncrm_Event * eventPtr ) {
+    struct ncrm_Payload * payload = ncrm_event_payload(eventPtr);
+    if( !payload ) {
+        /* coalesce with pending update of the same type */
+        for( uint16_t i = 0; i < inbox->nEvents; ++i ) {
+            struct ncrm_Event * pending = inbox->events + i;
+            if( pending->type != eventPtr->type
+             || ncrm_event_payload(pending) ) continue;
+            const unsigned int nCoalesced = pending->nCoalesced;
+            memcpy(pending, eventPtr, sizeof(struct ncrm_Event));
+            pending->nCoalesced += nCoalesced;
+            return;
+        }
+    }
+    if( NCRM_EXTENSION_INBOX_SIZE == inbox->nEvents ) {
+        /* drop the oldest one */
+        ncrm_payload_unref(ncrm_event_payload(inbox->events));
+        memmove( inbox->events, inbox->events + 1
+               , (--inbox->nEvents)*sizeof(struct ncrm_Event) );
+        ++inbox->nDropped;
+    }
+    memcpy(inbox->events + inbox->nEvents++, eventPtr, sizeof(struct ncrm_Event));
+    ncrm_payload_ref(payload);
+}
+
+/* Switches to extension's tab. Extension is updated at the next frame with
+ * all the events it has absorbed in background */
+static void
+_activate_extension( uint16_t nExt ) {
+    if( nExt == gApp.nActiveExtension ) return;
+    struct ncrm_Extension * prev = gApp.extensions[gApp.nActiveExtension]
+                        , * ext = gApp.extensions[nExt]
+                        ;
+    if( prev->prepare )
+        ncrm_renderer_activate(gApp.nActiveExtension, 0);
+    if( prev->show ) prev->show(prev, 0);
+    if( ext->show ) ext->show(ext, 1);
+    gApp.nActiveExtension = nExt;
+    /* make extension redraw its content even if nothing was absorbed */
+    struct ncrm_Event event = { ncrm_kEventExtension };
+    event.payload.forExtension.extensionID = nExt;
+    event.nCoalesced = 1;
+    clock_gettime(CLOCK_MONOTONIC, &event.enqueueTime);
+    if( gApp.extensions[nExt]->prepare ) {
+        /* on overflow, extension has events to be prepared anyway */
+        if( ncrm_renderer_post(nExt, &event) )
+            ++gApp.extInboxes[nExt].nDropped;
+        ncrm_renderer_activate(nExt, 1);
+        /* buffer prepared in background, if any */
+        gApp.pendingPresent = 0x1;
+    } else {
+        _inbox_put(gApp.extInboxes + nExt, &event);
+    }
+    gApp.pendingHeader = 0x1;
+}
+
+/* Calls extension's `update()` measuring its duration */
+static void
+_timed_update( uint16_t nExt, struct ncrm_Event * eventPtr ) {
+    struct ncrm_Extension * ext = gApp.extensions[nExt];
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    ext->update(ext, eventPtr);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    ncrm_lh_add_interval(gApp.extHandling + nExt, &started, &finished);
+}
+
+static void
+_handle_event(struct ncrm_Event * eventPtr) {
+    /* Keypresses are handled immediately; other events only mark parts of
+     * the GUI to be updated at the next frame (see `render_frame()`) */
     if( ncrm_kEventIncrementUpdateCount == eventPtr->type ) {
-        ++gApp.updateCount;
-        update_footer(gApp.columns);
+        /* ticks are coalesced in the queue */
+        gApp.updateCount += eventPtr->nCoalesced;
+        if( gApp.model ) {
+            pthread_mutex_lock(&gApp.model->lock);
+            ncrm_queue_stats(&gApp.model->queueStats);
+            pthread_mutex_unlock(&gApp.model->lock);
+        }
+        gApp.pendingFooter = 0x1;
         return;
     }
     if( ncrm_kEventKeypress == eventPtr->type ) {  /* keypress event */
         if( eventPtr->payload.keycode == 'q' ) {  /* exit */
             gApp.exitFlag = 0x1;
+            return;
         }
-        /* ignore other keypresses */
-        return;
-    }
-    /* forward event to extension update; deny update if extension is NOT
-     * active */
-    if(ncrm_kEventExtension == eventPtr->type) {
+        if( eventPtr->payload.keycode == 'D' ) {  /* toggle diagnostics */
+            gApp.diagnosticsShown = !gApp.diagnosticsShown;
+            if( gApp.diagnosticsShown ) {
+                update_diagnostics();
+                top_panel(gApp.p_diagnostics);
+            } else {
+                hide_panel(gApp.p_diagnostics);
+            }
+            gApp.screenDirty = 0x1;
+            return;
+        }
+        /* <ctrl>+<keyswitch> switches tab */
         uint16_t nExt = 0;
         for( struct ncrm_Extension ** extPtr = gApp.extensions
            ; *extPtr
            ; ++extPtr, ++nExt ) {
-            if( nExt == gApp.nActiveExtension
-             && !strcmp( eventPtr->payload.forExtension.extensionName
-                       , (*extPtr)->name
-                       ) ) {
-                (*extPtr)->update(*extPtr, eventPtr);
-                break;
-            }
+            if( !(*extPtr)->keyswitch
+             || eventPtr->payload.keycode != ((*extPtr)->keyswitch & 0x1f) )
+                continue;
+            _activate_extension(nExt);
+            return;
+        }
+        /* forward other keypresses to active extension */
+        struct ncrm_Extension * ext = gApp.extensions[gApp.nActiveExtension];
+        if( ext && ext->prepare ) {
+            if( ncrm_renderer_post(gApp.nActiveExtension, eventPtr) )
+                ++gApp.extInboxes[gApp.nActiveExtension].nDropped;
+        } else if( ext && ext->update ) {
+            _timed_update(gApp.nActiveExtension, eventPtr);
+            gApp.screenDirty = 0x1;
+        }
+        return;
+    }
+    /* put event into extension's inbox; background extensions absorb
+     * events till activation */
+    if(ncrm_kEventExtension == eventPtr->type) {
+        int nExt = _event_extension(eventPtr);
+        if( nExt < 0 ) return;
+        if( gApp.extensions[nExt]->prepare ) {
+            if( ncrm_renderer_post(nExt, eventPtr) )
+                ++gApp.extInboxes[nExt].nDropped;
+        } else {
+            _inbox_put(gApp.extInboxes + nExt, eventPtr);
         }
         return;
     }
     if( ncrm_kEventHeaderUpdate == eventPtr->type ) {
-        update_header();
+        gApp.pendingHeader = 0x1;
         return;
     }
     if( ncrm_kEventFooterUpdate == eventPtr->type ) {
+        gApp.pendingFooter = 0x1;
+        return;
+    }
+    if( ncrm_kEventExtensionReady == eventPtr->type ) {
+        gApp.pendingPresent = 0x1;
+        return;
+    }
+}
+
+void
+process_event(struct ncrm_Event * eventPtr, void * _) {
+    /* measure time event spent in queue and time of its handling */
+    const enum ncrm_EventType type = eventPtr->type;
+    assert( type < NCRM_N_EVENT_TYPES );
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    ncrm_lh_add_interval( gApp.queueWait + type
+                        , &eventPtr->enqueueTime, &started );
+    int nExt = _event_extension(eventPtr);
+    if( nExt >= 0 )
+        ncrm_lh_add_interval( gApp.extQueueWait + nExt
+                            , &eventPtr->enqueueTime, &started );
+    _handle_event(eventPtr);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    ncrm_lh_add_interval(gApp.handling + type, &started, &finished);
+}
+
+/* Returns non-zero if there is something to be rendered at next frame */
+static int
+has_pending_updates() {
+    if( gApp.pendingHeader || gApp.pendingFooter || gApp.pendingPresent )
+        return 1;
+    /* background extensions' inboxes wait for activation */
+    return gApp.extInboxes[gApp.nActiveExtension].nEvents ? 1 : 0;
+}
+
+/* Renders all the pending updates at once */
+static void
+render_frame() {
+    if( gApp.pendingHeader ) {
+        update_header();
+        gApp.pendingHeader = 0x0;
+    }
+    if( gApp.pendingFooter ) {
         update_footer(gApp.columns);
+        gApp.pendingFooter = 0x0;
+    }
+    uint16_t nExt = 0;
+    for( struct ncrm_Extension ** extPtr = gApp.extensions
+       ; *extPtr
+       ; ++extPtr, ++nExt ) {
+        if( nExt != gApp.nActiveExtension ) continue;
+        if( (*extPtr)->prepare ) {
+            /* copy content prepared by render thread; background
+             * extensions keep their ready buffers till activation */
+            if( !gApp.pendingPresent ) continue;
+            int nBuffer = ncrm_renderer_ready(nExt);
+            if( nBuffer < 0 ) continue;
+            struct timespec started, finished;
+            clock_gettime(CLOCK_MONOTONIC, &started);
+            (*extPtr)->present(*extPtr, nBuffer);
+            clock_gettime(CLOCK_MONOTONIC, &finished);
+            ncrm_lh_add_interval(gApp.extHandling + nExt, &started, &finished);
+            ncrm_renderer_presented(nExt);
+            continue;
+        }
+        struct ExtensionInbox * inbox = gApp.extInboxes + nExt;
+        for( uint16_t i = 0; i < inbox->nEvents; ++i ) {
+            _timed_update(nExt, inbox->events + i);
+            ncrm_payload_unref(ncrm_event_payload(inbox->events + i));
+        }
+        inbox->nEvents = 0;
+    }
+    if( gApp.diagnosticsShown ) {
+        /* extensions may create their panels lazily, above this one */
+        update_diagnostics();
+        top_panel(gApp.p_diagnostics);
+    }
+    gApp.pendingPresent = 0x0;
+    gApp.screenDirty = 0x1;
+}
+
+static int
+_timespec_lt(const struct timespec * a, const struct timespec * b) {
+    return a->tv_sec < b->tv_sec
+        || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/*
+ * Reactor callbacks: ticks and keypresses are dispatched directly, without
+ * the queue
+ */
+
+/* Emits tick on timer expiration(s) */
+static void
+_on_tick( int fd, void * _ ) {
+    struct ncrm_Event event = { ncrm_kEventIncrementUpdateCount };
+    uint64_t nExpirations;
+    if( read(fd, &nExpirations, sizeof(nExpirations)) != sizeof(nExpirations) )
+        return;
+    event.nCoalesced = nExpirations;
+    clock_gettime(CLOCK_MONOTONIC, &event.enqueueTime);
+    process_event(&event, NULL);
+}
+
+/* Reads keypress from readable stdin */
+static void
+_on_user_input( int fd, void * _ ) {
+    struct ncrm_Event event = { ncrm_kEventKeypress };
+    /* multibyte sequences (arrows, etc) are read as a whole; descriptor is
+     * readable, so read() won't block */
+    ssize_t nRead = read(fd, &event.payload.keycode, sizeof(event.payload.keycode));
+    if( nRead <= 0 ) {
+        /* input closed */
+        ncrm_reactor_remove(fd);
         return;
     }
+    event.nCoalesced = 1;
+    clock_gettime(CLOCK_MONOTONIC, &event.enqueueTime);
+    process_event(&event, NULL);
+}
+
+/* Queue's wakeup descriptor -- events are handled in main loop */
+static void
+_on_queue_wakeup( int fd, void * _ ) {
 }
 
 int
 main(int argc, char * argv[]) {
     gApp.updateCount = 0;
+    gApp.maxFPS = NCRM_DEFAULT_MAX_FPS;
+    int errorsView = 0;
+    /* journal sources, default one is used if none given */
+    char * addresses[NCRM_JOURNAL_MAX_SOURCES]
+       , * snapshotAddresses[NCRM_JOURNAL_MAX_SOURCES] = {NULL}
+       ;
+    uint16_t nAddresses = 0;
+    /* ingest budget of entries less severe than warnings, 0 for no limit */
+    unsigned int budget = 0;
+    {  /* Parse command line options */
+        int opt;
+        while( -1 != (opt = getopt(argc, argv, "F:ES:R:B:")) ) {
+            switch(opt) {
+                case 'F':  /* max frames per second */
+                    gApp.maxFPS = atoi(optarg);
+                    if( !gApp.maxFPS ) {
+                        fprintf(stderr, "Bad frame rate limit: \"%s\"\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    break;
+                case 'E':  /* errors-only view above the journal */
+                    errorsView = 1;
+                    break;
+                case 'S':  /* journal source address, may be repeated */
+                    if( NCRM_JOURNAL_MAX_SOURCES == nAddresses ) {
+                        fprintf(stderr, "Too many sources, max is %d.\n"
+                               , NCRM_JOURNAL_MAX_SOURCES );
+                        return EXIT_FAILURE;
+                    }
+                    addresses[nAddresses++] = optarg;
+                    break;
+                case 'R':  /* snapshot service of the last source given */
+                    snapshotAddresses[nAddresses ? nAddresses - 1 : 0] = optarg;
+                    break;
+                case 'B':  /* ingest budget of info/debug entries per second */
+                    budget = atoi(optarg);
+                    if( !budget ) {
+                        fprintf(stderr, "Bad ingest budget: \"%s\"\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    break;
+                default:
+                    fprintf(stderr, "Usage:\n    %s [-F <max-fps>] [-E] [-B <entries-per-sec>]"
+                                    " [-S <address> [-R <snapshot-address>]]...\n", argv[0]);
+                    return EXIT_FAILURE;
+            }
+        }
+    }
     { /* Default extensions */
         gApp.extensions = malloc(sizeof(struct ncrm_Extension *)*5);
         gApp.extensions[1] = NULL;
@@ -625,25 +1035,66 @@ main(int argc, char * argv[]) {
         gApp.extensions[0] = &gJournalExtension;
 
         gApp.nActiveExtension = 0;
+
+        /* register extensions: assign IDs events are addressed by */
+        gApp.nExtensions = 0;
+        for( struct ncrm_Extension ** extPtr = gApp.extensions
+           ; *extPtr
+           ; ++extPtr ) {
+            (*extPtr)->id = gApp.nExtensions++;
+        }
+        gApp.extInboxes = calloc( gApp.nExtensions
+                                , sizeof(struct ExtensionInbox) );
+        gApp.extQueueWait = calloc( gApp.nExtensions
+                                  , sizeof(struct ncrm_LatencyHistogram) );
+        gApp.extHandling  = calloc( gApp.nExtensions
+                                  , sizeof(struct ncrm_LatencyHistogram) );
     }
 
     /* Configure extensions */
     struct ncrm_JournalExtensionConfig jCfg = {
         NULL,  /* modelPtr (set automatically) */
-        "tcp://127.0.0.1:5598",  /* addres to subscribe */
-        100,  /* network query interval, msec */
+        {"tcp://127.0.0.1:5598"}, 1,  /* addresses to subscribe */
+        500,  /* reorder window of sources merge, msec */
+        {NULL},  /* snapshot services (set below) */
+        0, { -1, -1 },  /* backlog time span and levels requested */
+        64,  /* max messages appended at once */
+        2,  /* number of decode workers */
+        {0},  /* ingest budgets per level class (set below) */
         {  /* Default query parameters */
             NULL,  /* category pattern */
             NULL,  /* message pattern */
             { 0, 1000 },  /* priority range, -1 to unset */
             { 0, 1000 },  /* time range, ULONG_MAX to unset */
         },
-        {  /* Default timestamp formatter */
-            _journal_timestamp_formatter
+        {  /* Default timestamp formatter (compiled below) */
+            NULL
         },
+        {{{NULL}}}, 0,  /* views (set below, default is single view) */
         /* Initial dimesnions, updated automatically */
         {{0, 0}, {0, 0}},
     };
+    if( ncrm_tsf_compile( &jCfg.defaultTimestampFormatter
+                        , "%H:%M:%S.%f", ncrm_kTimestampRelative ) ) {
+        fputs("Bad timestamp format.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    if( nAddresses ) {
+        memcpy(jCfg.addresses, addresses, nAddresses*sizeof(char *));
+        jCfg.nAddresses = nAddresses;
+    }
+    memcpy(jCfg.snapshotAddresses, snapshotAddresses, sizeof(snapshotAddresses));
+    for( int c = NCRM_JOURNAL_KEPT_LEVEL_CLASS + 1; c < NCRM_JOURNAL_N_LEVEL_CLASSES; ++c )
+        jCfg.levelBudgets[c] = budget;
+    if( errorsView ) {
+        /* errors (and more severe) at the top, everything at the bottom */
+        jCfg.views[0].query = jCfg.defaultQueryParameters;
+        jCfg.views[0].query.levelRange[1] = 300;
+        jCfg.views[0].heightShare = 1;
+        jCfg.views[1].query = jCfg.defaultQueryParameters;
+        jCfg.views[1].heightShare = 3;
+        jCfg.nViews = 2;
+    }
     gApp.extensions[0]->userData = &jCfg;
 
     { /* XXX, mock "model" */
@@ -658,8 +1109,11 @@ main(int argc, char * argv[]) {
                 , "connecting");
         gApp.model->appMsg[0] = '\0';
         gApp.model->errors = NULL;
+        memset(&gApp.model->queueStats, 0, sizeof(gApp.model->queueStats));
     }
 
+    /* messages are shown according to locale's encoding (UTF-8) */
+    setlocale(LC_ALL, "");
     initscr();
 
     if( has_colors() != FALSE ) {
@@ -701,12 +1155,12 @@ main(int argc, char * argv[]) {
     /* Enter queue */
     ncrm_queue_init();
 
-    /* Spawn the threads */
-    pthread_t idelUpdaterThread;
-    pthread_create( &idelUpdaterThread, NULL, _idle_updater, NULL );
-
-    pthread_t userInputThread;
-    pthread_create( &userInputThread, NULL, _user_input, NULL );
+    /* Set up event sources: queue (for events from extensions' and render
+     * threads), ticks timer and user input */
+    ncrm_reactor_init();
+    ncrm_reactor_add(ncrm_queue_fd(), _on_queue_wakeup, NULL);
+    ncrm_reactor_add_timer(NCRM_TICK_PERIOD_MSEC, _on_tick, NULL);
+    ncrm_reactor_add(STDIN_FILENO, _on_user_input, NULL);
 
     /* Initialize extensions */
     for( struct ncrm_Extension ** extPtr = gApp.extensions
@@ -719,21 +1173,61 @@ main(int argc, char * argv[]) {
                        , gApp.columns  /* width */
                        );
     }
+    ncrm_renderer_init(gApp.extensions);
+    if( gApp.extensions[gApp.nActiveExtension]->prepare )
+        ncrm_renderer_activate(gApp.nActiveExtension, 1);
 
-    /* Event loop */
+    /* Event loop. Events are handled as they come, while rendering is done
+     * no more often than `maxFPS` times per second, for all the events
+     * accumulated since previous frame. */
+    const long framePeriodNSec = 1000000000L/gApp.maxFPS;
+    clock_gettime(CLOCK_MONOTONIC, &gApp.nextFrame);
+    gApp.screenDirty = 0x1;
     while(!gApp.exitFlag) {
-    	update_panels();  /* Update the stacking order. */
-    	doupdate();  /* Show it on the screen */
-        ncrm_do_with_events(process_event, NULL);
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if( has_pending_updates() && !_timespec_lt(&now, &gApp.nextFrame) ) {
+            render_frame();
+            gApp.nextFrame = now;
+            gApp.nextFrame.tv_nsec += framePeriodNSec;
+            if( gApp.nextFrame.tv_nsec >= 1000000000L ) {
+                ++gApp.nextFrame.tv_sec;
+                gApp.nextFrame.tv_nsec -= 1000000000L;
+            }
+        }
+        if( gApp.screenDirty ) {
+            update_panels();  /* Update the stacking order. */
+            doupdate();  /* Show it on the screen */
+            gApp.screenDirty = 0x0;
+        }
+        /* handle queued events, then wait for any source to be ready (if
+         * something is pending, not longer than till the next frame, and not
+         * at all if more events are queued meanwhile) */
+        ncrm_do_with_events_nowait(process_event, NULL);
+        if( ncrm_queue_sleep_begin() ) {
+            static const struct timespec noWait = { 0, 0 };
+            ncrm_reactor_run_until(&noWait);
+            continue;
+        }
+        ncrm_reactor_run_until( has_pending_updates() ? &gApp.nextFrame : NULL );
+        ncrm_queue_sleep_end();
     }
 
+    ncrm_renderer_free();
     /* Shutdown extensions */
     for( struct ncrm_Extension ** extPtr = gApp.extensions
        ; *extPtr
        ; ++extPtr ) {
         (*extPtr)->shutdown(*extPtr);
     }
+    for( uint16_t nExt = 0; nExt < gApp.nExtensions; ++nExt ) {
+        struct ExtensionInbox * inbox = gApp.extInboxes + nExt;
+        for( uint16_t i = 0; i < inbox->nEvents; ++i )
+            ncrm_payload_unref(ncrm_event_payload(inbox->events + i));
+    }
+    free(gApp.extInboxes);
 
+    ncrm_reactor_free();
     ncrm_queue_free();
     endwin();
 
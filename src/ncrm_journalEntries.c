@@ -18,9 +18,13 @@
 #include "ncrm_queue.h"
 #include "ncrm_extension.h"
 #include "ncrm_model.h"
+#include "ncrm_prefixSums.h"
+#include "ncrm_utf8.h"
+#include "ncrm_renderBuffer.h"
+#include "ncrm_msgpack.h"
+#include "ncrm_spsc.h"
 
 #include <zmq.h>
-#include <msgpack.h>
 
 #include <assert.h>
 #include <string.h>
@@ -28,8 +32,11 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/eventfd.h>
 
 #include <pthread.h>
+#include <stdatomic.h>
 
 #include <curses.h>
 #include <panel.h>
@@ -46,6 +53,7 @@ void
 ncrm_je_mark_as_terminative(struct ncrm_JournalEntry * je) {
     je->timest = 0;
     je->level = 0;
+    je->source = 0;
     je->category = NULL;
     je->message = NULL;
 }
@@ -247,6 +255,203 @@ ncrm_je_query( const struct ncrm_JournalEntries * src
     return qc.nCollected;
 }
 
+void
+ncrm_je_selection_init(struct ncrm_JournalSelection * sel) {
+    sel->entries = NULL;
+    sel->n = sel->nAllocated = 0;
+}
+
+void
+ncrm_je_selection_free(struct ncrm_JournalSelection * sel) {
+    free(sel->entries);
+    ncrm_je_selection_init(sel);
+}
+
+void
+ncrm_je_selection_append( struct ncrm_JournalSelection * sel
+                        , const struct ncrm_JournalEntry * entries
+                        , unsigned long nEntries ) {
+    if( sel->n + nEntries > sel->nAllocated ) {
+        while( sel->n + nEntries > sel->nAllocated )
+            sel->nAllocated += NCRM_NENTRIES_INC;
+        sel->entries = realloc( sel->entries
+                              , sel->nAllocated*sizeof(struct ncrm_JournalEntry) );
+    }
+    memcpy( sel->entries + sel->n, entries
+          , nEntries*sizeof(struct ncrm_JournalEntry) );
+    sel->n += nEntries;
+}
+
+/* Merges entries appended to the selection starting from `nOld` with
+ * previous (sorted) ones. Returns number of leading entries that were not
+ * moved. */
+static unsigned long
+_selection_merge_tail( struct ncrm_JournalSelection * sel
+                     , unsigned long nOld ) {
+    if( !nOld || nOld == sel->n
+     || sel->entries[nOld - 1].timest <= sel->entries[nOld].timest )
+        return nOld;  /* no intersection, new entries are just appended */
+    struct ncrm_JournalEntry * e = sel->entries;
+    /* find first previous entry that is later than the earliest new one */
+    unsigned long lo = 0, hi = nOld;
+    while( lo < hi ) {
+        unsigned long mid = lo + (hi - lo)/2;
+        if( e[mid].timest <= e[nOld].timest ) lo = mid + 1;
+        else hi = mid;
+    }
+    /* merge backwards, keeping new entries in a temporary buffer */
+    const unsigned long nNew = sel->n - nOld;
+    struct ncrm_JournalEntry * tmp = malloc(nNew*sizeof(struct ncrm_JournalEntry));
+    memcpy(tmp, e + nOld, nNew*sizeof(struct ncrm_JournalEntry));
+    unsigned long i = nOld, j = nNew, k = sel->n;
+    while( j ) {
+        if( i > lo && e[i - 1].timest > tmp[j - 1].timest ) e[--k] = e[--i];
+        else e[--k] = tmp[--j];
+    }
+    free(tmp);
+    return lo;
+}
+
+/** (internal) distinct pattern shared by fused queries */
+struct FusedPattern {
+    const char * pattern;
+    /* 0 -- match category, 1 -- match message */
+    int onMessage;
+};
+
+/** (internal) queries compiled for single-pass evaluation */
+struct FusedQueries {
+    const struct ncrm_QueryParams * const * qps;
+    unsigned int nQueries;
+    /* Distinct patterns; fnmatch() is the costly part, so it is done at most
+     * once per entry for every distinct pattern, whatever number of views
+     * use it */
+    struct FusedPattern patterns[2*NCRM_JOURNAL_MAX_VIEWS];
+    unsigned int nPatterns;
+    /* Indexes of category and message patterns of every query, -1 if
+     * not set */
+    int8_t catPattern[NCRM_JOURNAL_MAX_VIEWS]
+         , msgPattern[NCRM_JOURNAL_MAX_VIEWS]
+         ;
+    /* Union of levels and time ranges of all the queries, to reject entries
+     * not matching any query at once */
+    ncrm_JournalEntryLevel_t levelRange[2];
+    ncrm_Timestamp_t timeRange[2];
+};
+
+static int8_t
+_fused_pattern_index( struct FusedQueries * fq
+                    , const char * pattern, int onMessage ) {
+    if( !pattern ) return -1;
+    for( unsigned int i = 0; i < fq->nPatterns; ++i ) {
+        if( fq->patterns[i].onMessage == onMessage
+         && !strcmp(fq->patterns[i].pattern, pattern) ) return i;
+    }
+    fq->patterns[fq->nPatterns].pattern = pattern;
+    fq->patterns[fq->nPatterns].onMessage = onMessage;
+    return fq->nPatterns++;
+}
+
+static void
+_fused_queries_compile( struct FusedQueries * fq
+                      , const struct ncrm_QueryParams * const * qps
+                      , unsigned int nQueries ) {
+    assert( nQueries <= NCRM_JOURNAL_MAX_VIEWS );
+    fq->qps = qps;
+    fq->nQueries = nQueries;
+    fq->nPatterns = 0;
+    fq->levelRange[0] = fq->levelRange[1] = -1;
+    fq->timeRange[0] = fq->timeRange[1] = ULONG_MAX;
+    for( unsigned int i = 0; i < nQueries; ++i ) {
+        const struct ncrm_QueryParams * qp = qps[i];
+        fq->catPattern[i] = _fused_pattern_index(fq, qp->categoryPatern, 0);
+        fq->msgPattern[i] = _fused_pattern_index(fq, qp->msgPattern, 1);
+        /* unset bound of any query unsets the bound of union */
+        if( !i ) {
+            memcpy(fq->levelRange, qp->levelRange, sizeof(fq->levelRange));
+            memcpy(fq->timeRange, qp->timeRange, sizeof(fq->timeRange));
+            continue;
+        }
+        if( fq->levelRange[0] != -1 && ( qp->levelRange[0] == -1
+                                      || qp->levelRange[0] < fq->levelRange[0] ) )
+            fq->levelRange[0] = qp->levelRange[0];
+        if( fq->levelRange[1] != -1 && ( qp->levelRange[1] == -1
+                                      || qp->levelRange[1] > fq->levelRange[1] ) )
+            fq->levelRange[1] = qp->levelRange[1];
+        if( fq->timeRange[0] != ULONG_MAX && ( qp->timeRange[0] == ULONG_MAX
+                                           || qp->timeRange[0] < fq->timeRange[0] ) )
+            fq->timeRange[0] = qp->timeRange[0];
+        if( fq->timeRange[1] != ULONG_MAX && ( qp->timeRange[1] == ULONG_MAX
+                                           || qp->timeRange[1] > fq->timeRange[1] ) )
+            fq->timeRange[1] = qp->timeRange[1];
+    }
+}
+
+/* Checks level and time ranges of the query (cheap part of the filter) */
+static int
+_entry_in_ranges( const struct ncrm_JournalEntry * je
+                , const ncrm_JournalEntryLevel_t * levelRange
+                , const ncrm_Timestamp_t * timeRange ) {
+    if( levelRange[0] > -1 && je->level < levelRange[0] ) return 0;
+    if( levelRange[1] > -1 && je->level > levelRange[1] ) return 0;
+    if( timeRange[0] != ULONG_MAX && je->timest < timeRange[0] ) return 0;
+    if( timeRange[1] != ULONG_MAX && je->timest > timeRange[1] ) return 0;
+    return 1;
+}
+
+/* Checks pattern for the entry, using per-entry memo of pattern matches */
+static int
+_entry_matches_pattern( const struct FusedQueries * fq
+                      , const struct ncrm_JournalEntry * je
+                      , int8_t nPattern
+                      , uint32_t * evaluated, uint32_t * matched ) {
+    if( nPattern < 0 ) return 1;
+    const uint32_t bit = 1u << nPattern;
+    if( !(*evaluated & bit) ) {
+        const struct FusedPattern * fp = fq->patterns + nPattern;
+        *evaluated |= bit;
+        if( !fnmatch( fp->pattern
+                    , fp->onMessage ? je->message : je->category
+                    , 0x0 /*FNM_CASEFOLD | FNM_EXTMATCH*/
+                    ) ) *matched |= bit;
+    }
+    return *matched & bit ? 1 : 0;
+}
+
+void
+ncrm_je_select( const struct ncrm_JournalEntry * src
+              , unsigned long nEntries
+              , const struct ncrm_QueryParams * const * qps
+              , struct ncrm_JournalSelection * const * dests
+              , unsigned long * nCommon
+              , unsigned int nQueries
+              ) {
+    struct FusedQueries fq;
+    _fused_queries_compile(&fq, qps, nQueries);
+    unsigned long nOld[NCRM_JOURNAL_MAX_VIEWS];
+    for( unsigned int i = 0; i < nQueries; ++i ) nOld[i] = dests[i]->n;
+    /* single pass over the entries, every entry is tested against all the
+     * queries while it is hot in cache */
+    for( const struct ncrm_JournalEntry * je = src
+       ; je != src + nEntries
+       ; ++je ) {
+        if( !_entry_in_ranges(je, fq.levelRange, fq.timeRange) ) continue;
+        uint32_t evaluated = 0x0, matched = 0x0;
+        for( unsigned int i = 0; i < nQueries; ++i ) {
+            if( !_entry_in_ranges(je, qps[i]->levelRange, qps[i]->timeRange) )
+                continue;
+            if( !_entry_matches_pattern(&fq, je, fq.catPattern[i], &evaluated, &matched) )
+                continue;
+            if( !_entry_matches_pattern(&fq, je, fq.msgPattern[i], &evaluated, &matched) )
+                continue;
+            ncrm_je_selection_append(dests[i], je, 1);
+        }
+    }
+    /* entries are sorted, but may be late wrt already selected ones */
+    for( unsigned int i = 0; i < nQueries; ++i )
+        nCommon[i] = _selection_merge_tail(dests[i], nOld[i]);
+}
+
 #if 0
 static void
 _print_journal_entry( struct ncrm_JournalEntry * je, void * _) {
@@ -282,6 +487,7 @@ main(int argc, char * argv[]) {
         newEntry.timest = atoi(line);
         getline(&line, &len, fp);
         newEntry.level = atoi(line);
+        newEntry.source = 0;
         getline(&line, &len, fp);
         newEntry.category = strndup(line, strlen(line) - 1);
         getline(&line, &len, fp);
@@ -333,39 +539,34 @@ main(int argc, char * argv[]) {
 }
 #else
 
-/* A bulky function converting unpacked msgpack's messages into jounral
- * entries */
-static struct ncrm_JournalEntry *
-_convert_msgs_block( const msgpack_object_array * msgs ) {
-    struct ncrm_JournalEntry * newEntriesBlock
-        = malloc(sizeof(struct ncrm_JournalEntry)*(msgs->size+1));
-    ncrm_je_mark_as_terminative(newEntriesBlock + msgs->size);
-    for( uint64_t nMsg = 0; nMsg < msgs->size; ++nMsg ) {
-        struct ncrm_JournalEntry * dest = newEntriesBlock + nMsg;
-        msgpack_object * src = msgs->ptr + nMsg;
-        assert(src->type == MSGPACK_OBJECT_ARRAY);
-        assert(src->via.array.size == 4);
-        /* copy data */
-        dest->timest = src->via.array.ptr[0].via.u64;
-        dest->level  = src->via.array.ptr[1].via.u64;
-        dest->category
-            = strndup( src->via.array.ptr[2].via.str.ptr
-                     , src->via.array.ptr[2].via.str.size );
-        dest->message
-            = strndup( src->via.array.ptr[3].via.str.ptr
-                     , src->via.array.ptr[3].via.str.size );
-    }
-    return newEntriesBlock;
-}
-
 /*
  * Extension definition
  *//////////////////// */
 
+/** Identifies content of the view's body row: a line of certain message. Row
+ * with null message is blank. */
+struct JournalViewRow {
+    /** Message shown; messages are never reallocated, so their pointers
+     * identify the entries */
+    const char * message;
+    /** Number of the line within wrapped message */
+    uint16_t nLine;
+};
+
+/** Formatted timestamp cached by a view */
+struct JournalTimestampCacheEntry {
+    /** Message of the entry (identifies the entry), null if slot is empty */
+    const char * message;
+    uint8_t len;
+    char str[NCRM_JOURNAL_TIMESTAMP_CACHE_LEN];
+};
+
 /** Represents view on a journal entris set */
 struct JournalEntriesView {
     uint16_t showTimestamp:1;
     uint16_t showCategory:1;
+    /** Set when view sticks to the latest messages (scrolled to the end) */
+    uint16_t follow:1;
     /** Window width and height. If set to zero means "automatic" (will be
      * (re-)calculated during next udate event).
      * Order: {{top, left}, {nRows, nCols}} */
@@ -376,37 +577,75 @@ struct JournalEntriesView {
     WINDOW * w_jHeader;
     PANEL  * p_jHeader;
     /** Journal entries window */
-    WINDOW * w_jBody;  /* Is a pad actually */
+    WINDOW * w_jBody;  /* Is a screen-sized pad actually */
     PANEL  * p_jBody;
-    /** Current query results */
-    struct ncrm_JournalEntry ** queryResults;
-    unsigned long nQueryResults;
+    /** Current query results (updated incrementally, by new entries) */
+    struct ncrm_JournalSelection queryResults;
     /** Timestamp formatting settings */
     struct ncrm_JournalTimestampFormat tstFmtSettings;
-    /** Formatting cache for entries to show:
-     *  1. <timestamp:char*>, if showTimestamp is on
-     *  2. <null:char>, if showTimestamp is on
-     *  3. <category:char*>
-     *  4. <null:char>
-     *  ... XXX?
-     * */
-    char formattedTimestamps[NCRM_JOURNAL_MAX_LINES_SHOWN][NCRM_JOURNAL_MAX_TIMESTAMP_LEN];
+    /** Formatted timestamps of recently shown entries (direct-mapped by
+     * message ptr); has to be dropped once formatting settings change */
+    struct JournalTimestampCacheEntry tsCache[NCRM_JOURNAL_TIMESTAMP_CACHE_SIZE];
+    /** Number of wrapped lines for every query result, for `wrapWidth` */
+    uint16_t * nResultLines;
+    /** Prefix sums of `nResultLines` mapping wrapped lines to results */
+    struct ncrm_PrefixSums linesIndex;
+    /** Message column width the `nResultLines` were computed for */
+    int32_t wrapWidth;
+    /** Timestamp column width */
+    uint16_t tsColWidth;
+    /** Source number column width, zero if there is a single source */
+    uint16_t srcColWidth;
+    /** Number of the (wrapped) line shown at the top of the body */
+    unsigned long topLine;
+    /** What is currently drawn on every row of the body pad (damage
+     * tracking) and what has to be drawn by current update */
+    struct JournalViewRow * rows, * layout;
+    /** Set when whole body has to be redrawn at next update */
+    uint16_t damagedAll:1;
+    /** Set for the view receiving navigation keys */
+    uint16_t focused:1;
+    /** Number of sources entries are received from */
+    uint16_t nSources;
+    /** Number of source which lag is shown in header, -1 for the most
+     * lagging one */
+    int32_t lagSource;
+    /** Header and body content prepared by render thread (double
+     * buffered, see `ncrm_renderer.h`) */
+    struct ncrm_RenderBuffer hdrBuffers[2], bodyBuffers[2];
 };
 
 static struct JournalEntriesView *
-_new_journal_entries_view( struct ncrm_JournalExtensionConfig * cfg ) {
+_new_journal_entries_view( struct ncrm_JournalExtensionConfig * cfg
+                         , const struct ncrm_QueryParams * query ) {
     struct JournalEntriesView * obj = malloc(sizeof(struct JournalEntriesView));
     bzero(obj, sizeof(struct JournalEntriesView));
 
     obj->showTimestamp = 0x1;
     obj->showCategory = 0x1;
+    obj->follow = 0x1;
     obj->dims[0][0] = obj->dims[0][1] = obj->dims[1][0] = obj->dims[1][1] = 0;
-    obj->queryResults = NULL;
-    obj->nQueryResults = 0;
+    ncrm_je_selection_init(&obj->queryResults);
+    obj->nResultLines = NULL;
+    ncrm_ps_init(&obj->linesIndex);
+    obj->wrapWidth = -1;
+    obj->rows = obj->layout = NULL;
+    obj->damagedAll = 0x1;
+    obj->nSources = cfg->nAddresses;
+    obj->lagSource = -1;
+    /* sources are numbered as `#N` */
+    obj->srcColWidth = 0;
+    if( obj->nSources > 1 ) {
+        obj->srcColWidth = 2;
+        for( unsigned int n = obj->nSources - 1; n >= 10; n /= 10 )
+            ++obj->srcColWidth;
+    }
+    for( int i = 0; i < 2; ++i ) {
+        ncrm_rb_init(obj->hdrBuffers + i);
+        ncrm_rb_init(obj->bodyBuffers + i);
+    }
 
-    memcpy( &obj->query
-          , &cfg->defaultQueryParameters
-          , sizeof(struct ncrm_QueryParams)  );
+    memcpy( &obj->query, query, sizeof(struct ncrm_QueryParams) );
     memcpy( &obj->tstFmtSettings
           , &cfg->defaultTimestampFormatter
           , sizeof(struct ncrm_JournalTimestampFormat)  );
@@ -414,84 +653,374 @@ _new_journal_entries_view( struct ncrm_JournalExtensionConfig * cfg ) {
     return obj;
 }
 
+/* Number of lines in view's body pad (view height minus the header) */
+static uint16_t
+_jview_body_height(const struct JournalEntriesView * view) {
+    uint16_t h = view->dims[1][0] - 1;
+    return h > NCRM_JOURNAL_MAX_LINES_SHOWN ? NCRM_JOURNAL_MAX_LINES_SHOWN : h;
+}
+
 /* Log messages body has special behaviour for refreshing and these functions
  * are for convenience */
 void
 _jmsgwin_refresh(struct JournalEntriesView * view) {
     pnoutrefresh( view->w_jBody
-                , NCRM_JOURNAL_MAX_LINES_SHOWN - view->dims[1][0] + 1
-                , 0
+                , 0, 0
                 /* ^^^ upper left corner of the rectangle to be shown in the pad */
                 , view->dims[0][0] + 1, view->dims[0][1]
-                , view->dims[1][0] + 1, view->dims[1][1]
+                , view->dims[0][0] + _jview_body_height(view)
+                , view->dims[0][1] + view->dims[1][1] - 1
                 );
 }
 
-void
-_jmsgwin_reset_cursor(struct JournalEntriesView * view) {
-    wmove( view->w_jBody
-         , NCRM_JOURNAL_MAX_LINES_SHOWN - 1
-         , 0 );
-}
-
 /**\brief Breaks given string into a multile message with lines of `width`
- *        length max returning number of lines.
+ *        columns max returning number of lines.
  *
  * Returned buffer contains lines separated by 0x00 char finally terminated
- * with 0x4. */
+ * with 0x4. If `destBuffer` is null, lines are only counted. Message is
+ * assumed to be UTF-8 encoded, lines are broken by display width. */
 static uint16_t
 _split_message( const char * msg
               , uint16_t width
               , char * destBuffer
               ) {
     uint16_t nLine = 0;
-    uint16_t nCharInLine = 0;
     char * curDest = destBuffer;
-    const char * curSrc = msg;
-    //for( const char * c = msg; '\0' != *c; ++c, ++nCharInLine )
-    const char * c = msg;
+    const char * c = msg, * end = msg + strlen(msg);
     do {
-        if( !('\n' == *c || '\0' == *c || nCharInLine == width) ) {
-            ++c;
-            ++nCharInLine;
-            continue;
+        size_t nBytes = ncrm_u8_fit(c, end - c, width, NULL);
+        if( !nBytes && '\0' != *c && '\n' != *c ) {
+            /* char is wider than the column; put it anyway */
+            int w;
+            nBytes = ncrm_u8_next(c, &w);
         }
         /* copy line */
         ++nLine;
-        memcpy( curDest, curSrc, nCharInLine );
-        curDest[nCharInLine] = '\0';
-        /*printf( " copied \"%s\" (%d)\n", curDest, (int) nCharInLine ); // XXX */
-        curDest += nCharInLine + 1;  /* +1 for terminator */
-        curSrc  += nCharInLine    ;
-        nCharInLine = 0;
-
-        if( '\n' == *c ) {  /*jump over newline char*/
-            ++c;
-            ++curSrc;
-        }
-    } while('\0' != *curSrc);
-    *curDest = 0x4;  /* End of Transmission */
+        if( destBuffer ) {
+            memcpy( curDest, c, nBytes );
+            curDest[nBytes] = '\0';
+            curDest += nBytes + 1;  /* +1 for terminator */
+        }
+        c += nBytes;
+        if( '\n' == *c ) ++c;  /*jump over newline char*/
+    } while('\0' != *c);
+    if( destBuffer ) *curDest = 0x4;  /* End of Transmission */
     return nLine;
 }
 
+/* Returns formatted timestamp of `nEntry`-th query result, formatting it
+ * only if it is not in view's cache. Returned string is not
+ * null-terminated. */
+static uint16_t
+_jview_timestamp( struct JournalEntriesView * view
+                , unsigned long nEntry
+                , const char ** dest ) {
+    static char tsBuf[NCRM_JOURNAL_MAX_TIMESTAMP_LEN];
+    const struct ncrm_JournalEntry * je = view->queryResults.entries + nEntry;
+    struct JournalTimestampCacheEntry * cached = view->tsCache
+        + (((uintptr_t) je->message) >> 4) % NCRM_JOURNAL_TIMESTAMP_CACHE_SIZE;
+    if( cached->message == je->message ) {
+        *dest = cached->str;
+        return cached->len;
+    }
+    uint16_t len = view->tstFmtSettings.callback( &view->tstFmtSettings
+            , tsBuf, je->timest
+            , nEntry ? view->queryResults.entries[nEntry - 1].timest : NCRM_TIMESTAMP_NONE );
+    if( len <= NCRM_JOURNAL_TIMESTAMP_CACHE_LEN ) {
+        cached->message = je->message;
+        cached->len = len;
+        memcpy(cached->str, tsBuf, len);
+    }
+    *dest = tsBuf;
+    return len;
+}
+
+/* Re-builds wrapped lines index of the view after query results changed.
+ *
+ * Line counts are re-used for `nCommon` leading entries that were kept in
+ * place, so for the usual case of new messages appended only the new
+ * entries get wrapped. */
+static void
+_jview_reindex( struct JournalEntriesView * view
+              , unsigned long nCommon
+              , unsigned long nPrevResults ) {
+    /* time elapsed since preceding entry changes if entries were inserted,
+     * so cached timestamps are not valid anymore */
+    if( ncrm_kTimestampElapsed == view->tstFmtSettings.mode
+     && nCommon != nPrevResults ) {
+        bzero(view->tsCache, sizeof(view->tsCache));
+        view->damagedAll = 0x1;
+    }
+    /* Timestamp column width is defined by the latest (longest) timestamp */
+    uint16_t tsColWidth = 0;
+    if( view->showTimestamp && view->queryResults.n ) {
+        const char * ts;
+        tsColWidth = _jview_timestamp(view, view->queryResults.n - 1, &ts);
+    }
+    /* 1 + 1 + [tsw + 1] + [srcw + 1] + [msgW + 1] + 1
+     * ^   ^   ^^^^^^^^^   ^^^^^^^^^^   ^^^^    ^    ^
+     * |   |       |           |          |     |    +- scrollbar
+     * |   |       |           |          |     +------ reserved for a newline char
+     * |   |       |           |          +------------ width of the message itself
+     * |   |       |           +----------------------- (opt.) source + 1 for gap
+     * |   |       +----------------------------------- (opt.) timestamp + 1 for gap
+     * |   +------------------------------------------- gap after priority marking
+     * +----------------------------------------------- priority marking
+     * We always have a single-char column with priority marking
+     * We foresee also two chars at the end: a newline marking and a scrollbar
+     * */
+    int32_t msgW = view->dims[1][1]
+                 - 1 - 1  /* priority + gap */
+                 - (view->showTimestamp ? (tsColWidth + 1) : 0)
+                 - (view->srcColWidth ? (view->srcColWidth + 1) : 0)
+                 - 1      /* scrollbar */
+                 ;
+    if( msgW != view->wrapWidth || tsColWidth != view->tsColWidth ) {
+        /* all the messages have to be re-wrapped */
+        nCommon = 0;
+        view->damagedAll = 0x1;
+    }
+    view->wrapWidth = msgW;
+    view->tsColWidth = tsColWidth;
+    if( msgW <= 0 ) {
+        /* window width is not enough to show the message */
+        ncrm_ps_build(&view->linesIndex, NULL, 0);
+        return;
+    }
+    if( view->queryResults.n ) {
+        view->nResultLines = realloc( view->nResultLines
+                                    , view->queryResults.n*sizeof(uint16_t) );
+    }
+    for( unsigned long i = nCommon; i < view->queryResults.n; ++i ) {
+        view->nResultLines[i]
+            = _split_message(view->queryResults.entries[i].message, msgW, NULL);
+    }
+    if( nCommon == nPrevResults && nCommon == view->linesIndex.n ) {
+        /* results were appended -- extend the index */
+        for( unsigned long i = nCommon; i < view->queryResults.n; ++i )
+            ncrm_ps_push(&view->linesIndex, view->nResultLines[i]);
+    } else {
+        ncrm_ps_build(&view->linesIndex, view->nResultLines, view->queryResults.n);
+    }
+}
+
+/* Sets top line of the view, clamping it to the available range. Reaching
+ * the last page turns on "follow" mode. */
+static void
+_jview_scroll_to( struct JournalEntriesView * view, long topLine ) {
+    const uint16_t bodyH = _jview_body_height(view);
+    const unsigned long nLinesTotal = ncrm_ps_total(&view->linesIndex);
+    const long maxTop = nLinesTotal > bodyH ? nLinesTotal - bodyH : 0;
+    if( topLine < 0 ) topLine = 0;
+    view->follow = topLine >= maxTop ? 0x1 : 0x0;
+    view->topLine = topLine >= maxTop ? maxTop : topLine;
+}
+
+/* Scrolls view to the first entry with timestamp not less than given one */
+static void
+_jview_scroll_to_timestamp( struct JournalEntriesView * view
+                          , ncrm_Timestamp_t timest ) {
+    /* query results are sorted by time, so find lower bound by bisection */
+    unsigned long lo = 0, hi = view->queryResults.n;
+    while( lo < hi ) {
+        unsigned long mid = lo + (hi - lo)/2;
+        if( view->queryResults.entries[mid].timest < timest ) lo = mid + 1;
+        else hi = mid;
+    }
+    if( lo > view->linesIndex.n ) lo = view->linesIndex.n;
+    _jview_scroll_to(view, ncrm_ps_sum(&view->linesIndex, lo));
+}
+
+/* Handles view navigation keys, returns non-zero if key was consumed */
+static int
+_jview_handle_key( struct JournalEntriesView * view, unsigned int keycode ) {
+    const long bodyH = _jview_body_height(view);
+    switch( keycode ) {
+        case 'k': case NCRM_KEY_UP:
+            _jview_scroll_to(view, ((long) view->topLine) - 1);
+            return 1;
+        case 'j': case NCRM_KEY_DOWN:
+            _jview_scroll_to(view, view->topLine + 1);
+            return 1;
+        case 'b': case NCRM_KEY_PGUP:
+            _jview_scroll_to(view, ((long) view->topLine) - bodyH);
+            return 1;
+        case ' ': case NCRM_KEY_PGDN:
+            _jview_scroll_to(view, view->topLine + bodyH);
+            return 1;
+        case 'g': case NCRM_KEY_HOME:
+            _jview_scroll_to(view, 0);
+            return 1;
+        case 'G': case NCRM_KEY_END:
+            _jview_scroll_to(view, LONG_MAX);
+            return 1;
+        case 't': {  /* cycle timestamp modes */
+            ncrm_tsf_set_mode( &view->tstFmtSettings
+                             , (view->tstFmtSettings.mode + 1)%3 );
+            bzero(view->tsCache, sizeof(view->tsCache));
+            /* timestamps column width might change */
+            _jview_reindex(view, view->queryResults.n, view->queryResults.n);
+            view->damagedAll = 0x1;
+            return 1;
+        }
+        case 's':  /* cycle source which lag is shown in header */
+            if( view->nSources < 2 ) return 0;
+            if( ++view->lagSource == view->nSources )
+                view->lagSource = -1;
+            return 1;
+        case '{': case '}': {
+            if( !view->linesIndex.n ) return 1;
+            const struct ncrm_JournalEntry * je = view->queryResults.entries
+                    + ncrm_ps_find(&view->linesIndex, view->topLine);
+            if( '{' == keycode ) {
+                _jview_scroll_to_timestamp( view
+                        , je->timest > NCRM_JOURNAL_TIME_JUMP
+                        ? je->timest - NCRM_JOURNAL_TIME_JUMP : 0 );
+            } else {
+                _jview_scroll_to_timestamp( view
+                        , je->timest + NCRM_JOURNAL_TIME_JUMP );
+            }
+            return 1;
+        }
+    };
+    return 0;
+}
+
 static attr_t
-_put_priority_glyph(WINDOW * dest, int val, int omitChar) {
+_put_priority_glyph( struct ncrm_RenderBuffer * dest, uint16_t nRow
+                   , int val, int omitChar) {
     #define put_formatted_prefix(n, c, name, descr, attrs, ... )    \
     if( n*100 >= val ) {                                            \
-        wattrset(dest, attrs);                                      \
-        if(!omitChar) waddch(dest, c);                              \
-        else waddch(dest, ACS_CKBOARD);                             \
+        if(!omitChar) ncrm_rb_fill(dest, nRow, 0, attrs, c, 1);     \
+        else ncrm_rb_put_acs(dest, nRow, 0, attrs, 'a');            \
         return attrs;                                               \
     }
     ncrm_for_every_special_attribute(put_formatted_prefix);
     #undef put_formatted_prefix
 
-    wattrset(dest, A_NORMAL);
-    if(!omitChar) waddch(dest, '*');
-    else waddch(dest, ACS_CKBOARD);
+    /* 'a' is the ACS_CKBOARD */
+    if(!omitChar) ncrm_rb_fill(dest, nRow, 0, A_NORMAL, '*', 1);
+    else ncrm_rb_put_acs(dest, nRow, 0, A_NORMAL, 'a');
     return A_NORMAL;
 }
 
+/** (internal) chunk of arena keeping strings of received entries; strings
+ * live as long as journal does */
+struct StringsArenaChunk {
+    /** Previously filled chunk */
+    struct StringsArenaChunk * prev;
+    size_t nUsed, size;
+    char data[];
+};
+
+/** (internal) kinds of messages passed through ingest pipeline */
+enum JournalMessageKind {
+    /** Received from source's publisher */
+    kJournalMsgLive = 0,
+    /** Received from source's snapshot service: part of snapshot, or
+     * message re-sent on request */
+    kJournalMsgService,
+    /** Mark of no parts: sources went quiet, so entries held back for merge
+     * can be released */
+    kJournalMsgIdle,
+    /** Mark of no parts: source's snapshot service did not reply in time */
+    kJournalMsgSnapshotLost,
+};
+
+/** (internal) message taken from source's socket by receiver thread, with
+ * all its parts */
+struct RawMessage {
+    /** Number of source message was received from */
+    uint16_t nSource;
+    /** Kind of the message, `enum JournalMessageKind` */
+    uint8_t kind;
+    unsigned int nFrames;
+    zmq_msg_t frames[];
+};
+
+/** (internal) message decoded by a worker, applied by appender */
+struct DecodedMessage {
+    /** Journal entries of the message (of all its `j` arrays) */
+    struct ncrm_JournalEntry * entries;
+    unsigned long nEntries, nAllocated;
+    /** Set for the message items present */
+    int hasStatus:1
+      , hasProgress:1
+      , hasElapsedTime:1
+      , hasSeq:1
+      , hasSnapshotEnd:1
+      ;
+    /** Number of source message was received from */
+    uint16_t nSource;
+    /** Kind of the message, `enum JournalMessageKind` */
+    uint8_t kind;
+    /** Sequence number of the message and, for the end of snapshot, of the
+     * latest message covered by snapshot */
+    uint64_t seq, snapshotEnd;
+    /** Next message held back till snapshot ends (see `JournalSource`) */
+    struct DecodedMessage * next;
+    /** Number of entries received, including shed ones */
+    unsigned long nReceived;
+    /** Entries shed by ingest budget per level class, and the latest
+     * timestamp of them */
+    unsigned long nShed[NCRM_JOURNAL_N_LEVEL_CLASSES];
+    ncrm_Timestamp_t shedLatest[NCRM_JOURNAL_N_LEVEL_CLASSES];
+    char appMsg[sizeof(((struct ncrm_Model *) NULL)->appMsg)];
+    int statusMode;
+    unsigned long currentProgress, maxProgress, elapsedTime;
+    /** Non-zero listener's error code if message is malformed, described
+     * by `errBf` */
+    int rc;
+    char errBf[256];
+};
+
+/** (internal) decode worker, a stage between receiver and appender.
+ * Messages are dealt to workers round-robin, so appender restores their
+ * order taking decoded ones in the same sequence */
+struct DecodeWorker {
+    struct ncrm_JournalExtensionConfig * cfg;
+    pthread_t thread;
+    /** Raw messages from receiver */
+    struct ncrm_SPSCQueue inbox;
+    /** Decoded messages to appender */
+    struct ncrm_SPSCQueue outbox;
+    /** Arena keeping strings decoded by this worker (the latest chunk) */
+    struct StringsArenaChunk * strings;
+    /** Start of current ingest budget period, msec; entries of every level
+     * class taken within it and ones over budget */
+    unsigned long periodStart;
+    unsigned long nTaken[NCRM_JOURNAL_N_LEVEL_CLASSES]
+                , nOverBudget[NCRM_JOURNAL_N_LEVEL_CLASSES]
+                ;
+};
+
+/** (internal) range of missed messages of a source, to be requested from
+ * its snapshot service */
+struct ResendRequest {
+    uint16_t nSource;
+    uint64_t first, last;
+};
+
+/** (internal) state of a source kept by appender, to merge entries */
+struct JournalSource {
+    /** Latest timestamp of entries received from the source */
+    ncrm_Timestamp_t latest;
+    /** Number of entries received from the source */
+    unsigned long nEntries;
+    /** Set while snapshot of the source is being received */
+    int snapshotPending:1;
+    /** Set if source has snapshot service, missed messages are requested
+     * from */
+    int hasService:1;
+    /** Sequence number of the latest message applied */
+    uint64_t lastSeq;
+    /** Live messages received while snapshot is pending, held back */
+    struct DecodedMessage * heldFirst, * heldLast;
+    /** Entries of the source shed within current budget period per level
+     * class, and the latest timestamp of them */
+    unsigned long nPeriodShed[NCRM_JOURNAL_N_LEVEL_CLASSES];
+    ncrm_Timestamp_t shedLatest[NCRM_JOURNAL_N_LEVEL_CLASSES];
+};
 
 /* Static data structure, common for extension routines
  *
@@ -499,237 +1028,1129 @@ _put_priority_glyph(WINDOW * dest, int val, int omitChar) {
  * seem to be a right choice.
  * */
 static struct {
-    /** Listener (SUB) thread join condition
-     * Note: it is not guarded by mutex as there is only one thread actually
-     * modifying it */
-    int keepGoingFlag:1;
-    /** 0MQ (SUB) context receiving messages */
+    /** Set while pipeline threads are running */
+    int listening:1;
+    /** Error code of listener, zero if no error occured */
+    atomic_int listenerRC;
+    /** Cleared to stop the receiver */
+    atomic_int keepGoing;
+    /** 0MQ context and (SUB) sockets receiving messages, one per
+     * source */
     void * zmqContext
-       , * subscriber
+       , * subscribers[NCRM_JOURNAL_MAX_SOURCES]
        ;
-    /** recv'ing buffer */
-    char * recvBuf;
-    /** Collected journal entries */
-    struct ncrm_JournalEntries * journalEntries;
-    /** Mutex protecting access to `journalEntries` */
-    pthread_mutex_t entriesLock;
-    /** Listener thread */
-    pthread_t listenerThread;
-
-    /** Collection of views */
-    struct JournalEntriesView ** views;
+    uint16_t nSources;
+    /** (DEALER) sockets requesting snapshots and re-sending of missed
+     * messages from sources' services (receiver thread) */
+    void * snapshotRequesters[NCRM_JOURNAL_MAX_SOURCES];
+    /** Set if subscription is narrowed by topics */
+    int topicsFiltered:1;
+    /** Ranges of missed messages to be requested, `struct ResendRequest`
+     * (appender -> receiver) */
+    struct ncrm_SPSCQueue resendRequests;
+    /** eventfd descriptor waking receiver from poll, on resend request
+     * or stop */
+    int receiverWakeFd;
+    /** Statistics of sequence numbers (written by appender): set once
+     * numbered message is received; number of gaps detected, messages
+     * missed and ones recovered by re-sending */
+    atomic_int seqSeen;
+    atomic_ulong nGaps, nMissed, nRecovered;
+    /** Ingest pipeline: receiver thread -> decode workers -> appender
+     * thread */
+    pthread_t receiverThread
+            , appenderThread
+            ;
+    struct DecodeWorker * workers;
+    unsigned int nWorkers;
+
+    /** Merge state of sources and the latest timestamp over all of them
+     * (appender thread) */
+    struct JournalSource sources[NCRM_JOURNAL_MAX_SOURCES];
+    ncrm_Timestamp_t latest;
+    /** Entries received within a batch, and entries held back by reorder
+     * window, sorted (appender thread). Former are merged into latter,
+     * using `merged` as destination */
+    struct ncrm_JournalSelection incoming, pending, merged;
+    /** Ingest accounting (appender thread): start of current period, msec,
+     * and entries received within it (entries shed are counted per source,
+     * see `JournalSource`) */
+    unsigned long periodStart
+                , nPeriodReceived
+                ;
+    /** Arena keeping strings of entries made by appender */
+    struct StringsArenaChunk * strings;
+    /** Ingest rate of the last period, entries per second, and overall
+     * number of entries shed (written by appender) */
+    atomic_ulong ingestRate, nShed;
+    /** Lags of sources, as of the latest update event (render thread) */
+    ncrm_Timestamp_t sourceLags[NCRM_JOURNAL_MAX_SOURCES];
+    /** Number of entries evaluated by views' queries (render thread) */
+    unsigned long nEntriesProcessed;
+
+    /** Entries of the batch being appended, collected into payload of the
+     * update event (see `struct JournalDelta`) */
+    struct ncrm_Payload * delta;
+    /** Number of entries `delta` can hold */
+    unsigned long nDeltaAllocated;
+
+    /** Collection of views, top to bottom */
+    struct JournalEntriesView * views[NCRM_JOURNAL_MAX_VIEWS];
+    uint16_t nViews;
+    /** View receiving navigation keys */
+    uint16_t nFocusedView;
+
+    /** Appender's events producer; updates carry entries, so appender
+     * waits for free slot with no time limit (and pipeline stalls, leaving
+     * messages to 0MQ's high-water mark); cancelled on shutdown only */
+    struct ncrm_Producer producer;
+    /** ID of the extension, events are addressed by */
+    uint16_t extensionID;
 } gLocalData;
 
-/** (internal) structure used to communicate problems from extension */
-struct ListenerThreadExitResults {
-    int rc;
-    char * errorDetails;
+/** (internal) payload of extension's update event: entries received since
+ * previous event, sorted. Handed to render thread as is */
+struct JournalDelta {
+    /** Lag of every source behind the latest entry received, msec;
+     * `ULONG_MAX` if source did not send entries yet */
+    ncrm_Timestamp_t sourceLags[NCRM_JOURNAL_MAX_SOURCES];
+    unsigned long n;
+    struct ncrm_JournalEntry entries[];
 };
 
-/* A listener loop for journal events; to be ran in thread */
+/* Copies entries into delta being collected */
+static void
+_delta_append( const struct ncrm_JournalEntry * block, unsigned long n ) {
+    struct JournalDelta * delta;
+    if( !gLocalData.delta ) {
+        gLocalData.nDeltaAllocated = n > 1024 ? n : 1024;
+        gLocalData.delta = ncrm_payload_new( sizeof(struct JournalDelta)
+                + gLocalData.nDeltaAllocated*sizeof(struct ncrm_JournalEntry)
+                , NULL );
+        delta = ncrm_payload_data(gLocalData.delta);
+        delta->n = 0;
+    }
+    delta = ncrm_payload_data(gLocalData.delta);
+    if( delta->n + n > gLocalData.nDeltaAllocated ) {
+        while( delta->n + n > gLocalData.nDeltaAllocated )
+            gLocalData.nDeltaAllocated *= 2;
+        gLocalData.delta = ncrm_payload_resize( gLocalData.delta
+                , sizeof(struct JournalDelta)
+                + gLocalData.nDeltaAllocated*sizeof(struct ncrm_JournalEntry) );
+        delta = ncrm_payload_data(gLocalData.delta);
+    }
+    memcpy( delta->entries + delta->n, block
+          , n*sizeof(struct ncrm_JournalEntry) );
+    delta->n += n;
+}
+
+/* Wakes receiver sleeping in poll */
+static void
+_receiver_wake() {
+    const uint64_t one = 1;
+    ssize_t rc = write(gLocalData.receiverWakeFd, &one, sizeof(one));
+    (void) rc;  /* counter overflow is not possible here */
+}
+
+/* Stops pipeline: receiver exits, blocked stages get woken up */
+static void
+_pipeline_stop() {
+    atomic_store(&gLocalData.keepGoing, 0);
+    _receiver_wake();
+    for( unsigned int i = 0; i < gLocalData.nWorkers; ++i ) {
+        ncrm_spsc_close(&gLocalData.workers[i].inbox);
+        ncrm_spsc_close(&gLocalData.workers[i].outbox);
+    }
+}
+
+/* Stops listening on error, reporting it to model (the first error only);
+ * may be called from any pipeline thread */
+static void
+_listener_failed( struct ncrm_JournalExtensionConfig * cfg
+                , int rc, const char * details ) {
+    int noError = 0;
+    if( !atomic_compare_exchange_strong(&gLocalData.listenerRC, &noError, rc) )
+        return;
+    char errBf[320];
+    snprintf( errBf, sizeof(errBf)
+            , "Listener of \"" NCRM_JOURNAL_EXTENSION_NAME "\" failed"
+              " with code %d: \"%s\"", rc, details );
+    ncrm_mdl_error(cfg->modelPtr, errBf);
+    _pipeline_stop();
+}
+
+/* Copies string into arena (null-terminating it) */
+static char *
+_arena_strndup( struct StringsArenaChunk ** arena, const char * s, size_t len ) {
+    struct StringsArenaChunk * chunk = *arena;
+    if( !chunk || chunk->size - chunk->nUsed < len + 1 ) {
+        /* long strings get own chunk, put behind the current one, so the
+         * latter keeps being filled */
+        const int isLong = len + 1 > NCRM_JOURNAL_ARENA_CHUNK_SIZE/4;
+        const size_t size = isLong ? len + 1 : NCRM_JOURNAL_ARENA_CHUNK_SIZE;
+        struct StringsArenaChunk * newChunk
+            = malloc(sizeof(struct StringsArenaChunk) + size);
+        assert(newChunk);
+        newChunk->nUsed = 0;
+        newChunk->size = size;
+        if( isLong && chunk ) {
+            newChunk->prev = chunk->prev;
+            chunk->prev = newChunk;
+        } else {
+            newChunk->prev = chunk;
+            *arena = newChunk;
+        }
+        chunk = newChunk;
+    }
+    char * dest = chunk->data + chunk->nUsed;
+    memcpy(dest, s, len);
+    dest[len] = '\0';
+    chunk->nUsed += len + 1;
+    return dest;
+}
+
+/* Frees all the chunks of arena */
+static void
+_arena_free( struct StringsArenaChunk ** arena ) {
+    while( *arena ) {
+        struct StringsArenaChunk * prev = (*arena)->prev;
+        free(*arena);
+        *arena = prev;
+    }
+}
+
+/* Returns level class of entry level (rounded up to hundreds), as its
+ * priority glyph shows */
+static int
+_level_class( ncrm_JournalEntryLevel_t level ) {
+    if( level <= 0 ) return 0;
+    return level > 800 ? NCRM_JOURNAL_N_LEVEL_CLASSES - 1 : (level + 99)/100;
+}
+
+/* Returns monotonic time, msec */
+static unsigned long
+_now_msec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+/* Returns non-zero if entry of given level class is over ingest budget and
+ * has to be shed. Budget is split between workers evenly, as messages are
+ * dealt to them in turn */
+static int
+_over_budget( struct DecodeWorker * w, int nClass ) {
+    const unsigned int budget = w->cfg->levelBudgets[nClass];
+    if( !budget || nClass <= NCRM_JOURNAL_KEPT_LEVEL_CLASS ) return 0;
+    const unsigned long workerBudget = budget > gLocalData.nWorkers
+                                     ? budget/gLocalData.nWorkers : 1;
+    if( w->nTaken[nClass] < workerBudget ) {
+        ++w->nTaken[nClass];
+        return 0;
+    }
+    /* sampled */
+    return ++w->nOverBudget[nClass] % NCRM_JOURNAL_SAMPLING_RATE ? 1 : 0;
+}
+
+/* Decodes array of journal entries (`[timestamp, level, category, message]`
+ * each) straight into decoded message, strings are copied into worker's
+ * arena. Returns non-zero on malformed data */
+static int
+_decode_entries( struct DecodeWorker * w
+               , struct ncrm_MsgpackCursor * c
+               , struct DecodedMessage * msg ) {
+    uint32_t n;
+    if( ncrm_mp_read_array(c, &n) ) return 1;
+    if( msg->nEntries + n > msg->nAllocated ) {
+        msg->nAllocated = msg->nEntries + n;
+        msg->entries = realloc( msg->entries
+                              , msg->nAllocated*sizeof(struct ncrm_JournalEntry) );
+        assert(msg->entries);
+    }
+    for( uint32_t nEntry = 0; nEntry < n; ++nEntry ) {
+        struct ncrm_JournalEntry * dest = msg->entries + msg->nEntries;
+        uint32_t nFields, categoryLen, messageLen;
+        uint64_t timest;
+        int64_t level;
+        const char * category, * message;
+        if( ncrm_mp_read_array(c, &nFields) || 4 != nFields
+         || ncrm_mp_read_uint(c, &timest)
+         || ncrm_mp_read_int(c, &level)
+         || ncrm_mp_read_str(c, &category, &categoryLen)
+         || ncrm_mp_read_str(c, &message, &messageLen) ) return 1;
+        ++msg->nReceived;
+        /* entries requested over service channel are never shed */
+        const int nClass = _level_class(level);
+        if( kJournalMsgLive == msg->kind && _over_budget(w, nClass) ) {
+            ++msg->nShed[nClass];
+            if( timest > msg->shedLatest[nClass] )
+                msg->shedLatest[nClass] = timest;
+            continue;
+        }
+        dest->timest   = timest;
+        dest->level    = level;
+        dest->source   = msg->nSource;
+        dest->category = _arena_strndup(&w->strings, category, categoryLen);
+        dest->message  = _arena_strndup(&w->strings, message, messageLen);
+        ++msg->nEntries;
+    }
+    return 0;
+}
+
+/* Decodes message's status: must always be a (string, u-number) */
+static int
+_decode_status( struct ncrm_MsgpackCursor * c, struct DecodedMessage * msg ) {
+    uint32_t nItems, len;
+    const char * s;
+    uint64_t mode;
+    if( ncrm_mp_read_array(c, &nItems) || 2 != nItems
+     || ncrm_mp_read_str(c, &s, &len)
+     || ncrm_mp_read_uint(c, &mode) ) return 1;
+    if( len >= sizeof(msg->appMsg) ) len = sizeof(msg->appMsg) - 1;
+    memcpy(msg->appMsg, s, len);
+    msg->appMsg[len] = '\0';
+    msg->statusMode = mode;
+    msg->hasStatus = 0x1;
+    return 0;
+}
+
+/* Decodes message's progress: must be always (number, number) */
+static int
+_decode_progress( struct ncrm_MsgpackCursor * c, struct DecodedMessage * msg ) {
+    uint32_t nItems;
+    uint64_t current, max;
+    if( ncrm_mp_read_array(c, &nItems) || 2 != nItems
+     || ncrm_mp_read_uint(c, &current)
+     || ncrm_mp_read_uint(c, &max) ) return 1;
+    msg->currentProgress = current;
+    msg->maxProgress = max;
+    msg->hasProgress = 0x1;
+    return 0;
+}
+
+/* Decodes a message object (map of journal entries, status, etc) read from
+ * the cursor. Returns non-zero listener's error code, with description in
+ * message's `errBf` */
+static int
+_decode_object( struct DecodeWorker * w
+              , struct ncrm_MsgpackCursor * c
+              , struct DecodedMessage * msg ) {
+    uint32_t nPairs;
+    if( ncrm_mp_read_map(c, &nPairs) ) {
+        snprintf(msg->errBf, sizeof(msg->errBf)
+                , "From \"%s\": root message node is of type %#x, not"
+                  " an object."
+                , w->cfg->addresses[msg->nSource], ncrm_mp_at_end(c) ? 0 : *c->cur );
+        return 5;
+    }
+    for( uint32_t nPair = 0; nPair < nPairs; ++nPair ) {
+        const char * key;
+        uint32_t keyLen;
+        if( ncrm_mp_read_str(c, &key, &keyLen) ) {
+            snprintf(msg->errBf, sizeof(msg->errBf)
+                    , "From \"%s\": malformed message key."
+                    , w->cfg->addresses[msg->nSource] );
+            return 4;
+        }
+        /* keys are dispatched by length and first character, unknown ones
+         * are skipped */
+        int rc;
+        if( 1 == keyLen && 'j' == key[0] ) {
+            rc = _decode_entries(w, c, msg);
+        } else if( 6 == keyLen && 's' == key[0]
+                && !memcmp(key, "status", 6) ) {
+            rc = _decode_status(c, msg);
+        } else if( 8 == keyLen && 'p' == key[0]
+                && !memcmp(key, "progress", 8) ) {
+            rc = _decode_progress(c, msg);
+        } else if( 3 == keyLen && 's' == key[0]
+                && !memcmp(key, "seq", 3) ) {
+            rc = ncrm_mp_read_uint(c, &msg->seq);
+            msg->hasSeq = 0x1;
+        } else if( 11 == keyLen && 's' == key[0]
+                && !memcmp(key, "snapshotEnd", 11) ) {
+            rc = ncrm_mp_read_uint(c, &msg->snapshotEnd);
+            msg->hasSnapshotEnd = 0x1;
+        } else if( 11 == keyLen && 'e' == key[0]
+                && !memcmp(key, "elapsedTime", 11) ) {
+            /* must always be just a number */
+            uint64_t elapsed;
+            rc = ncrm_mp_read_uint(c, &elapsed);
+            msg->elapsedTime = elapsed;
+            msg->hasElapsedTime = 0x1;
+        } else {
+            rc = ncrm_mp_skip(c);
+        }
+        if( rc ) {
+            snprintf(msg->errBf, sizeof(msg->errBf)
+                    , "From \"%s\": malformed value of \"%.*s\"."
+                    , w->cfg->addresses[msg->nSource], (int) keyLen, key );
+            return 4;
+        }
+    }
+    return 0;
+}
+
+/* Decodes objects right from 0MQ's buffer of received frame (strings are
+ * copied into arena, so frame is not retained). Frame may contain several
+ * objects; object can not span over frames. */
+static int
+_decode_frame( struct DecodeWorker * w, zmq_msg_t * frame
+             , struct DecodedMessage * msg ) {
+    struct ncrm_MsgpackCursor c;
+    ncrm_mp_cursor_init(&c, zmq_msg_data(frame), zmq_msg_size(frame));
+    while( !ncrm_mp_at_end(&c) ) {
+        int rc = _decode_object(w, &c, msg);
+        if( rc ) return rc;
+    }
+    return 0;
+}
+
+static void
+_raw_message_free( struct RawMessage * raw ) {
+    for( unsigned int i = 0; i < raw->nFrames; ++i )
+        zmq_msg_close(raw->frames + i);
+    free(raw);
+}
+
+static void
+_decoded_message_free( struct DecodedMessage * msg ) {
+    free(msg->entries);
+    free(msg);
+}
+
+/* Allocates message able to hold given number of parts */
+static struct RawMessage *
+_raw_message_new( uint16_t nSource, uint8_t kind, unsigned int nAllocated ) {
+    struct RawMessage * raw
+        = malloc(sizeof(struct RawMessage) + nAllocated*sizeof(zmq_msg_t));
+    assert(raw);
+    raw->nSource = nSource;
+    raw->kind = kind;
+    raw->nFrames = 0;
+    return raw;
+}
+
+/* Receives message with all its parts from socket of the source; 0MQ
+ * delivers message atomically, so all the parts are available once the
+ * first one is. Returns NULL if there is no message or on error (then
+ * `errno` is not EAGAIN) */
+static struct RawMessage *
+_receive_message( void * socket, uint16_t nSource, uint8_t kind ) {
+    unsigned int nAllocated = 1;
+    struct RawMessage * raw = _raw_message_new(nSource, kind, nAllocated);
+    do {
+        if( raw->nFrames == nAllocated ) {
+            /* initialized messages must not be copied byte-wise (e.g. by
+             * realloc()), so parts are moved to larger array */
+            nAllocated *= 2;
+            struct RawMessage * grown = _raw_message_new(nSource, kind, nAllocated);
+            for( ; grown->nFrames < raw->nFrames; ++grown->nFrames ) {
+                zmq_msg_t * frame = grown->frames + grown->nFrames;
+                zmq_msg_init(frame);
+                zmq_msg_move(frame, raw->frames + grown->nFrames);
+            }
+            _raw_message_free(raw);
+            raw = grown;
+        }
+        zmq_msg_t * frame = raw->frames + raw->nFrames;
+        zmq_msg_init(frame);
+        if( zmq_msg_recv(frame, socket, ZMQ_DONTWAIT) < 0 ) {
+            int err = errno;
+            zmq_msg_close(frame);
+            _raw_message_free(raw);
+            errno = err;
+            return NULL;
+        }
+        ++raw->nFrames;
+    } while( zmq_msg_more(raw->frames + raw->nFrames - 1) );
+    return raw;
+}
+
+/* Deals message to the next decode worker, waiting if it lags. Returns
+ * non-zero if pipeline is stopped */
+static int
+_deal_message( struct RawMessage * raw, unsigned long * nMsg ) {
+    struct DecodeWorker * w = gLocalData.workers + (*nMsg)++%gLocalData.nWorkers;
+    if( ncrm_spsc_push(&w->inbox, raw) ) {
+        _raw_message_free(raw);
+        return 1;
+    }
+    return 0;
+}
+
+/* Deals mark (message of no parts) of given kind. Returns non-zero if
+ * pipeline is stopped */
+static int
+_deal_mark( uint16_t nSource, uint8_t kind, unsigned long * nMsg ) {
+    return _deal_message(_raw_message_new(nSource, kind, 0), nMsg);
+}
+
+/* Returns non-zero if message is the last one of snapshot (single
+ * `{"snapshotEnd": <seq>}` object) */
+static int
+_is_snapshot_end( struct RawMessage * raw ) {
+    struct ncrm_MsgpackCursor c;
+    uint32_t n, keyLen;
+    const char * key;
+    if( 1 != raw->nFrames ) return 0;
+    ncrm_mp_cursor_init(&c, zmq_msg_data(raw->frames), zmq_msg_size(raw->frames));
+    return !ncrm_mp_read_map(&c, &n) && 1 == n
+        && !ncrm_mp_read_str(&c, &key, &keyLen)
+        && 11 == keyLen && !memcmp(key, "snapshotEnd", 11);
+}
+
+/* Returns time receiver may sleep waiting for messages till the nearest
+ * deadline, msec: idle mark is due once sources go quiet, snapshot requests
+ * expire. Returns -1 if there is none (receiver is woken up then by
+ * messages, resend requests or stop only) */
+static long
+_receiver_timeout( const unsigned long * snapshotDeadlines
+                 , int receivedSinceIdle ) {
+    long timeout = receivedSinceIdle ? NCRM_JOURNAL_IDLE_PERIOD_MSEC : -1;
+    const unsigned long now = _now_msec();
+    for( uint16_t i = 0; i < gLocalData.nSources; ++i ) {
+        if( !snapshotDeadlines[i] ) continue;
+        const long left = snapshotDeadlines[i] > now
+                        ? (long) (snapshotDeadlines[i] - now) : 0;
+        if( timeout < 0 || left < timeout ) timeout = left;
+    }
+    return timeout;
+}
+
+/* Receiver thread: takes messages from sources' sockets and deals them to
+ * decode workers, waiting if they lag (then messages are left to 0MQ's
+ * high-water mark). Sources ready at once are taken one message each, in
+ * turn. If sources go quiet, sends an idle mark to let appender release
+ * entries held back for merge.
+ *
+ * Replies of snapshot services are dealt the same way. If service does not
+ * reply to snapshot request in time, appender is notified with a mark.
+ * Requests for re-sending of missed messages are sent on appender's
+ * demand */
 static void *
-_journal_updater(void * cfg_) {
+_journal_receiver( void * cfg_ ) {
     struct ncrm_JournalExtensionConfig * cfg
         = (struct ncrm_JournalExtensionConfig *) cfg_;
+    char errBf[256];
+    unsigned long nMsg = 0;
+    int receivedSinceIdle = 0;
+    /* polled sockets: subscribers, then snapshot requesters; followed by
+     * wake-up descriptor */
+    zmq_pollitem_t items[2*NCRM_JOURNAL_MAX_SOURCES + 1];
+    uint16_t itemSources[2*NCRM_JOURNAL_MAX_SOURCES];
+    /* time pending snapshot requests expire at, 0 if none pending */
+    unsigned long snapshotDeadlines[NCRM_JOURNAL_MAX_SOURCES];
+    const unsigned long started = _now_msec();
+    for( uint16_t i = 0; i < gLocalData.nSources; ++i ) {
+        snapshotDeadlines[i] = gLocalData.snapshotRequesters[i]
+                             ? started + NCRM_JOURNAL_SNAPSHOT_TIMEOUT_MSEC
+                             : 0;
+    }
+    struct ncrm_MsgpackBuffer request;
+    ncrm_mp_buffer_init(&request);
+    while( atomic_load(&gLocalData.keepGoing) ) {
+        void * item;
+        while( !ncrm_spsc_try_pop(&gLocalData.resendRequests, &item) ) {
+            struct ResendRequest * rr = (struct ResendRequest *) item;
+            void * requester = gLocalData.snapshotRequesters[rr->nSource];
+            /* `{"resend": [<first>, <last>]}`, dropped if can't be sent at
+             * once */
+            ncrm_mp_buffer_reset(&request);
+            ncrm_mp_write_map(&request, 1);
+            ncrm_mp_write_str(&request, "resend", 6);
+            ncrm_mp_write_array(&request, 2);
+            ncrm_mp_write_uint(&request, rr->first);
+            ncrm_mp_write_uint(&request, rr->last);
+            if( requester )
+                zmq_send(requester, request.data, request.size, ZMQ_DONTWAIT);
+            free(rr);
+        }
+        uint16_t nItems = 0;
+        for( uint16_t i = 0; i < gLocalData.nSources; ++i ) {
+            itemSources[nItems] = i;
+            items[nItems++].socket = gLocalData.subscribers[i];
+        }
+        for( uint16_t i = 0; i < gLocalData.nSources; ++i ) {
+            if( !gLocalData.snapshotRequesters[i] ) continue;
+            itemSources[nItems] = i;
+            items[nItems++].socket = gLocalData.snapshotRequesters[i];
+        }
+        for( uint16_t i = 0; i < nItems; ++i ) {
+            items[i].fd = 0;
+            items[i].events = ZMQ_POLLIN;
+            items[i].revents = 0;
+        }
+        items[nItems].socket = NULL;
+        items[nItems].fd = gLocalData.receiverWakeFd;
+        items[nItems].events = ZMQ_POLLIN;
+        items[nItems].revents = 0;
+        int rc = zmq_poll( items, nItems + 1
+                         , _receiver_timeout(snapshotDeadlines, receivedSinceIdle) );
+        if( rc < 0 && EINTR == errno ) continue;
+        if( rc < 0 ) {
+            snprintf( errBf, sizeof(errBf)
+                    , "zmq_poll(...): %s", zmq_strerror(errno) );
+            _listener_failed(cfg, 2, errBf);
+            break;
+        }
+        if( items[nItems].revents & ZMQ_POLLIN ) {
+            uint64_t counter;
+            ssize_t nRead = read(gLocalData.receiverWakeFd, &counter, sizeof(counter));
+            (void) nRead;  /* only resets the counter */
+        }
+        if( !rc && receivedSinceIdle ) {
+            if( _deal_mark(0, kJournalMsgIdle, &nMsg) ) break;  /* pipeline stopped */
+            receivedSinceIdle = 0;
+        }
+        for( uint16_t n = 0; n < nItems; ++n ) {
+            if( !(items[n].revents & ZMQ_POLLIN) ) continue;
+            const uint16_t i = itemSources[n];
+            const int isService = n >= gLocalData.nSources;
+            struct RawMessage * raw = _receive_message( items[n].socket, i
+                    , isService ? kJournalMsgService : kJournalMsgLive );
+            if( !raw ) {
+                if( EAGAIN == errno ) continue;
+                snprintf(errBf, sizeof(errBf)
+                        , "zmq_msg_recv(...) on \"%s\": %s"
+                        , isService ? cfg->snapshotAddresses[i] : cfg->addresses[i]
+                        , zmq_strerror(errno) );
+                _listener_failed(cfg, 2, errBf);
+                break;
+            }
+            if( isService && snapshotDeadlines[i] ) {
+                snapshotDeadlines[i] = _is_snapshot_end(raw) ? 0
+                        : _now_msec() + NCRM_JOURNAL_SNAPSHOT_TIMEOUT_MSEC;
+            }
+            if( _deal_message(raw, &nMsg) ) break;  /* pipeline stopped */
+            receivedSinceIdle = 1;
+        }
+        /* give up snapshots of silent services */
+        const unsigned long now = _now_msec();
+        for( uint16_t i = 0; i < gLocalData.nSources; ++i ) {
+            if( !snapshotDeadlines[i] || now < snapshotDeadlines[i] ) continue;
+            snapshotDeadlines[i] = 0;
+            if( _deal_mark(i, kJournalMsgSnapshotLost, &nMsg) ) break;
+        }
+    }
+    ncrm_mp_buffer_free(&request);
+    /* let workers finish what was received */
+    for( unsigned int i = 0; i < gLocalData.nWorkers; ++i )
+        ncrm_spsc_close(&gLocalData.workers[i].inbox);
+    return NULL;
+}
 
-    struct ListenerThreadExitResults * lteR
-        = malloc(sizeof(struct ListenerThreadExitResults));
-    bzero(lteR, sizeof(struct ListenerThreadExitResults));
+/* Decode worker thread */
+static void *
+_journal_decoder( void * w_ ) {
+    struct DecodeWorker * w = (struct DecodeWorker *) w_;
+    void * item;
+    while( !ncrm_spsc_pop(&w->inbox, &item) ) {
+        struct RawMessage * raw = (struct RawMessage *) item;
+        struct DecodedMessage * msg = calloc(1, sizeof(struct DecodedMessage));
+        assert(msg);
+        msg->nSource = raw->nSource;
+        msg->kind = raw->kind;
+        /* budget period expired */
+        const unsigned long now = _now_msec();
+        if( now - w->periodStart >= NCRM_JOURNAL_BUDGET_PERIOD_MSEC ) {
+            w->periodStart = now;
+            memset(w->nTaken, 0, sizeof(w->nTaken));
+        }
+        /* skip topic, if any (root object is always a map) */
+        unsigned int nFirst = 0;
+        if( raw->nFrames ) {
+            const uint8_t * first = zmq_msg_data(raw->frames);
+            if( !zmq_msg_size(raw->frames)
+             || !(0x80 == (*first & 0xf0) || 0xde == *first || 0xdf == *first) )
+                nFirst = 1;
+        }
+        for( unsigned int i = nFirst; i < raw->nFrames && !msg->rc; ++i )
+            msg->rc = _decode_frame(w, raw->frames + i, msg);
+        _raw_message_free(raw);
+        if( ncrm_spsc_push(&w->outbox, msg) ) {
+            _decoded_message_free(msg);
+            break;  /* pipeline stopped */
+        }
+    }
+    ncrm_spsc_close(&w->outbox);
+    return NULL;
+}
 
+/* Takes entries of decoded message to be merged, updating state of its
+ * source */
+static void
+_merge_add( const struct DecodedMessage * msg ) {
+    if( !msg->nEntries ) return;
+    struct JournalSource * src = gLocalData.sources + msg->nSource;
+    for( unsigned long i = 0; i < msg->nEntries; ++i ) {
+        if( msg->entries[i].timest > src->latest )
+            src->latest = msg->entries[i].timest;
+    }
+    src->nEntries += msg->nEntries;
+    if( src->latest > gLocalData.latest ) gLocalData.latest = src->latest;
+    ncrm_je_selection_append(&gLocalData.incoming, msg->entries, msg->nEntries);
+}
+
+/* Merges entries received within the batch into pending ones and releases
+ * (appends to delta) those that can not be preceded by entries still to be
+ * received: entries older than every source's latest one, or older than the
+ * latest received by more than reorder window. With `releaseAll` set
+ * (sources are quiet), releases all of them */
+static void
+_merge_release( struct ncrm_JournalExtensionConfig * cfg, int releaseAll ) {
+    struct ncrm_JournalSelection * incoming = &gLocalData.incoming
+                                 , * pending = &gLocalData.pending
+                                 ;
+    if( incoming->n ) {
+        qsort( incoming->entries, incoming->n
+             , sizeof(struct ncrm_JournalEntry)
+             , _compare_journal_entries );
+        if( pending->n ) {
+            /* merge sorted sequences */
+            struct ncrm_JournalSelection * merged = &gLocalData.merged;
+            if( merged->nAllocated < pending->n + incoming->n ) {
+                merged->nAllocated = pending->n + incoming->n;
+                merged->entries = realloc( merged->entries
+                        , merged->nAllocated*sizeof(struct ncrm_JournalEntry) );
+                assert(merged->entries);
+            }
+            const struct ncrm_JournalEntry * a = pending->entries
+                                         , * aEnd = a + pending->n
+                                         , * b = incoming->entries
+                                         , * bEnd = b + incoming->n
+                                         ;
+            struct ncrm_JournalEntry * dest = merged->entries;
+            while( a != aEnd && b != bEnd )
+                *(dest++) = b->timest < a->timest ? *(b++) : *(a++);
+            while( a != aEnd ) *(dest++) = *(a++);
+            while( b != bEnd ) *(dest++) = *(b++);
+            merged->n = pending->n + incoming->n;
+            struct ncrm_JournalSelection tmp = *pending;
+            *pending = *merged;
+            *merged = tmp;
+        } else {
+            struct ncrm_JournalSelection tmp = *pending;
+            *pending = *incoming;
+            *incoming = tmp;
+        }
+        incoming->n = 0;
+    }
+    if( !pending->n ) return;
+    ncrm_Timestamp_t threshold = ULONG_MAX;
+    if( !releaseAll ) {
+        for( uint16_t i = 0; i < gLocalData.nSources; ++i ) {
+            const struct JournalSource * src = gLocalData.sources + i;
+            if( src->nEntries && src->latest < threshold )
+                threshold = src->latest;
+        }
+        if( gLocalData.latest > cfg->reorderWindow
+         && gLocalData.latest - cfg->reorderWindow > threshold )
+            threshold = gLocalData.latest - cfg->reorderWindow;
+    }
+    /* find first entry after threshold by bisection */
+    unsigned long lo = 0, hi = pending->n;
+    while( lo < hi ) {
+        unsigned long mid = lo + (hi - lo)/2;
+        if( pending->entries[mid].timest <= threshold ) lo = mid + 1;
+        else hi = mid;
+    }
+    if( !lo ) return;
+    _delta_append(pending->entries, lo);
+    memmove( pending->entries, pending->entries + lo
+           , (pending->n - lo)*sizeof(struct ncrm_JournalEntry) );
+    pending->n -= lo;
+}
+
+/* Hands batch of entries to render thread, applies latest status items to
+ * model under single lock acquisition */
+static void
+_journal_flush_batch( struct ncrm_JournalExtensionConfig * cfg
+                    , const struct DecodedMessage * latest
+                    , int doUpdateFooter ) {
     struct ncrm_Event event = { ncrm_kEventExtension };
-    strncpy( event.payload.forExtension.extensionName
-           , NCRM_JOURNAL_EXTENSION_NAME
-           , sizeof(event.payload.forExtension.extensionName)
-           );
+    event.payload.forExtension.extensionID = gLocalData.extensionID;
+    if( gLocalData.delta ) {
+        /* entries are released by merge of sources already sorted */
+        struct JournalDelta * delta = ncrm_payload_data(gLocalData.delta);
+        for( uint16_t i = 0; i < gLocalData.nSources; ++i ) {
+            const struct JournalSource * src = gLocalData.sources + i;
+            delta->sourceLags[i] = src->nEntries
+                                 ? gLocalData.latest - src->latest
+                                 : ULONG_MAX;
+        }
+        event.payload.forExtension.data = gLocalData.delta;
+        gLocalData.delta = NULL;
+    }
+    ncrm_enqueue_from(&gLocalData.producer, &event);
+    if( !doUpdateFooter ) return;
+    struct ncrm_Model * mdl = cfg->modelPtr;
+    pthread_mutex_lock(&mdl->lock); {
+        if( latest->hasStatus ) {
+            memcpy(mdl->appMsg, latest->appMsg, sizeof(mdl->appMsg));
+            mdl->statusMode = latest->statusMode;
+        }
+        if( latest->hasProgress ) {
+            mdl->currentProgress = latest->currentProgress;
+            mdl->maxProgress = latest->maxProgress;
+        }
+        if( latest->hasElapsedTime )
+            mdl->elapsedTime = latest->elapsedTime;
+    } pthread_mutex_unlock(&mdl->lock);
+    struct ncrm_Event footerUpdateEvent = {ncrm_kEventFooterUpdate};
+    ncrm_enqueue_from(&gLocalData.producer, &footerUpdateEvent);
+}
 
-    gLocalData.recvBuf = malloc(NCRM_JOURNAL_MAX_BUFFER_LENGTH);
-    gLocalData.zmqContext = zmq_ctx_new();
-    gLocalData.subscriber = zmq_socket(gLocalData.zmqContext, ZMQ_SUB);
-    int rc = zmq_connect(gLocalData.subscriber, cfg->address);
-    if( rc ) {
-        lteR->rc = 1;
-        lteR->errorDetails = malloc(128);
-        snprintf(lteR->errorDetails, 128
-                , "zmq_connect(\"%s\") return code: %d, %s"
-                , cfg->address, rc, zmq_strerror(errno) );
-        pthread_exit(lteR);
+/* Tracks sequence numbers of source's messages: counts gaps, requesting
+ * missed messages from source's snapshot service, and messages re-sent */
+static void
+_journal_track_seq( const struct DecodedMessage * msg ) {
+    struct JournalSource * src = gLocalData.sources + msg->nSource;
+    if( !src->lastSeq ) atomic_store(&gLocalData.seqSeen, 1);
+    if( kJournalMsgService == msg->kind ) {
+        /* parts of snapshot are not counted */
+        if( !src->snapshotPending && msg->seq <= src->lastSeq )
+            atomic_fetch_add(&gLocalData.nRecovered, 1);
+        return;
     }
-    rc = zmq_setsockopt(gLocalData.subscriber, ZMQ_SUBSCRIBE, "", 0);
-    if( rc ) {
-        lteR->rc = 1;
-        lteR->errorDetails = malloc(128);
-        snprintf(lteR->errorDetails, 128
-                , "zmq_setsockopt(SUBSCRIBE) on \"%s\" return code: %d"
-                , cfg->address, rc );
-        pthread_exit(lteR);
-    }
-
-    while(gLocalData.keepGoingFlag) {
-        int recvRet = zmq_recv( gLocalData.subscriber
-                              , gLocalData.recvBuf
-                              , NCRM_JOURNAL_MAX_BUFFER_LENGTH
-                              , 0 == cfg->recvIntervalMSec ? 0 : ZMQ_DONTWAIT );
-        int errnoCpy = 0;
-        if( recvRet < 0 ) errnoCpy = errno;
-        if( 0 != cfg->recvIntervalMSec && EAGAIN == errnoCpy ) {
-            usleep(cfg->recvIntervalMSec*1e3);
+    /* messages filtered by topics leave gaps */
+    if( src->lastSeq && msg->seq > src->lastSeq + 1
+     && !gLocalData.topicsFiltered ) {
+        const uint64_t nMissed = msg->seq - src->lastSeq - 1;
+        atomic_fetch_add(&gLocalData.nGaps, 1);
+        atomic_fetch_add(&gLocalData.nMissed, nMissed);
+        if( src->hasService && nMissed <= NCRM_JOURNAL_MAX_RESEND ) {
+            struct ResendRequest * rr = malloc(sizeof(struct ResendRequest));
+            assert(rr);
+            rr->nSource = msg->nSource;
+            rr->first = src->lastSeq + 1;
+            rr->last = msg->seq - 1;
+            /* receiver lagging with requests is unlikely; drop if so */
+            if( ncrm_spsc_try_push(&gLocalData.resendRequests, rr) ) free(rr);
+            else _receiver_wake();
+        }
+    }
+    /* numbering restarts with source */
+    if( msg->seq > src->lastSeq || 1 == msg->seq ) src->lastSeq = msg->seq;
+}
+
+/* Applies decoded message: takes its entries to be merged and its status
+ * items as the latest ones of the batch. Frees message */
+static void
+_journal_take( struct DecodedMessage * latest, struct DecodedMessage * msg ) {
+    if( msg->hasSeq ) _journal_track_seq(msg);
+    _merge_add(msg);
+    if( msg->hasStatus ) {
+        memcpy(latest->appMsg, msg->appMsg, sizeof(latest->appMsg));
+        latest->statusMode = msg->statusMode;
+        latest->hasStatus = 0x1;
+    }
+    if( msg->hasProgress ) {
+        latest->currentProgress = msg->currentProgress;
+        latest->maxProgress = msg->maxProgress;
+        latest->hasProgress = 0x1;
+    }
+    if( msg->hasElapsedTime ) {
+        latest->elapsedTime = msg->elapsedTime;
+        latest->hasElapsedTime = 0x1;
+    }
+    _decoded_message_free(msg);
+}
+
+/* Splices snapshot of the source with live messages held back meanwhile:
+ * applies ones not covered by snapshot (of sequence number greater than
+ * `lastSeq`), drops the others */
+static void
+_snapshot_end( struct DecodedMessage * latest
+             , uint16_t nSource, uint64_t lastSeq ) {
+    struct JournalSource * src = gLocalData.sources + nSource;
+    src->snapshotPending = 0x0;
+    if( lastSeq > src->lastSeq ) src->lastSeq = lastSeq;
+    while( src->heldFirst ) {
+        struct DecodedMessage * msg = src->heldFirst;
+        src->heldFirst = msg->next;
+        if( msg->hasSeq && msg->seq <= lastSeq ) {
+            _decoded_message_free(msg);
             continue;
         }
-        if( recvRet == -1 ) {
-            lteR->rc = 2;
-            lteR->errorDetails = malloc(128);
-            snprintf(lteR->errorDetails, 128
-                    , "zmq_recv(...) on \"%s\" return code: %d, %s"
-                    , cfg->address, recvRet, zmq_strerror(errnoCpy) );
-            pthread_exit(lteR);
-        }
-        if( recvRet > NCRM_JOURNAL_MAX_BUFFER_LENGTH ) {
-            lteR->rc = 3;
-            lteR->errorDetails = malloc(256);
-            snprintf(lteR->errorDetails, 256
-                    , "zmq_recv(...) on \"%s\" fetched message of %d bytes"
-                      " length while ncrm \"" NCRM_JOURNAL_EXTENSION_NAME
-                      "\" extesnions limit is %d bytes max."
-                    , cfg->address, recvRet, NCRM_JOURNAL_MAX_BUFFER_LENGTH );
-            pthread_exit(lteR);
-        }
-
-        msgpack_unpacked msg;
-        msgpack_unpacked_init(&msg);
-        msgpack_unpack_return ret
-            = msgpack_unpack_next( &msg  /* ................. result */
-                                 , gLocalData.recvBuf  /* ... data */
-                                 , recvRet  /* .............. size */
-                                 , NULL  /* .............. (size_t *) offset */
-                                 );
-        if( !ret ) {
-            lteR->rc = 4;
-            lteR->errorDetails = malloc(256);
-            snprintf(lteR->errorDetails, 256
-                    , "msgpack_unpack_next(...) on \"%s\" return code: %d"
-                    , cfg->address, (int) ret );
-            pthread_exit(lteR);
-        }
-
-        /* Extract data; we expect the message to be an object */
-        msgpack_object root = msg.data;
-        if( root.type != MSGPACK_OBJECT_MAP ) {
-            lteR->rc = 5;
-            lteR->errorDetails = malloc(128);
-            snprintf(lteR->errorDetails, 128
-                    , "From \"%s\": root message node is of type %#x, not"
-                      " an object."
-                    , cfg->address, root.type );
-            pthread_exit(lteR);
-        }
-        /* NOTE: schemata checks below relate to the client API that for most
-         * of the cases should be provided by ncrm lib itself, so we only
-         * check schematic validity with assert() */
-        int doUpdateFooter = 0;
-        for( int nMapNode = 0; nMapNode < root.via.map.size; ++nMapNode ) {
-            const msgpack_object_kv * kv = root.via.map.ptr + nMapNode;
-            assert( kv->key.type == MSGPACK_OBJECT_STR );
-            char key[128];
-            strncpy(key, kv->key.via.str.ptr, kv->key.via.str.size);
-            key[ kv->key.via.str.size >= sizeof(key)
-               ? sizeof(key)-1
-               : kv->key.via.str.size
-               ] = '\0';
-            /* ^^^ NOTE this string is not null-terminated! */
-            //ncrm_mdl_error( cfg->modelPtr, key );  // XXX
-            if(!strcmp("j", key)) {
-                /* process journal entries */
-                assert( kv->val.type == MSGPACK_OBJECT_ARRAY );
-                #if 0
-                {  // XXX
-                    char bf[128];
-                    snprintf(bf, sizeof(bf), "unpacking %d entries", (int) kv->val.via.array.size);
-                    ncrm_mdl_error( cfg->modelPtr, bf );  // XXX
-                }
-                #endif
-                struct ncrm_JournalEntry * newBlock
-                    = _convert_msgs_block(&(kv->val.via.array));
-                /* `gLocalData.journalEntries` is used by updating callback
-                 * from main thread, so it has to be synchronized */
-                pthread_mutex_lock(&gLocalData.entriesLock); {
-                    #if 0
-                    {  // XXX -------------------------------------------------
-                        char bf[128];
-                        for( struct ncrm_JournalEntry * jePtr = newBlock
-                           ; !ncrm_je_is_terminative_entry(jePtr)
-                           ; ++jePtr
-                           ) {
-                            snprintf(bf, sizeof(bf), " => \"%s\"", jePtr->message);
-                            ncrm_mdl_error( cfg->modelPtr, bf );
-                        }
-                    }  // XXX -------------------------------------------------
-                    #endif
-                    gLocalData.journalEntries = ncrm_je_append(
-                            gLocalData.journalEntries , newBlock );
-                } pthread_mutex_unlock(&gLocalData.entriesLock);
-                continue;
+        _journal_take(latest, msg);
+    }
+    src->heldLast = NULL;
+}
+
+/* Accounts entries received and shed by decoder within the message */
+static void
+_ingest_account( const struct DecodedMessage * msg ) {
+    struct JournalSource * src = gLocalData.sources + msg->nSource;
+    gLocalData.nPeriodReceived += msg->nReceived;
+    for( int c = 0; c < NCRM_JOURNAL_N_LEVEL_CLASSES; ++c ) {
+        if( !msg->nShed[c] ) continue;
+        src->nPeriodShed[c] += msg->nShed[c];
+        if( msg->shedLatest[c] > src->shedLatest[c] )
+            src->shedLatest[c] = msg->shedLatest[c];
+    }
+}
+
+/* Once budget period expires (or sources go quiet, `force`), updates ingest
+ * rate and takes a summary entry ("N entries suppressed") for every source
+ * and level class shed within the period, timestamped as the latest entry
+ * shed, to be merged with received ones */
+static void
+_ingest_summarize( int force ) {
+    const unsigned long now = _now_msec()
+                      , elapsed = now - gLocalData.periodStart
+                      ;
+    if( !elapsed || (!force && elapsed < NCRM_JOURNAL_BUDGET_PERIOD_MSEC) )
+        return;
+    atomic_store( &gLocalData.ingestRate
+                , gLocalData.nPeriodReceived*1000/elapsed );
+    gLocalData.periodStart = now;
+    gLocalData.nPeriodReceived = 0;
+    for( uint16_t i = 0; i < gLocalData.nSources; ++i ) {
+        struct JournalSource * src = gLocalData.sources + i;
+        for( int c = 0; c < NCRM_JOURNAL_N_LEVEL_CLASSES; ++c ) {
+            if( !src->nPeriodShed[c] ) continue;
+            char bf[64];
+            int len = snprintf( bf, sizeof(bf), "%lu entries suppressed"
+                              , src->nPeriodShed[c] );
+            struct ncrm_JournalEntry summary;
+            summary.timest   = src->shedLatest[c];
+            summary.level    = c*100;
+            summary.source   = i;
+            summary.category = _arena_strndup(&gLocalData.strings, "ncrm.ingest", 11);
+            summary.message  = _arena_strndup(&gLocalData.strings, bf, len);
+            ncrm_je_selection_append(&gLocalData.incoming, &summary, 1);
+            atomic_fetch_add(&gLocalData.nShed, src->nPeriodShed[c]);
+            src->nPeriodShed[c] = 0;
+            src->shedLatest[c] = 0;
+        }
+    }
+}
+
+/* Appender thread: takes decoded messages in the order they were received
+ * and appends them in batches of up to `maxMsgsPerBatch`, merging entries
+ * of sources. Live messages of source being caught up are held back till
+ * its snapshot ends */
+static void *
+_journal_appender( void * cfg_ ) {
+    struct ncrm_JournalExtensionConfig * cfg
+        = (struct ncrm_JournalExtensionConfig *) cfg_;
+    unsigned long nMsg = 0;
+    void * item;
+    while( !ncrm_spsc_pop( &gLocalData.workers[nMsg%gLocalData.nWorkers].outbox
+                         , &item ) ) {
+        /* latest status items of the batch */
+        struct DecodedMessage latest;
+        latest.hasStatus = latest.hasProgress = latest.hasElapsedTime = 0x0;
+        int releaseAll = 0;
+        unsigned int nInBatch = 0;
+        do {
+            struct DecodedMessage * msg = (struct DecodedMessage *) item;
+            struct JournalSource * src = gLocalData.sources + msg->nSource;
+            ++nMsg;
+            if( msg->rc ) {
+                _listener_failed(cfg, msg->rc, msg->errBf);
+                _decoded_message_free(msg);
+                break;
             }
-            if(!strcmp("status", key)) {
-                /* update model's status: must always be a (string, u-number) */
-                assert( kv->val.type == MSGPACK_OBJECT_ARRAY );
-                assert( kv->val.via.array.size == 2 );
-                pthread_mutex_lock(&cfg->modelPtr->lock); {
-                    const char * s
-                        = kv->val.via.array.ptr[0].via.str.ptr;
-                    const uint64_t ss
-                        = kv->val.via.array.ptr[0].via.str.size;
-                    if( !s || *s == '\0' ) {
-                        cfg->modelPtr->appMsg[0] = '\0';
-                    } else {
-                        strncpy( cfg->modelPtr->appMsg
-                               , s
-                               , sizeof(cfg->modelPtr->appMsg) );
-                        cfg->modelPtr->appMsg[ ss >= sizeof(cfg->modelPtr->appMsg)
-                                             ? sizeof(cfg->modelPtr->appMsg) - 1
-                                             : ss
-                                             ] = '\0';
+            _ingest_account(msg);
+            switch( msg->kind ) {
+                case kJournalMsgIdle:
+                    releaseAll = 1;
+                    _decoded_message_free(msg);
+                    break;
+                case kJournalMsgSnapshotLost:
+                    /* no way to tell what is duplicated, apply all */
+                    _snapshot_end(&latest, msg->nSource, 0);
+                    _decoded_message_free(msg);
+                    break;
+                case kJournalMsgService: {
+                    const int isEnd = msg->hasSnapshotEnd;
+                    const uint64_t lastSeq = msg->snapshotEnd;
+                    const uint16_t nSource = msg->nSource;
+                    _journal_take(&latest, msg);
+                    if( isEnd ) _snapshot_end(&latest, nSource, lastSeq);
+                    break;
+                }
+                default:
+                    if( !src->snapshotPending ) {
+                        _journal_take(&latest, msg);
+                        break;
                     }
-                    cfg->modelPtr->statusMode
-                        = kv->val.via.array.ptr[1].via.u64;
-                } pthread_mutex_unlock(&cfg->modelPtr->lock);
-                doUpdateFooter = 1;
-                continue;
+                    msg->next = NULL;
+                    if( src->heldLast ) src->heldLast->next = msg;
+                    else src->heldFirst = msg;
+                    src->heldLast = msg;
             }
-            if(!strcmp("progress", key)) {
-                /* update model's progress: must be always (number, number) */
-                assert( kv->val.type == MSGPACK_OBJECT_ARRAY );
-                assert( kv->val.via.array.size == 2 );
-                pthread_mutex_lock(&cfg->modelPtr->lock); {
-                    cfg->modelPtr->currentProgress
-                        = kv->val.via.array.ptr[0].via.u64;
-                    cfg->modelPtr->currentProgress
-                        = kv->val.via.array.ptr[1].via.u64;
-                } pthread_mutex_unlock(&cfg->modelPtr->lock);
-                doUpdateFooter = 1;
-                continue;
-            }
-            if(!strcmp("elapsedTime", key)) {
-                /* update model's elapsed time: must always be just a number */
-                assert( kv->val.type == MSGPACK_OBJECT_POSITIVE_INTEGER );
-                cfg->modelPtr->elapsedTime
-                        = kv->val.via.u64;
-                doUpdateFooter = 1;
-                continue;
-            }
-        }  /* end of journal entry message processing */
-        ncrm_enqueue(&event);
-        if( doUpdateFooter ) {
-            struct ncrm_Event footerUpdateEvent = {ncrm_kEventFooterUpdate};
-            ncrm_enqueue(&footerUpdateEvent);
-        }
-        msgpack_unpacked_destroy(&msg);
+        } while( ++nInBatch < cfg->maxMsgsPerBatch
+              && !ncrm_spsc_try_pop( &gLocalData.workers[nMsg%gLocalData.nWorkers].outbox
+                                   , &item ) );
+        _ingest_summarize(releaseAll);
+        _merge_release(cfg, releaseAll);
+        _journal_flush_batch( cfg, &latest
+                            , latest.hasStatus || latest.hasProgress
+                           || latest.hasElapsedTime );
+        if( atomic_load(&gLocalData.listenerRC) ) break;
     }
+    return NULL;
+}
 
-    zmq_close(gLocalData.subscriber);
-    zmq_ctx_destroy(gLocalData.zmqContext);
-    free(gLocalData.recvBuf);
+/* Connects requester socket to source's snapshot service and sends request
+ * for backlog. Returns non-zero on error (reported to model) */
+static int
+_request_snapshot( struct ncrm_JournalExtensionConfig * cfg, uint16_t nSource ) {
+    char errBf[256];
+    void * requester = zmq_socket(gLocalData.zmqContext, ZMQ_DEALER);
+    gLocalData.snapshotRequesters[nSource] = requester;
+    int rc = zmq_connect(requester, cfg->snapshotAddresses[nSource]);
+    if( rc ) {
+        snprintf(errBf, sizeof(errBf)
+                , "zmq_connect(\"%s\") return code: %d, %s"
+                , cfg->snapshotAddresses[nSource], rc, zmq_strerror(errno) );
+        return _listener_failed(cfg, 1, errBf), 1;
+    }
+    struct ncrm_MsgpackBuffer request;
+    ncrm_mp_buffer_init(&request);
+    ncrm_mp_write_map(&request, 2);
+    ncrm_mp_write_str(&request, "snapshot", 8);
+    ncrm_mp_write_uint(&request, cfg->snapshotSpan);
+    ncrm_mp_write_str(&request, "levels", 6);
+    ncrm_mp_write_array(&request, 2);
+    ncrm_mp_write_int(&request, cfg->snapshotLevelRange[0]);
+    ncrm_mp_write_int(&request, cfg->snapshotLevelRange[1]);
+    /* queued till connection is established */
+    rc = zmq_send(requester, request.data, request.size, 0);
+    ncrm_mp_buffer_free(&request);
+    if( rc < 0 ) {
+        snprintf(errBf, sizeof(errBf)
+                , "zmq_send(...) on \"%s\": %s"
+                , cfg->snapshotAddresses[nSource], zmq_strerror(errno) );
+        return _listener_failed(cfg, 1, errBf), 1;
+    }
+    gLocalData.sources[nSource].snapshotPending = 0x1;
+    gLocalData.sources[nSource].hasService = 0x1;
+    return 0;
+}
+
+/** (internal) prefixes of topics subscribed to: per level class for every
+ * view, and for messages of no topic */
+struct JournalTopics {
+    uint16_t n;
+    char prefixes[NCRM_JOURNAL_N_LEVEL_CLASSES*NCRM_JOURNAL_MAX_VIEWS + 18][NCRM_JOURNAL_MAX_TOPIC_LEN];
+};
+
+/* Adds prefix to the set, if it is not there yet */
+static void
+_topics_add( struct JournalTopics * topics, const char * prefix ) {
+    for( uint16_t i = 0; i < topics->n; ++i )
+        if( !strcmp(topics->prefixes[i], prefix) ) return;
+    strcpy(topics->prefixes[topics->n++], prefix);
+}
 
-    pthread_exit(lteR);
+/* Collects prefixes of topics of messages that views' queries may match.
+ * Results in a single empty prefix (everything) if any query is not
+ * narrowed by levels or category */
+static void
+_jviews_topics( struct JournalTopics * topics ) {
+    char prefix[NCRM_JOURNAL_MAX_TOPIC_LEN];
+    topics->n = 0;
+    for( uint16_t nView = 0; nView < gLocalData.nViews; ++nView ) {
+        const struct ncrm_QueryParams * q = &gLocalData.views[nView]->query;
+        /* literal part of category pattern is a prefix of every category
+         * matched */
+        size_t len = 0;
+        if( q->categoryPatern ) {
+            len = strcspn(q->categoryPatern, "*?[\\");
+            if( len > sizeof(prefix) - 3 ) len = sizeof(prefix) - 3;
+        }
+        const char lo = q->levelRange[0] > -1 ? '0' + _level_class(q->levelRange[0]) : '0'
+                 , hi = q->levelRange[1] > -1 ? '0' + _level_class(q->levelRange[1]) : '9'
+                 ;
+        if( '0' == lo && '9' == hi && !len ) {
+            topics->n = 1;
+            topics->prefixes[0][0] = '\0';
+            return;
+        }
+        for( char c = lo; c <= hi; ++c ) {
+            prefix[0] = c;
+            prefix[1] = ':';
+            memcpy(prefix + 2, q->categoryPatern, len);
+            prefix[2 + len] = '\0';
+            _topics_add(topics, prefix);
+        }
+    }
+    /* messages of no topic start with a map */
+    for( int b = 0x80; b <= 0x8f; ++b ) {
+        prefix[0] = b;
+        prefix[1] = '\0';
+        _topics_add(topics, prefix);
+    }
+    _topics_add(topics, "\xde");
+    _topics_add(topics, "\xdf");
+}
+
+/* Connects subscriber sockets and starts ingest pipeline. Returns non-zero
+ * on error (reported to model) */
+static int
+_journal_listen( struct ncrm_JournalExtensionConfig * cfg ) {
+    char errBf[256];
+    assert( cfg->nAddresses && cfg->nAddresses <= NCRM_JOURNAL_MAX_SOURCES );
+    ncrm_spsc_init(&gLocalData.resendRequests, NCRM_JOURNAL_PIPELINE_DEPTH);
+    gLocalData.receiverWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert( gLocalData.receiverWakeFd >= 0 );
+    gLocalData.zmqContext = zmq_ctx_new();
+    /* views are set up, subscribe to what they may show */
+    struct JournalTopics topics;
+    _jviews_topics(&topics);
+    gLocalData.topicsFiltered = topics.prefixes[0][0] ? 0x1 : 0x0;
+    for( uint16_t i = 0; i < cfg->nAddresses; ++i ) {
+        void * subscriber = zmq_socket(gLocalData.zmqContext, ZMQ_SUB);
+        gLocalData.subscribers[gLocalData.nSources++] = subscriber;
+        gLocalData.sourceLags[i] = ULONG_MAX;
+        int rc = zmq_connect(subscriber, cfg->addresses[i]);
+        if( rc ) {
+            snprintf(errBf, sizeof(errBf)
+                    , "zmq_connect(\"%s\") return code: %d, %s"
+                    , cfg->addresses[i], rc, zmq_strerror(errno) );
+            return _listener_failed(cfg, 1, errBf), 1;
+        }
+        for( uint16_t nTopic = 0; nTopic < topics.n; ++nTopic ) {
+            rc = zmq_setsockopt( subscriber, ZMQ_SUBSCRIBE
+                               , topics.prefixes[nTopic]
+                               , strlen(topics.prefixes[nTopic]) );
+            if( rc ) {
+                snprintf(errBf, sizeof(errBf)
+                        , "zmq_setsockopt(SUBSCRIBE) on \"%s\" return code: %d"
+                        , cfg->addresses[i], rc );
+                return _listener_failed(cfg, 1, errBf), 1;
+            }
+        }
+        /* once subscribed, request backlog (live messages are held back
+         * till it is received) */
+        if( cfg->snapshotAddresses[i] && _request_snapshot(cfg, i) ) return 1;
+    }
+    ncrm_je_selection_init(&gLocalData.incoming);
+    ncrm_je_selection_init(&gLocalData.pending);
+    ncrm_je_selection_init(&gLocalData.merged);
+    gLocalData.periodStart = _now_msec();
+    gLocalData.nWorkers = cfg->nDecodeWorkers;
+    if( !gLocalData.nWorkers ) gLocalData.nWorkers = 1;
+    if( gLocalData.nWorkers > NCRM_JOURNAL_MAX_DECODE_WORKERS )
+        gLocalData.nWorkers = NCRM_JOURNAL_MAX_DECODE_WORKERS;
+    gLocalData.workers = calloc( gLocalData.nWorkers
+                               , sizeof(struct DecodeWorker) );
+    atomic_store(&gLocalData.keepGoing, 1);
+    for( unsigned int i = 0; i < gLocalData.nWorkers; ++i ) {
+        struct DecodeWorker * w = gLocalData.workers + i;
+        w->cfg = cfg;
+        ncrm_spsc_init(&w->inbox, NCRM_JOURNAL_PIPELINE_DEPTH);
+        ncrm_spsc_init(&w->outbox, NCRM_JOURNAL_PIPELINE_DEPTH);
+        pthread_create(&w->thread, NULL, _journal_decoder, w);
+    }
+    pthread_create(&gLocalData.appenderThread, NULL, _journal_appender, cfg);
+    pthread_create(&gLocalData.receiverThread, NULL, _journal_receiver, cfg);
+    gLocalData.listening = 0x1;
+    return 0;
 }
 
 static int
@@ -740,275 +2161,262 @@ _journal_entries_ext_init( struct ncrm_Extension * ext
     assert(nLines);
     assert(nCols);
 
-    gLocalData.keepGoingFlag = 0x1;
     assert(ext);
     assert(ext->userData);
     struct ncrm_JournalExtensionConfig * cfg
         = (struct ncrm_JournalExtensionConfig *) ext->userData;
     cfg->modelPtr = modelPtr;
+    gLocalData.extensionID = ext->id;
 
     cfg->dims[0][0] = top;
     cfg->dims[0][1] = left;
     cfg->dims[1][0] = nLines;
     cfg->dims[1][1] = nCols;
 
-    pthread_mutex_init(&gLocalData.entriesLock, NULL);
-    pthread_create( &gLocalData.listenerThread, NULL, _journal_updater, cfg );
-
-    /* Init single view (further we possibly will recieve some initial view
-     * configuration from outside) */
-    gLocalData.views = malloc(2*sizeof(struct JournalEntriesView *));
-    gLocalData.views[1] = NULL;  /* sentinel */
-    gLocalData.views[0] = _new_journal_entries_view(cfg);
-
-    return 0;
+    /* Init views before listener starts, so they will get all the entries
+     * received */
+    assert( cfg->nViews <= NCRM_JOURNAL_MAX_VIEWS );
+    gLocalData.nViews = 0;
+    for( uint16_t i = 0; i < cfg->nViews; ++i ) {
+        gLocalData.views[gLocalData.nViews++]
+            = _new_journal_entries_view(cfg, &cfg->views[i].query);
+    }
+    if( !gLocalData.nViews ) {
+        gLocalData.views[gLocalData.nViews++]
+            = _new_journal_entries_view(cfg, &cfg->defaultQueryParameters);
+    }
+    gLocalData.nFocusedView = gLocalData.nViews - 1;
+    gLocalData.views[gLocalData.nFocusedView]->focused = 0x1;
+    gLocalData.delta = NULL;
+    atomic_init(&gLocalData.listenerRC, 0);
+    ncrm_producer_init( &gLocalData.producer, "journal"
+                      , ncrm_kOverflowBlock, 0 );
+    return _journal_listen(cfg);
 }
 
+/* Fills view's layout: message and its line for every body row. If all the
+ * lines fit in the body, they're aligned to the bottom. */
 static void
-_update_view( struct ncrm_Model *, struct JournalEntriesView * view );  /* fwd */
+_jview_layout( struct JournalEntriesView * view
+             , uint16_t bodyH
+             , unsigned long nLinesTotal ) {
+    unsigned long nEntry = ncrm_ps_find(&view->linesIndex, view->topLine);
+    uint16_t nLine = view->topLine - ncrm_ps_sum(&view->linesIndex, nEntry);
+    uint16_t nRow = 0;
+    for( ; nRow < bodyH && nLinesTotal < bodyH - nRow; ++nRow )
+        view->layout[nRow].message = NULL;
+    for( ; nRow < bodyH && nEntry < view->queryResults.n; ++nRow ) {
+        view->layout[nRow].message = view->queryResults.entries[nEntry].message;
+        view->layout[nRow].nLine = nLine;
+        if( ++nLine == view->nResultLines[nEntry] ) {
+            nLine = 0;
+            ++nEntry;
+        }
+    }
+    for( ; nRow < bodyH; ++nRow )
+        view->layout[nRow].message = NULL;
+}
 
 static int
-_journal_entries_ext_update( struct ncrm_Extension * ext
-                           , struct ncrm_Event * event ) {
-    struct ncrm_JournalExtensionConfig * cfg
-        = (struct ncrm_JournalExtensionConfig *) ext->userData;
-    /* Create windows, pads, panels if need.
-     * Iterate over set of views looking for zero dimensions.
-     * */
-    #if 0
-    int overallDims[64][2];  /* todo: dedicated macro */
-    int nView = 0;
-    for( struct JournalEntriesView * jev = gLocalData.views
-       ; jev && *jev
-       ; ++jev, ++nView ) {
-        overallDims[nDim][0] = jev->dims[0];
-        overallDims[nDim][1] = jev->dims[1];
-        assert( nView < 64 );  /* todo: dedicated macro */
-    }
-    assert( nView < 64 );  /* todo: dedicated macro */
-    overallDims[nDim] = -1;
-    ... TODO: multi-view
-    #else
-    /* TODO: multiview. We assume single (static) view so far */
-    assert( gLocalData.views );
-    assert( gLocalData.views[0] );
-    assert( gLocalData.views[1] == NULL );
-    {
-        struct JournalEntriesView * jev = gLocalData.views[0];
-        /* If dimensions is not set, use all available space for the
-         * extension */
-        if( 0 == jev->dims[1][0] || 0 == jev->dims[1][1] ) {
-            jev->dims[0][0] = cfg->dims[0][0];   /* top */
-            jev->dims[0][1] = cfg->dims[0][1];   /* left */
-            jev->dims[1][0] = cfg->dims[1][0];   /* height */
-            jev->dims[1][1] = cfg->dims[1][1];   /* width */
-        }
-        assert(jev->dims[1][0]);
-        assert(jev->dims[1][1]);
-        /* If windows/panels/pads do not exist, create */
-        if( !jev->w_jHeader ) {
-            assert(jev->dims[1][0]);
-            assert(jev->dims[1][1]);
-            jev->w_jHeader = newwin( 1   /* # of lines in win */
-                                   , jev->dims[1][1]  /* # of columns in win */
-                                   , jev->dims[0][0]  /* Y of LT corner */
-                                   , jev->dims[0][1]  /* X of LT corner */
-                                   );
-            #if 0
-            jev->w_jBody = newwin( jev->dims[1][0] - 1  /* # of lines in win */
-                                 , jev->dims[1][1]      /* # of columns in win */
-                                 , jev->dims[0][0] + 1  /* Y of LT corner */
-                                 , jev->dims[0][1]      /* X of LT corner */
-                                 );
-            #endif
-            jev->w_jBody = newpad( NCRM_JOURNAL_MAX_LINES_SHOWN  /* # of lines in pad */
-                                 , jev->dims[1][1]      /* # of columns in pad */
-                                 );
-            box(jev->w_jBody, 0, 0);  // XXX
-            #if 0
-            box(jev->w_jBody, 0, 0);
-            touchwin(jev->w_jBody);
-            wrefresh(jev->w_jBody);
-            #endif
-
-            #if 0
-            box(jev->w_jHeader, 0, 0);
-            touchwin(jev->w_jHeader);
-            wrefresh(jev->w_jHeader);
-            #endif
-            
-            /* Create panels for header and footer */
-            jev->p_jHeader = new_panel(jev->w_jHeader);
-            jev->p_jBody   = new_panel(jev->w_jBody);
+_jview_rows_eq( const struct JournalViewRow * a, const struct JournalViewRow * b ) {
+    return a->message == b->message && (!a->message || a->nLine == b->nLine);
+}
+
+/* Returns number of rows the drawn content has to be shifted by to match
+ * the new layout (positive -- up, negative -- down), or zero if no shift
+ * makes sense. As every message line appears at most once on the body, the
+ * shift is defined by position of the first non-blank layout row among the
+ * drawn ones. */
+static int32_t
+_jview_rows_shift( const struct JournalEntriesView * view, uint16_t bodyH ) {
+    int32_t nLayoutRow, nRow;
+    for( nLayoutRow = 0
+       ; nLayoutRow < bodyH && !view->layout[nLayoutRow].message
+       ; ++nLayoutRow ) {}
+    if( nLayoutRow == bodyH ) return 0;
+    for( nRow = 0
+       ; nRow < bodyH && !_jview_rows_eq(view->rows + nRow, view->layout + nLayoutRow)
+       ; ++nRow ) {}
+    if( nRow == bodyH || nRow == nLayoutRow ) return 0;
+    const int32_t shift = nRow - nLayoutRow;
+    /* shifted content must match in the overlapping range */
+    for( int32_t i = shift > 0 ? 0 : -shift; i < bodyH && i + shift < bodyH; ++i ) {
+        if( !_jview_rows_eq(view->rows + i + shift, view->layout + i) ) return 0;
+    }
+    return shift;
+}
+
+/* Renders a single line of the message on the body row */
+static void
+_jview_render_line( struct JournalEntriesView * view
+                  , struct ncrm_RenderBuffer * rb
+                  , uint16_t nRow
+                  , unsigned long nEntry
+                  , const char * line
+                  , uint16_t nLineInMsg ) {
+    const struct ncrm_JournalEntry * je = view->queryResults.entries + nEntry;
+    attr_t pgAttrs = _put_priority_glyph(rb, nRow, je->level, nLineInMsg);
+    uint16_t col = 2;
+    if( view->showTimestamp ) {
+        if( !nLineInMsg ) {
+            const char * ts;
+            uint16_t tsLen = _jview_timestamp(view, nEntry, &ts);
+            if( tsLen > view->tsColWidth ) tsLen = view->tsColWidth;
+            ncrm_rb_fill(rb, nRow, 1, pgAttrs & ~A_BLINK, ' ', 1);
+            /* right align in column */
+            ncrm_rb_put( rb, nRow, 2 + view->tsColWidth - tsLen
+                       , pgAttrs & ~A_BLINK, ts, tsLen );
         }
+        col = 3 + view->tsColWidth;
     }
-    #endif
-
-    /* `gLocalData.journalEntries` is used by message-unpacking code
-     * from listener thread, so it has to be guarded */
-    pthread_mutex_lock(&gLocalData.entriesLock); {
-        /* Update views selection according to their queries using new data */
-        for( struct JournalEntriesView ** jev = gLocalData.views
-           ; jev && *jev
-           ; ++jev ) {
-            /* re-query items */
-            assert( gLocalData.journalEntries );
-                (*jev)->nQueryResults =
-                    ncrm_je_query( gLocalData.journalEntries
-                                 , &(*jev)->query
-                                 , &(*jev)->queryResults
-                                 );
-            _update_view(cfg->modelPtr, *jev);
+    if( view->srcColWidth ) {
+        if( !nLineInMsg ) {
+            char srcBf[8];
+            int srcLen = snprintf(srcBf, sizeof(srcBf), "#%u", je->source);
+            ncrm_rb_put( rb, nRow, col + view->srcColWidth - srcLen
+                       , A_DIM, srcBf, srcLen );
         }
-    } pthread_mutex_unlock(&gLocalData.entriesLock);
-    return 0;
+        col += view->srcColWidth + 1;
+    }
+    /* print message (line is already cut to fit the column) */
+    ncrm_rb_put(rb, nRow, col, A_NORMAL, line, strlen(line));
 }
 
+/* Renders view's header line */
 static void
-_update_view( struct ncrm_Model * mdl
-            , struct JournalEntriesView * view ) {
-    assert(view);
-    { /* Update query settings window */
-        char printBuf[64];
-        wmove(view->w_jHeader, 0, 0);
-        wattron( view->w_jHeader, A_DIM | A_REVERSE );
-        whline(view->w_jHeader, ' ', view->dims[1][1]);
-        wmove(view->w_jHeader, 0, 0);
-        //  [x] timestamp [x] category | [*]*::* |
-        //wattroff(view->w_jHeader, A_DIM);
-
-        waddch(view->w_jHeader, ' ');
-
-        waddch(view->w_jHeader, '[');
-        waddch(view->w_jHeader, view->showTimestamp ? '#' : ' ');
-        wprintw(view->w_jHeader, "] time:");
-
-        if( view->query.timeRange[0] != ULONG_MAX ) {
-            view->tstFmtSettings.callback( &(view->tstFmtSettings)
-                                         , printBuf
-                                         , view->query.timeRange[0]*1e3 );
-            wprintw(view->w_jHeader, printBuf);
-        } else {
-            waddch(view->w_jHeader, '*');
-        }
-        waddch(view->w_jHeader, '-');
-        if( view->query.timeRange[1] != ULONG_MAX ) {
-            view->tstFmtSettings.callback( &(view->tstFmtSettings)
+_jview_render_header( struct JournalEntriesView * view
+                    , struct ncrm_RenderBuffer * rb ) {
+    char printBuf[64];
+    /* focused view's header is highlighted */
+    const attr_t attrs = view->focused ? A_REVERSE : A_DIM | A_REVERSE;
+    uint16_t col = 0;
+    #define put_text(a, s) col += ncrm_rb_put(rb, 0, col, a, s, strlen(s))
+    ncrm_rb_fill(rb, 0, 0, attrs, ' ', view->dims[1][1]);
+    //  [x] timestamp [x] category | [*]*::* |
+    put_text(attrs, view->showTimestamp ? " [#] time:" : " [ ] time:");
+    for( int i = 0; i < 2; ++i ) {
+        if( i ) put_text(attrs, "-");
+        if( view->query.timeRange[i] != ULONG_MAX ) {
+            uint16_t n = view->tstFmtSettings.callback( &(view->tstFmtSettings)
                                          , printBuf
-                                         , view->query.timeRange[1]*1e3 );
-            wprintw(view->w_jHeader, printBuf);
+                                         , view->query.timeRange[i]*1e3
+                                         , NCRM_TIMESTAMP_NONE );
+            col += ncrm_rb_put(rb, 0, col, attrs, printBuf, n);
         } else {
-            waddch(view->w_jHeader, '*');
+            put_text(attrs, "*");
         }
-
-        wprintw(view->w_jHeader, ", [");
-        waddch(view->w_jHeader, view->showCategory ? '#' : ' ');
-        wprintw(view->w_jHeader, "] category:");
-        if( view->query.categoryPatern ) {
-            wattron(view->w_jHeader, A_BOLD);
-            wprintw(view->w_jHeader, view->query.categoryPatern);
-            wattroff(view->w_jHeader, A_BOLD);
+    }
+    put_text(attrs, view->showCategory ? ", [#] category:" : ", [ ] category:");
+    if( view->query.categoryPatern ) {
+        put_text(attrs | A_BOLD, view->query.categoryPatern);
+    } else {
+        put_text(attrs, "*");
+    }
+    put_text(attrs, ", message:");
+    if( view->query.msgPattern ) {
+        put_text(attrs | A_BOLD, view->query.msgPattern);
+    } else {
+        put_text(attrs, "*");
+    }
+    put_text(attrs, ", prio:");
+    for( int i = 0; i < 2; ++i ) {
+        if( i ) put_text(attrs, "-");
+        if( view->query.levelRange[i] != -1 ) {
+            snprintf(printBuf, sizeof(printBuf), "%d", view->query.levelRange[i]);
+            put_text(attrs, printBuf);
         } else {
-            waddch(view->w_jHeader, '*');
+            put_text(attrs, "*");
         }
-        wprintw(view->w_jHeader, ", message:");
-        if( view->query.msgPattern ) {
-            wattron(view->w_jHeader, A_BOLD);
-            wprintw(view->w_jHeader, view->query.msgPattern);
-            wattroff(view->w_jHeader, A_BOLD);
-        } else {
-            waddch(view->w_jHeader, '*');
+    }
+    snprintf( printBuf, sizeof(printBuf), " q%lu/%lu"
+            , view->queryResults.n, gLocalData.nEntriesProcessed );
+    put_text(attrs, printBuf);
+    if( view->nSources > 1 ) {
+        /* sources that sent entries, and lag of the chosen (or the most
+         * lagging) one */
+        uint16_t nActive = 0, nShown = 0;
+        ncrm_Timestamp_t lag = 0;
+        for( uint16_t i = 0; i < view->nSources; ++i ) {
+            if( ULONG_MAX == gLocalData.sourceLags[i] ) continue;
+            ++nActive;
+            if( view->lagSource < 0 && gLocalData.sourceLags[i] >= lag ) {
+                lag = gLocalData.sourceLags[i];
+                nShown = i;
+            }
         }
-        wprintw(view->w_jHeader, ", prio:");
-        if( view->query.levelRange[0] != -1 ) {
-            snprintf( printBuf, sizeof(printBuf), "%d"
-                    , view->query.levelRange[0] );
-            wprintw(view->w_jHeader, printBuf);
-        } else {
-            waddch(view->w_jHeader, '*');
+        if( view->lagSource >= 0 ) {
+            nShown = view->lagSource;
+            lag = gLocalData.sourceLags[nShown];
         }
-        waddch(view->w_jHeader, '-');
-        if( view->query.levelRange[1] != -1 ) {
-            snprintf( printBuf, sizeof(printBuf), "%d"
-                    , view->query.levelRange[1] );
-            wprintw(view->w_jHeader, printBuf);
+        snprintf( printBuf, sizeof(printBuf), " src:%u/%u lag#%u:"
+                , nActive, view->nSources, nShown );
+        put_text(attrs, printBuf);
+        if( ULONG_MAX == lag ) {
+            put_text(attrs, "-");
         } else {
-            waddch(view->w_jHeader, '*');
+            snprintf(printBuf, sizeof(printBuf), "%lums", lag);
+            put_text(lag > 0 ? attrs | A_BOLD : attrs, printBuf);
         }
-        /* debug */
-        uint16_t nEntriesOverall = 0;
-        for( const struct ncrm_JournalEntries * jes = gLocalData.journalEntries
-           ; jes
-           ; jes = jes->next
-           ) {
-            for( const struct ncrm_JournalEntry * je = jes->entries
-               ; !ncrm_je_is_terminative_entry(je)
-               ; ++je ) {
-                ++nEntriesOverall;
-            }
+    }
+    if( atomic_load(&gLocalData.seqSeen) && gLocalData.topicsFiltered ) {
+        /* messages filtered out by topics leave gaps too, so missed ones
+         * can not be told; zeros would claim the journal is complete */
+        put_text(attrs, " gaps:n/a");
+    } else if( atomic_load(&gLocalData.seqSeen) ) {
+        /* messages missed and not recovered */
+        const unsigned long nMissed = atomic_load(&gLocalData.nMissed)
+                          , nRecovered = atomic_load(&gLocalData.nRecovered)
+                          , nLost = nMissed > nRecovered ? nMissed - nRecovered : 0
+                          ;
+        snprintf( printBuf, sizeof(printBuf), " gaps:%lu lost:%lu"
+                , atomic_load(&gLocalData.nGaps), nLost );
+        put_text(nLost ? attrs | A_BOLD : attrs, printBuf);
+    }
+    {
+        /* ingest rate and entries shed by budget */
+        const unsigned long nShed = atomic_load(&gLocalData.nShed);
+        snprintf( printBuf, sizeof(printBuf), " in:%lu/s"
+                , atomic_load(&gLocalData.ingestRate) );
+        put_text(attrs, printBuf);
+        if( nShed ) {
+            snprintf(printBuf, sizeof(printBuf), " shed:%lu", nShed);
+            put_text(attrs | A_BOLD, printBuf);
         }
-
-        char bf[128];
-        snprintf( bf, sizeof(bf)
-                , " q%d/%d", (int) view->nQueryResults, (int) nEntriesOverall );
-        wprintw(view->w_jHeader, bf);
     }
+    /* scrolling position */
+    if( view->follow ) {
+        put_text(attrs, " [end]");
+    } else {
+        snprintf( printBuf, sizeof(printBuf), " [%lu/%lu]"
+                , view->topLine + 1, ncrm_ps_total(&view->linesIndex) );
+        put_text(attrs, printBuf);
+    }
+    #undef put_text
+}
+
+/* Renders the view (header and damaged rows of the body) into render
+ * buffers. Does not call ncurses, to be ran on render thread. */
+static void
+_jview_render( struct ncrm_Model * mdl
+             , struct JournalEntriesView * view
+             , struct ncrm_RenderBuffer * hdr
+             , struct ncrm_RenderBuffer * body ) {
+    assert(view);
+    const uint16_t bodyH = _jview_body_height(view);
+    const unsigned long nLinesTotal = ncrm_ps_total(&view->linesIndex);
+    /* keep top line in valid range as number of results might change */
+    _jview_scroll_to( view, view->follow ? LONG_MAX : (long) view->topLine );
+    _jview_render_header(view, hdr);
 
-    //werase( view->w_jBody );  /* TODO: uncomment this */
-    _jmsgwin_reset_cursor(view);
     /* Check that we have something to show */
-    if( !view->nQueryResults ) {
-        wattron(view->w_jBody, A_DIM);
-        wprintw(view->w_jBody, "... no messages received.");
-        wattroff(view->w_jBody, A_DIM);
-        _jmsgwin_refresh(view);
+    if( !view->queryResults.n ) {
+        body->erase = 0x1;
+        view->damagedAll = 0x1;
+        const char msg[] = "... no messages received.";
+        ncrm_rb_put(body, bodyH - 1, 0, A_DIM, msg, sizeof(msg) - 1);
         return;
     }
-    /* NOTE: `entries` assumed to go in ascending order, e.g. latest message go
-     * last.
-     *
-     * Iterate over the journal entries finding latest message to iterate
-     * backwards while printing and max of variadic width columns, if needed
-     * */
-    int32_t nEntryLast = 0;
-    uint16_t tsMaxLen = 0;
-    uint32_t maxMsgLen = 0;
-    uint64_t nQuery = 0;
-    for( struct ncrm_JournalEntry ** jePtr = view->queryResults
-       ; nEntryLast < view->dims[1][0] && nEntryLast < NCRM_JOURNAL_MAX_LINES_SHOWN
-         && nQuery < view->nQueryResults
-       ; ++jePtr, ++nEntryLast, ++nQuery ) {
-        uint32_t msgLen = strlen((*jePtr)->message);
-        if(msgLen > maxMsgLen) maxMsgLen = msgLen;
-        /* format timestamp */
-        if( view->showTimestamp ) {
-            const struct ncrm_JournalEntry * je = *jePtr;
-            char * formattedBufBgn = view->formattedTimestamps[nEntryLast];
-            uint16_t tsLen = view->tstFmtSettings.callback(
-                    &view->tstFmtSettings, formattedBufBgn, je->timest );
-            /* update timestamp max len if need */
-            if(tsMaxLen < tsLen) tsMaxLen = tsLen;
-        }
-    }
-    --nEntryLast;
-    /* Calculate widths */
-    /* 1 + 1 + [tsw + 1] + [msgW + 1] + 1
-     * ^   ^   ^^^^^^^^^   ^^^^    ^    ^
-     * |   |       |         |     |    +- scrollbar
-     * |   |       |         |     +------ reserved for a newline char
-     * |   |       |         +------------ width of the message itself
-     * |   |       +---------------------- (opt.) timestamp + 1 for gap
-     * |   +------------------------------ gap after priority marking
-     * +---------------------------------- priority marking
-     * We always have a single-char column with priority marking
-     * We foresee also two chars at the end: a newline marking and a scrollbar
-     * */
-    int32_t msgW = view->dims[1][1]
-                 - 1 - 1  /* priority + gap */
-                 - (view->showTimestamp ? (tsMaxLen + 1) : 0)
-                 - 1      /* scrollbar */
-                 ;
-    if( nEntryLast < 0 || msgW < 0 ) {
+    if( view->wrapWidth <= 0 ) {
         {
             char errBf[128];
             snprintf( errBf, sizeof(errBf)
@@ -1016,153 +2424,323 @@ _update_view( struct ncrm_Model * mdl
             ncrm_mdl_error( mdl, errBf );
         }
         /* window width is not enough to show the message */
-        wprintw(view->w_jBody, "width error");
-        _jmsgwin_refresh(view);
+        body->erase = 0x1;
+        view->damagedAll = 0x1;
+        const char msg[] = "width error";
+        ncrm_rb_put(body, bodyH - 1, 0, A_NORMAL, msg, sizeof(msg) - 1);
         return;
     }
-    /* Format messages making breaks. Iterate from last message backwards until
-     * either messages or shown lines will be exceeded. */
-    int32_t lastMessageBegin = NCRM_JOURNAL_MAX_LINES_SHOWN;
-    /* Allocate message formatting buffer to be at least long enough to handle
-     * longest formatted string */
-    char * buf = malloc(((maxMsgLen)/msgW + 1)*(msgW+2));
-    werase(view->w_jBody);
-    #if 0
-    {  // XXX
-        char errBf[128];
-        snprintf( errBf, sizeof(errBf)
-                , "Extension \"" NCRM_JOURNAL_EXTENSION_NAME "\": printing at most %d messages."
-                , (int) nEntryLast+1 );
-        ncrm_mdl_error( mdl, errBf );
-    }
-    #endif
-    ncrm_mdl_error( mdl, view->queryResults[0]->message );  // XXX
-    uint16_t nLinesShown = 0;
-    for( int16_t nEntry = nEntryLast
-       ; nEntry >= 0 && nLinesShown < view->dims[1][0]
-       ; --nEntry ) {
-        assert(nEntry > -1);
-        const struct ncrm_JournalEntry * je = view->queryResults[nEntry];
-        /* format message to fit message's column width and get number of used
-         * lines.
-         * Formatted message is of the form:
-         *  line1<0x00>line2<0x00>...lineN<0x00><0x04>
-         * I.e. single lines are terminated with null character, the last line
-         * is terminated with 0x04 (EOT).
-         * */
-        #if 0
-        {  // XXX
-            char errBf[128];
-            snprintf( errBf, sizeof(errBf)
-                    , " print %d query's entry starting at line %d: %s"
-                    , (int) nEntry
-                    , (int) lastMessageBegin
-                    , je->message
-                    );
-            ncrm_mdl_error( mdl, errBf );
-        }
-        #endif
-        uint16_t nLinesNeed = _split_message( je->message, msgW, buf );
-        assert( nLinesNeed );
-        lastMessageBegin -= nLinesNeed;
-        /* Print
-         * We print the messages from bottom to up, while the lines within
-         * message are printed from top to bottom. */
-        //for( uint16_t nLineInMsg = 0; nLineInMsg < nLinesNeed; ++nLineInMsg ) {
-        uint16_t nLineInMsg = 0;
-        const char * ts = view->formattedTimestamps[nEntry];
-        uint16_t tsLen = strlen(ts);
-        for( char * c = buf; *c != 0x4; c += strlen(c) + 1, ++nLineInMsg ) {
-            wmove( view->w_jBody
-                 , lastMessageBegin + nLineInMsg, 0
-                 );
-            attr_t pgAttrs = _put_priority_glyph(view->w_jBody, je->level, nLineInMsg);
-            if( view->showTimestamp ) {
-                wattrset( view->w_jBody, pgAttrs );
-                wattroff( view->w_jBody, A_BLINK );
-                if( !nLineInMsg ) {
-                    waddch( view->w_jBody, ' ' );
-                    /* move cursor for right align in column */
-                    #if 0
-                    wmove( view->w_jBody
-                         , lastMessageBegin + nLineInMsg, 3 + tsMaxLen - tsLen - 1
-                         );
-                    #else
-                    uint16_t nSpaces = tsMaxLen - tsLen;
-                    for(int i = 0; i < nSpaces; ++i) {
-                        waddch( view->w_jBody, ' ' );
-                    }
-                    #endif
-                    wprintw( view->w_jBody, ts );
-                    wattrset( view->w_jBody, A_NORMAL );
-                    waddch( view->w_jBody, ' ' );
-                } else {
-                    wmove( view->w_jBody
-                         , lastMessageBegin + nLineInMsg, 3 + tsMaxLen
-                         );
-                }
+    _jview_layout(view, bodyH, nLinesTotal);
+    if( view->damagedAll ) {
+        body->erase = 0x1;
+        for( uint16_t nRow = 0; nRow < bodyH; ++nRow )
+            view->rows[nRow].message = NULL;
+        view->damagedAll = 0x0;
+    } else {
+        /* If view was scrolled (by new messages appended in follow mode, or
+         * by navigation keys), shift pad content to keep rows that are still
+         * shown */
+        int32_t shift = _jview_rows_shift(view, bodyH);
+        if( shift ) {
+            body->scroll = shift;
+            if( shift > 0 ) {
+                memmove( view->rows, view->rows + shift
+                       , (bodyH - shift)*sizeof(struct JournalViewRow) );
+                for( uint16_t nRow = bodyH - shift; nRow < bodyH; ++nRow )
+                    view->rows[nRow].message = NULL;
             } else {
-                /* timestamp column disabled */
-                wmove( view->w_jBody
-                     , lastMessageBegin + nLineInMsg, 3
-                     );
+                memmove( view->rows - shift, view->rows
+                       , (bodyH + shift)*sizeof(struct JournalViewRow) );
+                for( uint16_t nRow = 0; nRow < -shift; ++nRow )
+                    view->rows[nRow].message = NULL;
             }
-            wattrset( view->w_jBody, A_NORMAL );
-            /* print message */
-            wprintw( view->w_jBody, c );
         }
-        nLinesShown += nLinesNeed;
+    }
+    /* Render damaged rows only. Consecutive rows of the same message share
+     * the wrapped message buffer */
+    const int32_t msgW = view->wrapWidth;
+    unsigned long nEntry = ncrm_ps_find(&view->linesIndex, view->topLine);
+    const struct ncrm_JournalEntry * je = NULL;
+    /* Message formatting buffer; grows to handle longest formatted message */
+    char * buf = NULL;
+    size_t bufSize = 0;
+    for( uint16_t nRow = 0; nRow < bodyH; ++nRow ) {
+        const struct JournalViewRow * want = view->layout + nRow;
+        struct JournalViewRow * have = view->rows + nRow;
+        if( want->message && !want->nLine && nRow
+         && view->layout[nRow - 1].message ) ++nEntry;
+        if( _jview_rows_eq(have, want) ) continue;  /* row is up to date */
+        *have = *want;
+        ncrm_rb_clear_row(body, nRow);
+        if( !want->message ) continue;  /* blank row */
+        if( !je || je->message != want->message ) {
+            je = view->queryResults.entries + nEntry;
+            assert( je->message == want->message );
+            /* format message to fit message's column width.
+             * Formatted message is of the form:
+             *  line1<0x00>line2<0x00>...lineN<0x00><0x04>
+             * I.e. single lines are terminated with null character, the last
+             * line is terminated with 0x04 (EOT).
+             * */
+            size_t bufNeed = strlen(je->message) + view->nResultLines[nEntry] + 1;
+            if( bufNeed > bufSize ) {
+                bufSize = bufNeed;
+                buf = realloc(buf, bufSize);
+            }
+            _split_message( je->message, msgW, buf );
+        }
+        const char * c = buf;
+        for( uint16_t i = 0; i < want->nLine; ++i ) c += strlen(c) + 1;
+        _jview_render_line(view, body, nRow, nEntry, c, want->nLine);
     }
     free(buf);
-    _jmsgwin_refresh(view);
-    //pnoutrefresh( view->w_jBody
-    //            , NCRM_JOURNAL_MAX_LINES_SHOWN - view->dims[1][0] + 1
-    //            , 0
-    //            /* ^^^ upper left corner of the rectangle to be shown in the pad */
-    //            /* these are screen coordinates: */
-    //            , view->dims[0][0] + 1, view->dims[0][1]
-    //            , view->dims[1][0] + 1, view->dims[1][1]
-    //            );
+    /* Scrollbar at the last column, shown if lines do not fit in the body.
+     * 'x' is the ACS_VLINE */
+    if( nLinesTotal > bodyH ) {
+        const uint16_t thumbBgn = view->topLine*bodyH/nLinesTotal;
+        uint16_t thumbLen = ((unsigned long) bodyH)*bodyH/nLinesTotal;
+        if( !thumbLen ) thumbLen = 1;
+        for( uint16_t i = 0; i < bodyH; ++i ) {
+            ncrm_rb_put_acs( body, i, view->dims[1][1] - 1
+                    , (i >= thumbBgn && i < thumbBgn + thumbLen) ? A_REVERSE : A_DIM
+                    , 'x' );
+        }
+    } else {
+        for( uint16_t i = 0; i < bodyH; ++i )
+            ncrm_rb_fill( body, i, view->dims[1][1] - 1, A_NORMAL, ' ', 1 );
+    }
+}
+
+/* Sets dimensions of views, splitting extension's height between them
+ * according to their shares */
+static void
+_jviews_arrange( struct ncrm_JournalExtensionConfig * cfg ) {
+    unsigned int sharesTotal = 0;
+    for( uint16_t i = 0; i < gLocalData.nViews; ++i ) {
+        sharesTotal += (i < cfg->nViews && cfg->views[i].heightShare)
+                     ? cfg->views[i].heightShare : 1;
+    }
+    uint16_t top = cfg->dims[0][0];
+    for( uint16_t i = 0; i < gLocalData.nViews; ++i ) {
+        struct JournalEntriesView * jev = gLocalData.views[i];
+        const unsigned int share = (i < cfg->nViews && cfg->views[i].heightShare)
+                                 ? cfg->views[i].heightShare : 1;
+        uint16_t h = (i + 1 == gLocalData.nViews)  /* last takes the rest */
+                   ? cfg->dims[0][0] + cfg->dims[1][0] - top
+                   : ((unsigned int) cfg->dims[1][0])*share/sharesTotal;
+        if( h < 2 ) h = 2;  /* header and at least one line of body */
+        jev->dims[0][0] = top;               /* top */
+        jev->dims[0][1] = cfg->dims[0][1];   /* left */
+        jev->dims[1][0] = h;                 /* height */
+        jev->dims[1][1] = cfg->dims[1][1];   /* width */
+        top += h;
+    }
+}
+
+/* Evaluates views' queries on entries received by listener (delta of
+ * update event) */
+static void
+_jviews_query_new_entries( const struct JournalDelta * delta ) {
+    gLocalData.nEntriesProcessed += delta->n;
+    memcpy( gLocalData.sourceLags, delta->sourceLags
+          , sizeof(gLocalData.sourceLags) );
+    /* Update views selection according to their queries using new data, in
+     * a single pass for all the views */
+    const struct ncrm_QueryParams * queries[NCRM_JOURNAL_MAX_VIEWS];
+    struct ncrm_JournalSelection * selections[NCRM_JOURNAL_MAX_VIEWS];
+    unsigned long nPrevResults[NCRM_JOURNAL_MAX_VIEWS]
+                , nCommon[NCRM_JOURNAL_MAX_VIEWS]
+                ;
+    for( uint16_t i = 0; i < gLocalData.nViews; ++i ) {
+        queries[i] = &gLocalData.views[i]->query;
+        selections[i] = &gLocalData.views[i]->queryResults;
+        nPrevResults[i] = selections[i]->n;
+    }
+    ncrm_je_select( delta->entries, delta->n
+                  , queries, selections, nCommon, gLocalData.nViews );
+    for( uint16_t i = 0; i < gLocalData.nViews; ++i )
+        _jview_reindex(gLocalData.views[i], nCommon[i], nPrevResults[i]);
+}
+
+static int
+_journal_entries_ext_prepare( struct ncrm_Extension * ext
+                            , const struct ncrm_Event * events
+                            , unsigned int nEvents
+                            , int nBuffer ) {
+    struct ncrm_JournalExtensionConfig * cfg
+        = (struct ncrm_JournalExtensionConfig *) ext->userData;
+    assert( gLocalData.nViews );
+    /* If dimensions of a view are not set, split all available space for the
+     * extension between views */
+    for( uint16_t i = 0; i < gLocalData.nViews; ++i ) {
+        if( 0 == gLocalData.views[i]->dims[1][0]
+         || 0 == gLocalData.views[i]->dims[1][1] ) {
+            _jviews_arrange(cfg);
+            break;
+        }
+    }
+    uint16_t toRender[NCRM_JOURNAL_MAX_VIEWS];
+    for( uint16_t i = 0; i < gLocalData.nViews; ++i ) {
+        struct JournalEntriesView * jev = gLocalData.views[i];
+        assert(jev->dims[1][0]);
+        assert(jev->dims[1][1]);
+        if( !jev->rows ) {
+            jev->rows   = malloc(_jview_body_height(jev)*sizeof(struct JournalViewRow));
+            jev->layout = malloc(_jview_body_height(jev)*sizeof(struct JournalViewRow));
+            jev->damagedAll = 0x1;
+        }
+        toRender[i] = 0;
+    }
+
+    int newEntries = 0;
+    for( const struct ncrm_Event * event = events
+       ; event != events + nEvents
+       ; ++event ) {
+        if( ncrm_kEventKeypress != event->type ) {
+            struct ncrm_Payload * payload = ncrm_event_payload(event);
+            if( payload ) _jviews_query_new_entries(ncrm_payload_data(payload));
+            newEntries = 1;
+            continue;
+        }
+        /* Navigation keys only change shown range, so view is redrawn
+         * without re-querying */
+        if( 'w' == event->payload.keycode ) {
+            /* switch focus to the next view */
+            if( gLocalData.nViews < 2 ) continue;
+            toRender[gLocalData.nFocusedView] = 1;
+            gLocalData.views[gLocalData.nFocusedView]->focused = 0x0;
+            gLocalData.nFocusedView = (gLocalData.nFocusedView + 1)%gLocalData.nViews;
+            gLocalData.views[gLocalData.nFocusedView]->focused = 0x1;
+            toRender[gLocalData.nFocusedView] = 1;
+            continue;
+        }
+        if( _jview_handle_key( gLocalData.views[gLocalData.nFocusedView]
+                             , event->payload.keycode ) )
+            toRender[gLocalData.nFocusedView] = 1;
+    }
+    if( newEntries ) {
+        for( uint16_t i = 0; i < gLocalData.nViews; ++i ) toRender[i] = 1;
+    }
+
+    int rendered = 0;
+    for( uint16_t i = 0; i < gLocalData.nViews; ++i ) {
+        struct JournalEntriesView * jev = gLocalData.views[i];
+        ncrm_rb_reset(jev->hdrBuffers + nBuffer, 1);
+        ncrm_rb_reset(jev->bodyBuffers + nBuffer, _jview_body_height(jev));
+        if( !toRender[i] ) continue;
+        _jview_render( cfg->modelPtr, jev
+                     , jev->hdrBuffers + nBuffer
+                     , jev->bodyBuffers + nBuffer );
+        rendered = 1;
+    }
+    return rendered;
+}
+
+static void
+_journal_entries_ext_present( struct ncrm_Extension * ext, int nBuffer ) {
+    for( uint16_t i = 0; i < gLocalData.nViews; ++i ) {
+        struct JournalEntriesView * jev = gLocalData.views[i];
+        /* If windows/panels/pads do not exist, create */
+        if( !jev->w_jHeader ) {
+            jev->w_jHeader = newwin( 1   /* # of lines in win */
+                                   , jev->dims[1][1]  /* # of columns in win */
+                                   , jev->dims[0][0]  /* Y of LT corner */
+                                   , jev->dims[0][1]  /* X of LT corner */
+                                   );
+            jev->w_jBody = newpad( _jview_body_height(jev)  /* # of lines in pad */
+                                 , jev->dims[1][1]      /* # of columns in pad */
+                                 );
+            /* Create panels for header and footer */
+            jev->p_jHeader = new_panel(jev->w_jHeader);
+            jev->p_jBody   = new_panel(jev->w_jBody);
+        }
+        ncrm_rb_draw(jev->hdrBuffers + nBuffer, jev->w_jHeader);
+        ncrm_rb_draw(jev->bodyBuffers + nBuffer, jev->w_jBody);
+        _jmsgwin_refresh(jev);
+    }
+}
+
+static void
+_journal_entries_ext_show( struct ncrm_Extension * ext, int shown ) {
+    for( uint16_t i = 0; i < gLocalData.nViews; ++i ) {
+        struct JournalEntriesView * jev = gLocalData.views[i];
+        if( !jev->p_jHeader ) continue;  /* not presented yet */
+        if( shown ) {
+            show_panel(jev->p_jHeader);
+            show_panel(jev->p_jBody);
+        } else {
+            hide_panel(jev->p_jHeader);
+            hide_panel(jev->p_jBody);
+        }
+    }
 }
 
 static int
 _journal_entries_ext_shutdown(struct ncrm_Extension * ext) {
-    char errBf[128];
-    gLocalData.keepGoingFlag = 0x0;
-    void * listenerTheadReturn = NULL;
-    pthread_join(gLocalData.listenerThread, &listenerTheadReturn);
-    if( listenerTheadReturn ) {
-        struct ListenerThreadExitResults * lteR
-            = (struct ListenerThreadExitResults *) listenerTheadReturn;
-        if( lteR->rc ) {
-            snprintf( errBf, sizeof(errBf)
-                    , "Listener thread of"
-                    " \"" NCRM_JOURNAL_EXTENSION_NAME "\" exit with code %d"
-                    ": \"%s\"\n", lteR->rc, lteR->errorDetails );
-            ncrm_mdl_error( ((struct ncrm_JournalExtensionConfig *) (ext->userData))->modelPtr
-                          , errBf
-                          );
-            free(lteR->errorDetails);
-        }
-        int rc = lteR->rc;
-        free(lteR);
-        return rc;
-    } else {
-        snprintf( errBf, sizeof(errBf)
-                , "Listener thread of"
-                  " \"" NCRM_JOURNAL_EXTENSION_NAME "\" exit with NULL"
-                  " result.\n" );
-        ncrm_mdl_error( ((struct ncrm_JournalExtensionConfig *) (ext->userData))->modelPtr
-                      , errBf
-                      );
-        return -1;
+    if( gLocalData.listening ) {
+        _pipeline_stop();
+        /* queue is not drained anymore */
+        ncrm_producer_cancel(&gLocalData.producer);
+        pthread_join(gLocalData.receiverThread, NULL);
+        for( unsigned int i = 0; i < gLocalData.nWorkers; ++i )
+            pthread_join(gLocalData.workers[i].thread, NULL);
+        pthread_join(gLocalData.appenderThread, NULL);
+    }
+    gLocalData.listening = 0x0;
+    for( unsigned int i = 0; i < gLocalData.nWorkers; ++i ) {
+        struct DecodeWorker * w = gLocalData.workers + i;
+        void * item;
+        /* free messages left in stopped pipeline */
+        while( !ncrm_spsc_try_pop(&w->inbox, &item) )
+            _raw_message_free((struct RawMessage *) item);
+        while( !ncrm_spsc_try_pop(&w->outbox, &item) )
+            _decoded_message_free((struct DecodedMessage *) item);
+        ncrm_spsc_free(&w->inbox);
+        ncrm_spsc_free(&w->outbox);
+        /* render thread is stopped, entries are not referred anymore */
+        _arena_free(&w->strings);
+    }
+    _arena_free(&gLocalData.strings);
+    free(gLocalData.workers);
+    gLocalData.workers = NULL;
+    gLocalData.nWorkers = 0;
+    for( uint16_t i = 0; i < gLocalData.nSources; ++i ) {
+        struct JournalSource * src = gLocalData.sources + i;
+        zmq_close(gLocalData.subscribers[i]);
+        if( gLocalData.snapshotRequesters[i] )
+            zmq_close(gLocalData.snapshotRequesters[i]);
+        gLocalData.snapshotRequesters[i] = NULL;
+        while( src->heldFirst ) {
+            struct DecodedMessage * next = src->heldFirst->next;
+            _decoded_message_free(src->heldFirst);
+            src->heldFirst = next;
+        }
+    }
+    gLocalData.nSources = 0;
+    {
+        void * item;
+        while( !ncrm_spsc_try_pop(&gLocalData.resendRequests, &item) )
+            free(item);
+        ncrm_spsc_free(&gLocalData.resendRequests);
     }
+    ncrm_je_selection_free(&gLocalData.incoming);
+    ncrm_je_selection_free(&gLocalData.pending);
+    ncrm_je_selection_free(&gLocalData.merged);
+    if( gLocalData.zmqContext ) zmq_ctx_destroy(gLocalData.zmqContext);
+    close(gLocalData.receiverWakeFd);
+    gLocalData.receiverWakeFd = -1;
+    ncrm_payload_unref(gLocalData.delta);
+    gLocalData.delta = NULL;
+    return atomic_load(&gLocalData.listenerRC);
 }
 
 struct ncrm_Extension gJournalExtension = {
     NCRM_JOURNAL_EXTENSION_NAME, 'l', NULL,
     _journal_entries_ext_init,
-    _journal_entries_ext_update,
+    NULL,  /* content is prepared on render thread */
+    _journal_entries_ext_prepare,
+    _journal_entries_ext_present,
+    _journal_entries_ext_show,
     _journal_entries_ext_shutdown
 };
 
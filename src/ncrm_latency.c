@@ -0,0 +1,94 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "ncrm_latency.h"
+
+#include <string.h>
+
+/* Returns bucket number for value: values below NCRM_LATENCY_SUB_BUCKETS
+ * have own buckets, others are grouped by the power of two and few most
+ * significant bits after the leading one */
+static unsigned int
+_bucket( unsigned long v ) {
+    if( v < NCRM_LATENCY_SUB_BUCKETS ) return v;
+    unsigned int e = 8*sizeof(unsigned long) - 1 - __builtin_clzl(v);
+    unsigned int nBucket
+        = (e - NCRM_LATENCY_SUB_BUCKETS_LOG2 + 1)*NCRM_LATENCY_SUB_BUCKETS
+        + ((v >> (e - NCRM_LATENCY_SUB_BUCKETS_LOG2)) & (NCRM_LATENCY_SUB_BUCKETS - 1));
+    return nBucket < NCRM_LATENCY_N_BUCKETS
+         ? nBucket : NCRM_LATENCY_N_BUCKETS - 1;
+}
+
+/* Returns max value falling into bucket */
+static unsigned long
+_bucket_upper( unsigned int nBucket ) {
+    if( nBucket < NCRM_LATENCY_SUB_BUCKETS ) return nBucket;
+    unsigned int e = nBucket/NCRM_LATENCY_SUB_BUCKETS
+                   + NCRM_LATENCY_SUB_BUCKETS_LOG2 - 1
+               , sub = nBucket%NCRM_LATENCY_SUB_BUCKETS
+               ;
+    unsigned long step = 1UL << (e - NCRM_LATENCY_SUB_BUCKETS_LOG2);
+    return ((NCRM_LATENCY_SUB_BUCKETS + sub) + 1)*step - 1;
+}
+
+void
+ncrm_lh_reset( struct ncrm_LatencyHistogram * h ) {
+    memset(h, 0, sizeof(*h));
+}
+
+void
+ncrm_lh_add( struct ncrm_LatencyHistogram * h, unsigned long usec ) {
+    ++h->counts[_bucket(usec)];
+    ++h->n;
+    if( usec > h->maxUSec ) h->maxUSec = usec;
+}
+
+void
+ncrm_lh_add_interval( struct ncrm_LatencyHistogram * h
+                    , const struct timespec * from
+                    , const struct timespec * to ) {
+    long usec = (to->tv_sec - from->tv_sec)*1000000L
+              + (to->tv_nsec - from->tv_nsec)/1000L;
+    ncrm_lh_add(h, usec > 0 ? usec : 0);
+}
+
+void
+ncrm_lh_merge( struct ncrm_LatencyHistogram * h
+             , const struct ncrm_LatencyHistogram * other ) {
+    for( unsigned int i = 0; i < NCRM_LATENCY_N_BUCKETS; ++i )
+        h->counts[i] += other->counts[i];
+    h->n += other->n;
+    if( other->maxUSec > h->maxUSec ) h->maxUSec = other->maxUSec;
+}
+
+unsigned long
+ncrm_lh_quantile( const struct ncrm_LatencyHistogram * h, double q ) {
+    if( !h->n ) return 0;
+    /* rank of the value, 1-based */
+    unsigned long rank = q*h->n + .5;
+    if( rank < 1 ) rank = 1;
+    if( rank > h->n ) rank = h->n;
+    unsigned long sum = 0;
+    for( unsigned int i = 0; i < NCRM_LATENCY_N_BUCKETS; ++i ) {
+        sum += h->counts[i];
+        if( sum < rank ) continue;
+        if( NCRM_LATENCY_N_BUCKETS - 1 == i ) break;  /* open bucket */
+        unsigned long upper = _bucket_upper(i);
+        return upper < h->maxUSec ? upper : h->maxUSec;
+    }
+    return h->maxUSec;
+}
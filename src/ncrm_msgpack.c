@@ -0,0 +1,305 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "ncrm_msgpack.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Reads big-endian integer of `n` bytes */
+static uint64_t
+_read_be( const uint8_t * p, int n ) {
+    uint64_t v = 0;
+    for( int i = 0; i < n; ++i ) v = (v << 8) | p[i];
+    return v;
+}
+
+/* Reads length of `n` bytes following `nHeader` bytes of header. Returns
+ * non-zero if buffer is too short */
+static int
+_read_len( const struct ncrm_MsgpackCursor * c, int nHeader, int n
+         , uint32_t * len ) {
+    if( c->end - c->cur < nHeader + n ) return 1;
+    *len = _read_be(c->cur + nHeader, n);
+    return 0;
+}
+
+void
+ncrm_mp_cursor_init( struct ncrm_MsgpackCursor * c
+                   , const void * data, size_t size ) {
+    c->cur = (const uint8_t *) data;
+    c->end = c->cur + size;
+}
+
+/* Reads container header: fix-format mask/value and codes of 16 and 32-bit
+ * formats */
+static int
+_read_container( struct ncrm_MsgpackCursor * c, uint32_t * n
+               , uint8_t fixMask, uint8_t fixCode
+               , uint8_t code16, uint8_t code32 ) {
+    if( ncrm_mp_at_end(c) ) return 1;
+    const uint8_t t = *c->cur;
+    if( (t & fixMask) == fixCode ) {
+        *n = t & ~fixMask;
+        ++c->cur;
+        return 0;
+    }
+    int nLen = t == code16 ? 2 : (t == code32 ? 4 : 0);
+    if( !nLen || _read_len(c, 1, nLen, n) ) return 1;
+    c->cur += 1 + nLen;
+    return 0;
+}
+
+int
+ncrm_mp_read_map( struct ncrm_MsgpackCursor * c, uint32_t * n ) {
+    return _read_container(c, n, 0xf0, 0x80, 0xde, 0xdf);
+}
+
+int
+ncrm_mp_read_array( struct ncrm_MsgpackCursor * c, uint32_t * n ) {
+    return _read_container(c, n, 0xf0, 0x90, 0xdc, 0xdd);
+}
+
+int
+ncrm_mp_read_str( struct ncrm_MsgpackCursor * c
+                , const char ** ptr, uint32_t * len ) {
+    if( ncrm_mp_at_end(c) ) return 1;
+    const uint8_t t = *c->cur;
+    int nHeader;
+    if( (t & 0xe0) == 0xa0 ) {
+        *len = t & 0x1f;
+        nHeader = 1;
+    } else {
+        int nLen = t == 0xd9 ? 1 : (t == 0xda ? 2 : (t == 0xdb ? 4 : 0));
+        if( !nLen || _read_len(c, 1, nLen, len) ) return 1;
+        nHeader = 1 + nLen;
+    }
+    if( (size_t) (c->end - c->cur) < nHeader + (size_t) *len ) return 1;
+    *ptr = (const char *) c->cur + nHeader;
+    c->cur += nHeader + *len;
+    return 0;
+}
+
+/* Reads integer of any format; `isNegative` is set for negative values */
+static int
+_read_integer( struct ncrm_MsgpackCursor * c, uint64_t * v, int * isNegative ) {
+    if( ncrm_mp_at_end(c) ) return 1;
+    const uint8_t t = *c->cur;
+    *isNegative = 0;
+    if( t < 0x80 ) {  /* positive fixint */
+        *v = t;
+        ++c->cur;
+        return 0;
+    }
+    if( t >= 0xe0 ) {  /* negative fixint */
+        *v = (uint64_t) (int64_t) (int8_t) t;
+        *isNegative = 1;
+        ++c->cur;
+        return 0;
+    }
+    if( t < 0xcc || t > 0xd3 ) return 1;
+    const int n = 1 << ((t - 0xcc) & 0x3);
+    if( c->end - c->cur < 1 + n ) return 1;
+    *v = _read_be(c->cur + 1, n);
+    if( t >= 0xd0 ) {  /* intX, sign-extend */
+        const int nBits = 8*n;
+        if( nBits < 64 && (*v >> (nBits - 1)) ) *v |= ~(uint64_t) 0 << nBits;
+        *isNegative = (int64_t) *v < 0;
+    }
+    c->cur += 1 + n;
+    return 0;
+}
+
+int
+ncrm_mp_read_uint( struct ncrm_MsgpackCursor * c, uint64_t * v ) {
+    struct ncrm_MsgpackCursor tmp = *c;
+    int isNegative;
+    if( _read_integer(&tmp, v, &isNegative) || isNegative ) return 1;
+    *c = tmp;
+    return 0;
+}
+
+int
+ncrm_mp_read_int( struct ncrm_MsgpackCursor * c, int64_t * v ) {
+    struct ncrm_MsgpackCursor tmp = *c;
+    uint64_t u;
+    int isNegative;
+    if( _read_integer(&tmp, &u, &isNegative) ) return 1;
+    if( !isNegative && u > INT64_MAX ) return 1;
+    *v = (int64_t) u;
+    *c = tmp;
+    return 0;
+}
+
+/* Returns size of value's header plus data (not including nested values),
+ * and number of nested values; -1 on malformed data */
+static long
+_value_size( const struct ncrm_MsgpackCursor * c, uint64_t * nNested ) {
+    const uint8_t t = *c->cur;
+    uint32_t len;
+    *nNested = 0;
+    if( t < 0x80 || t >= 0xe0 || t == 0xc0 || t == 0xc2 || t == 0xc3 )
+        return 1;
+    if( t < 0x90 ) { *nNested = 2*(t & 0x0f); return 1; }  /* fixmap */
+    if( t < 0xa0 ) { *nNested = t & 0x0f; return 1; }  /* fixarray */
+    if( t < 0xc0 ) return 1 + (t & 0x1f);  /* fixstr */
+    switch(t) {
+        case 0xc4: case 0xd9:  /* bin8, str8 */
+            return _read_len(c, 1, 1, &len) ? -1 : 2 + (long) len;
+        case 0xc5: case 0xda:  /* bin16, str16 */
+            return _read_len(c, 1, 2, &len) ? -1 : 3 + (long) len;
+        case 0xc6: case 0xdb:  /* bin32, str32 */
+            return _read_len(c, 1, 4, &len) ? -1 : 5 + (long) len;
+        case 0xc7:  /* ext8 */
+            return _read_len(c, 1, 1, &len) ? -1 : 3 + (long) len;
+        case 0xc8:  /* ext16 */
+            return _read_len(c, 1, 2, &len) ? -1 : 4 + (long) len;
+        case 0xc9:  /* ext32 */
+            return _read_len(c, 1, 4, &len) ? -1 : 6 + (long) len;
+        case 0xca: return 5;  /* float32 */
+        case 0xcb: return 9;  /* float64 */
+        case 0xcc: case 0xd0: return 2;
+        case 0xcd: case 0xd1: return 3;
+        case 0xce: case 0xd2: return 5;
+        case 0xcf: case 0xd3: return 9;
+        case 0xd4: return 3;  /* fixext1 */
+        case 0xd5: return 4;
+        case 0xd6: return 6;
+        case 0xd7: return 10;
+        case 0xd8: return 18;  /* fixext16 */
+        case 0xdc: case 0xde:  /* array16, map16 */
+            if( _read_len(c, 1, 2, &len) ) return -1;
+            *nNested = t == 0xde ? 2*(uint64_t) len : len;
+            return 3;
+        case 0xdd: case 0xdf:  /* array32, map32 */
+            if( _read_len(c, 1, 4, &len) ) return -1;
+            *nNested = t == 0xdf ? 2*(uint64_t) len : len;
+            return 5;
+    }
+    return -1;  /* 0xc1 is never used */
+}
+
+int
+ncrm_mp_skip( struct ncrm_MsgpackCursor * c ) {
+    /* number of values left to skip at every nesting level */
+    uint64_t nLeft[NCRM_MP_MAX_SKIP_DEPTH];
+    int depth = 0;
+    const uint8_t * cur = c->cur;
+    nLeft[0] = 1;
+    while( depth >= 0 ) {
+        if( !nLeft[depth] ) { --depth; continue; }
+        --nLeft[depth];
+        if( cur >= c->end ) return 1;
+        struct ncrm_MsgpackCursor at = { cur, c->end };
+        uint64_t nNested;
+        long size = _value_size(&at, &nNested);
+        if( size < 0 || c->end - cur < size ) return 1;
+        cur += size;
+        if( !nNested ) continue;
+        if( depth + 1 == NCRM_MP_MAX_SKIP_DEPTH ) return 1;
+        nLeft[++depth] = nNested;
+    }
+    c->cur = cur;
+    return 0;
+}
+
+/*
+ * Writer
+ */
+
+void
+ncrm_mp_buffer_init( struct ncrm_MsgpackBuffer * b ) {
+    b->data = NULL;
+    b->size = b->nAllocated = 0;
+}
+
+void
+ncrm_mp_buffer_free( struct ncrm_MsgpackBuffer * b ) {
+    free(b->data);
+    ncrm_mp_buffer_init(b);
+}
+
+/* Reserves `n` bytes at the end of buffer, returns pointer to them */
+static uint8_t *
+_reserve( struct ncrm_MsgpackBuffer * b, size_t n ) {
+    if( b->size + n > b->nAllocated ) {
+        if( !b->nAllocated ) b->nAllocated = 256;
+        while( b->size + n > b->nAllocated ) b->nAllocated *= 2;
+        b->data = realloc(b->data, b->nAllocated);
+        assert(b->data);
+    }
+    uint8_t * p = b->data + b->size;
+    b->size += n;
+    return p;
+}
+
+/* Writes type code followed by big-endian integer of `n` bytes */
+static void
+_write_be( struct ncrm_MsgpackBuffer * b, uint8_t code, uint64_t v, int n ) {
+    uint8_t * p = _reserve(b, 1 + n);
+    *(p++) = code;
+    for( int i = n - 1; i >= 0; --i ) *(p++) = (uint8_t) (v >> (8*i));
+}
+
+/* Writes container header of fix-format (if `n` fits) or 16/32-bit one */
+static void
+_write_container( struct ncrm_MsgpackBuffer * b, uint32_t n
+                , uint8_t fixCode, uint8_t code16, uint8_t code32 ) {
+    if( n < 16 ) *_reserve(b, 1) = fixCode | n;
+    else if( n <= UINT16_MAX ) _write_be(b, code16, n, 2);
+    else _write_be(b, code32, n, 4);
+}
+
+void
+ncrm_mp_write_map( struct ncrm_MsgpackBuffer * b, uint32_t n ) {
+    _write_container(b, n, 0x80, 0xde, 0xdf);
+}
+
+void
+ncrm_mp_write_array( struct ncrm_MsgpackBuffer * b, uint32_t n ) {
+    _write_container(b, n, 0x90, 0xdc, 0xdd);
+}
+
+void
+ncrm_mp_write_str( struct ncrm_MsgpackBuffer * b
+                 , const char * s, uint32_t len ) {
+    if( len < 32 ) *_reserve(b, 1) = 0xa0 | len;
+    else if( len <= UINT8_MAX ) _write_be(b, 0xd9, len, 1);
+    else if( len <= UINT16_MAX ) _write_be(b, 0xda, len, 2);
+    else _write_be(b, 0xdb, len, 4);
+    memcpy(_reserve(b, len), s, len);
+}
+
+void
+ncrm_mp_write_uint( struct ncrm_MsgpackBuffer * b, uint64_t v ) {
+    if( v < 0x80 ) *_reserve(b, 1) = (uint8_t) v;
+    else if( v <= UINT8_MAX ) _write_be(b, 0xcc, v, 1);
+    else if( v <= UINT16_MAX ) _write_be(b, 0xcd, v, 2);
+    else if( v <= UINT32_MAX ) _write_be(b, 0xce, v, 4);
+    else _write_be(b, 0xcf, v, 8);
+}
+
+void
+ncrm_mp_write_int( struct ncrm_MsgpackBuffer * b, int64_t v ) {
+    if( v >= 0 ) { ncrm_mp_write_uint(b, v); return; }
+    if( v >= -32 ) *_reserve(b, 1) = (uint8_t) (int8_t) v;
+    else if( v >= INT8_MIN ) _write_be(b, 0xd0, (uint64_t) v, 1);
+    else if( v >= INT16_MIN ) _write_be(b, 0xd1, (uint64_t) v, 2);
+    else if( v >= INT32_MIN ) _write_be(b, 0xd2, (uint64_t) v, 4);
+    else _write_be(b, 0xd3, (uint64_t) v, 8);
+}
@@ -0,0 +1,58 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "ncrm_payload.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+struct ncrm_Payload *
+ncrm_payload_new( size_t size, void (*dtor)(void *) ) {
+    struct ncrm_Payload * p = malloc(sizeof(struct ncrm_Payload) + size);
+    assert(p);
+    atomic_init(&p->nRefs, 1);
+    p->dtor = dtor;
+    p->size = size;
+    return p;
+}
+
+struct ncrm_Payload *
+ncrm_payload_resize( struct ncrm_Payload * p, size_t size ) {
+    assert( 1 == atomic_load(&p->nRefs) );
+    p = realloc(p, sizeof(struct ncrm_Payload) + size);
+    assert(p);
+    p->size = size;
+    return p;
+}
+
+struct ncrm_Payload *
+ncrm_payload_ref( struct ncrm_Payload * p ) {
+    if( p ) atomic_fetch_add_explicit(&p->nRefs, 1, memory_order_relaxed);
+    return p;
+}
+
+void
+ncrm_payload_unref( struct ncrm_Payload * p ) {
+    if( !p ) return;
+    /* release pairs with acquire of the last owner, so all the accesses to
+     * data happen before it is freed (acquire is on the decrement itself
+     * rather than in a separate fence, which thread sanitizer can't see) */
+    if( 1 != atomic_fetch_sub_explicit(&p->nRefs, 1, memory_order_acq_rel) )
+        return;
+    if( p->dtor ) p->dtor(p->data);
+    free(p);
+}
@@ -0,0 +1,107 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ncrm_prefixSums.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* lowest set bit of the node index */
+#define _lsb(i) ((i) & (~(i) + 1))
+
+static void
+_reserve( struct ncrm_PrefixSums * ps, unsigned long n ) {
+    if( n + 1 <= ps->nAllocated ) return;
+    unsigned long nAllocated = ps->nAllocated;
+    while( nAllocated < n + 1 ) nAllocated += NCRM_PREFIX_SUMS_INC;
+    ps->tree = realloc(ps->tree, nAllocated*sizeof(uint32_t));
+    assert(ps->tree);
+    ps->nAllocated = nAllocated;
+}
+
+void
+ncrm_ps_init( struct ncrm_PrefixSums * ps ) {
+    ps->tree = NULL;
+    ps->n = ps->nAllocated = 0;
+}
+
+void
+ncrm_ps_free( struct ncrm_PrefixSums * ps ) {
+    free(ps->tree);
+    ncrm_ps_init(ps);
+}
+
+void
+ncrm_ps_build( struct ncrm_PrefixSums * ps
+             , const uint16_t * values
+             , unsigned long n ) {
+    _reserve(ps, n);
+    ps->n = n;
+    ps->tree[0] = 0;
+    for( unsigned long i = 1; i <= n; ++i )
+        ps->tree[i] = values[i-1];
+    /* propagate every node to its parent once */
+    for( unsigned long i = 1; i <= n; ++i ) {
+        unsigned long j = i + _lsb(i);
+        if( j <= n ) ps->tree[j] += ps->tree[i];
+    }
+}
+
+void
+ncrm_ps_push( struct ncrm_PrefixSums * ps, uint32_t value ) {
+    _reserve(ps, ps->n + 1);
+    unsigned long i = ++ps->n;
+    /* new node covers range (i - lsb(i), i], so it must include sums of the
+     * preceding items within this range */
+    ps->tree[i] = value + ncrm_ps_sum(ps, i - 1) - ncrm_ps_sum(ps, i - _lsb(i));
+}
+
+void
+ncrm_ps_add( struct ncrm_PrefixSums * ps, unsigned long nItem, int32_t delta ) {
+    assert(nItem < ps->n);
+    for( unsigned long i = nItem + 1; i <= ps->n; i += _lsb(i) )
+        ps->tree[i] += delta;
+}
+
+unsigned long
+ncrm_ps_sum( const struct ncrm_PrefixSums * ps, unsigned long n ) {
+    assert(n <= ps->n);
+    unsigned long s = 0;
+    for( unsigned long i = n; i; i -= _lsb(i) )
+        s += ps->tree[i];
+    return s;
+}
+
+unsigned long
+ncrm_ps_total( const struct ncrm_PrefixSums * ps ) {
+    return ncrm_ps_sum(ps, ps->n);
+}
+
+unsigned long
+ncrm_ps_find( const struct ncrm_PrefixSums * ps, unsigned long pos ) {
+    /* binary lifting: descend from the highest power of two keeping the
+     * accumulated sum not exceeding `pos` */
+    unsigned long step = 1, i = 0;
+    while( (step << 1) <= ps->n ) step <<= 1;
+    for( ; step; step >>= 1 ) {
+        if( i + step <= ps->n && ps->tree[i + step] <= pos ) {
+            i += step;
+            pos -= ps->tree[i];
+        }
+    }
+    return i;  /* 0-based index of the item containing position */
+}
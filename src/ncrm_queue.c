@@ -14,168 +14,627 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE  /* for ppoll() */
+
 #include "ncrm_queue.h"
 
-#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
-static struct EventListEntry {
-    int isInUse:1;
+#if (NCRM_MAX_INPUT_EVENTS & (NCRM_MAX_INPUT_EVENTS - 1)) \
+ || (NCRM_MAX_CONTROL_EVENTS & (NCRM_MAX_CONTROL_EVENTS - 1)) \
+ || (NCRM_MAX_DATA_EVENTS & (NCRM_MAX_DATA_EVENTS - 1))
+#   error "Queue capacity of every event class must be a power of two."
+#endif
+
+/* Events queue consists of a bounded lock-free multi-producer/single-consumer
+ * ring per event class (after D. Vyukov's bounded queue). Every slot has a
+ * sequence number telling whether it is free for producer with certain
+ * position (seq == pos) or contains event for consumer (seq == pos + 1).
+ * Producers claim positions with CAS, so enqueueing takes constant time and
+ * never blocks; consumer is the main thread only.
+ *
+ * Producers that wait for free slot ("block" policy) sleep on condition
+ * variable. Consumer signals it after draining, only if it sees waiting
+ * producers: producer counts itself before it checks the ring for the last
+ * time, and consumer checks the count after it releases slots (same
+ * handshake as for `consumerSleeping`), so the signal is never missed.
+ *
+ * When ring is full, producer's overflow policy is applied. Policies that
+ * modify pending events (drop oldest, coalesce) lock the slot with `busy`
+ * flag for a moment; consumer takes the same flag while copying event out
+ * of the slot. */
+
+/** (internal) queue slot */
+struct QueueSlot {
+    atomic_ulong seq;
+    /** Set while event in the slot is being copied or modified */
+    atomic_int busy;
     struct ncrm_Event eventObject;
-    struct EventListEntry * next;
-} gEventListEntriesPool[NCRM_MAX_EVENTS_IN_QUEUE];
-static pthread_mutex_t gEventPoolMutex;
+};
 
-static struct ncrm_Queue {
-    pthread_mutex_t mtxQueueEmpty;
-    pthread_cond_t cvQueueEmpty;
+/** (internal) ring of certain event class */
+struct QueueRing {
+    struct QueueSlot * slots;
+    /** Capacity minus one, to get slot index from position */
+    unsigned long mask;
+    /** Next position to be claimed by producers */
+    _Alignas(64) atomic_ulong enqueuePos;
+    /** Max number of pending events observed */
+    atomic_ulong highWater;
+    /** Next position to be consumed (modified by consumer only) */
+    _Alignas(64) atomic_ulong dequeuePos;
+};
+
+/** (internal) coalescing target -- an idempotent event type with extension
+ * ID (if any) that may have at most one event pending in the queue */
+struct CoalescingTarget {
+    /** 0 -- free, 1 -- being registered, 2 -- ready */
+    atomic_int state;
+    enum ncrm_EventType type;
+    uint16_t extensionID;
+    /** Number of events coalesced into pending one, zero if none is
+     * pending */
+    atomic_uint nPending;
+};
+
+static struct QueueSlot gInputSlots[NCRM_MAX_INPUT_EVENTS]
+                      , gControlSlots[NCRM_MAX_CONTROL_EVENTS]
+                      , gDataSlots[NCRM_MAX_DATA_EVENTS]
+                      ;
 
-    struct EventListEntry * head, *tail;
+static struct ncrm_Queue {
+    /** Rings by event class, in order of priority */
+    struct QueueRing rings[NCRM_N_EVENT_CLASSES];
+    /** Set by consumer before it goes to sleep; producers write to
+     * `wakeFd` only if it is set */
+    atomic_int consumerSleeping;
+    /** eventfd descriptor consumer waits on */
+    int wakeFd;
+    /** Number of producers waiting for free slot; consumer signals
+     * `slotsFreed` after draining if it is set */
+    atomic_int nProducersWaiting;
+    /** Guards waits of blocked producers */
+    pthread_mutex_t slotsLock;
+    pthread_cond_t slotsFreed;
+    /** Producer used by `ncrm_enqueue()` */
+    struct ncrm_Producer defaultProducer;
+    /** List of registered producers */
+    _Atomic(struct ncrm_Producer *) producers;
+    /** Coalescing targets registered so far */
+    struct CoalescingTarget targets[NCRM_MAX_COALESCING_TARGETS];
+    /** Events drained from the rings to be handled (consumer only) */
+    struct ncrm_Event batch[ NCRM_MAX_INPUT_EVENTS
+                           + NCRM_MAX_CONTROL_EVENTS
+                           + NCRM_MAX_DATA_EVENTS ];
 } gQueue;
 
-static struct EventListEntry *
-_alloc_evlist_entry() {
-    struct EventListEntry * evEntry;
-    pthread_mutex_lock(&gEventPoolMutex); {
-        uint32_t nEvent = 0;
-        for( evEntry = gEventListEntriesPool
-           ; (evEntry->isInUse & 0x1) && nEvent <= NCRM_MAX_EVENTS_IN_QUEUE
-           ; ++evEntry, ++nEvent ) {}
-        if( nEvent == NCRM_MAX_EVENTS_IN_QUEUE ) {
-            /* failed to allocate new event (entire pool busy) */
-            pthread_mutex_unlock(&gEventPoolMutex);
-            return NULL;
+enum ncrm_EventClass
+ncrm_event_class( const struct ncrm_Event * eventPtr ) {
+    switch( eventPtr->type ) {
+        case ncrm_kEventKeypress:
+            return ncrm_kEventClassInput;
+        case ncrm_kEventExtension:
+            return ncrm_kEventClassData;
+        default:
+            return ncrm_kEventClassControl;
+    };
+}
+
+struct ncrm_Payload *
+ncrm_event_payload( const struct ncrm_Event * eventPtr ) {
+    if( ncrm_kEventExtension != eventPtr->type ) return NULL;
+    return eventPtr->payload.forExtension.data;
+}
+
+int
+ncrm_event_is_coalescing( const struct ncrm_Event * eventPtr ) {
+    switch( eventPtr->type ) {
+        case ncrm_kEventExtension:
+            /* data can not be merged */
+            return !eventPtr->payload.forExtension.data;
+        case ncrm_kEventIncrementUpdateCount:
+        case ncrm_kEventHeaderUpdate:
+        case ncrm_kEventFooterUpdate:
+        case ncrm_kEventExtensionReady:
+            return 1;
+        default:
+            return 0;
+    };
+}
+
+/* Returns non-zero if event is addressed to certain extension */
+static int
+_is_for_extension( enum ncrm_EventType type ) {
+    return ncrm_kEventExtension == type || ncrm_kEventExtensionReady == type;
+}
+
+/* Finds (registering, if need) coalescing target of the event. Returns NULL
+ * if targets table is full. */
+static struct CoalescingTarget *
+_coalescing_target( const struct ncrm_Event * eventPtr ) {
+    const uint16_t extensionID = _is_for_extension(eventPtr->type)
+                               ? eventPtr->payload.forExtension.extensionID : 0;
+    for( struct CoalescingTarget * t = gQueue.targets
+       ; t != gQueue.targets + NCRM_MAX_COALESCING_TARGETS
+       ; ++t ) {
+        int state = atomic_load(&t->state);
+        if( 0 == state ) {
+            /* try to register new target in free entry */
+            if( atomic_compare_exchange_strong(&t->state, &state, 1) ) {
+                t->type = eventPtr->type;
+                t->extensionID = extensionID;
+                atomic_store(&t->state, 2);
+                return t;
+            }
+            /* `state` is updated by failed CAS */
         }
-        evEntry->isInUse = 0x1;
-        evEntry->next = NULL;
-        /* no need to zero event object as it will be anyway overwritten by
-         * memcpy() */
-    } pthread_mutex_unlock(&gEventPoolMutex);
-    return evEntry;
+        while( 1 == state ) state = atomic_load(&t->state);  /* being registered */
+        if( t->type == eventPtr->type && t->extensionID == extensionID )
+            return t;
+    }
+    return NULL;
 }
 
-void
-_free_evlist_entry( struct EventListEntry * evEntry) {
-    pthread_mutex_lock(&gEventPoolMutex);
-    evEntry->isInUse = 0x0;
-    pthread_mutex_unlock(&gEventPoolMutex);
+static void
+_ring_init( struct QueueRing * ring
+          , struct QueueSlot * slots, unsigned long capacity ) {
+    ring->slots = slots;
+    ring->mask = capacity - 1;
+    for( unsigned long i = 0; i < capacity; ++i ) {
+        atomic_init(&slots[i].seq, i);
+        atomic_init(&slots[i].busy, 0);
+    }
+    atomic_init(&ring->enqueuePos, 0);
+    atomic_init(&ring->highWater, 0);
+    atomic_init(&ring->dequeuePos, 0);
 }
 
 void
 ncrm_queue_init() {
-    bzero( gEventListEntriesPool, sizeof(gEventListEntriesPool) );
-    gQueue.head = gQueue.tail = NULL;
+    _ring_init( gQueue.rings + ncrm_kEventClassInput
+              , gInputSlots, NCRM_MAX_INPUT_EVENTS );
+    _ring_init( gQueue.rings + ncrm_kEventClassControl
+              , gControlSlots, NCRM_MAX_CONTROL_EVENTS );
+    _ring_init( gQueue.rings + ncrm_kEventClassData
+              , gDataSlots, NCRM_MAX_DATA_EVENTS );
+    for( int i = 0; i < NCRM_MAX_COALESCING_TARGETS; ++i ) {
+        atomic_init(&gQueue.targets[i].state, 0);
+        atomic_init(&gQueue.targets[i].nPending, 0);
+    }
+    atomic_init(&gQueue.consumerSleeping, 0);
+    atomic_init(&gQueue.producers, NULL);
+    ncrm_producer_init( &gQueue.defaultProducer, "default"
+                      , ncrm_kOverflowDropNewest, 0 );
+    gQueue.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert( gQueue.wakeFd >= 0 );
+    atomic_init(&gQueue.nProducersWaiting, 0);
+    pthread_mutex_init(&gQueue.slotsLock, NULL);
+    /* deadlines of blocked producers are monotonic */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&gQueue.slotsFreed, &attr);
+    pthread_condattr_destroy(&attr);
+}
 
-    pthread_mutex_init(&gEventPoolMutex, NULL);
+void
+ncrm_queue_free() {
+    close(gQueue.wakeFd);
+    gQueue.wakeFd = -1;
+    pthread_cond_destroy(&gQueue.slotsFreed);
+    pthread_mutex_destroy(&gQueue.slotsLock);
+}
 
-    pthread_mutex_init(&gQueue.mtxQueueEmpty, NULL);
-    pthread_cond_init(&gQueue.cvQueueEmpty, NULL);
+void
+ncrm_producer_init( struct ncrm_Producer * producer
+                  , const char * name
+                  , enum ncrm_OverflowPolicy policy
+                  , unsigned int blockTimeoutMSec ) {
+    producer->name = name;
+    producer->overflowPolicy = policy;
+    producer->blockTimeoutMSec = blockTimeoutMSec;
+    atomic_init(&producer->cancelled, 0);
+    atomic_init(&producer->nEnqueued, 0);
+    atomic_init(&producer->nDropped, 0);
+    atomic_init(&producer->nOverflowMerged, 0);
+    /* push to the list head */
+    producer->next = atomic_load(&gQueue.producers);
+    while( !atomic_compare_exchange_weak( &gQueue.producers
+                                        , &producer->next, producer ) ) {}
 }
 
 void
-ncrm_queue_free() {
-    pthread_mutex_destroy(&gEventPoolMutex);
-    pthread_mutex_destroy(&gQueue.mtxQueueEmpty);
-    pthread_cond_destroy(&gQueue.cvQueueEmpty);
+ncrm_producer_cancel( struct ncrm_Producer * producer ) {
+    pthread_mutex_lock(&gQueue.slotsLock);
+    atomic_store(&producer->cancelled, 1);
+    pthread_cond_broadcast(&gQueue.slotsFreed);
+    pthread_mutex_unlock(&gQueue.slotsLock);
 }
 
-int
-ncrm_enqueue( struct ncrm_Event * eventPtr ) {
-    /* Allocate new list entry and copy source data to it */
-    struct EventListEntry * evListEntry = _alloc_evlist_entry();
-    if( !evListEntry ) return -1;
-    memcpy(&evListEntry->eventObject, eventPtr, sizeof(struct ncrm_Event));
-    /* ^^^ note that here we completely overwrite evListEntry->eventObject */
-    /* Add event list entry into queue */
-    pthread_mutex_lock(&(gQueue.mtxQueueEmpty));
-    {
-        if( !gQueue.tail ) {
-            assert(!gQueue.head);
-            gQueue.head = gQueue.tail = evListEntry;
+struct ncrm_Producer *
+ncrm_producers() {
+    return atomic_load(&gQueue.producers);
+}
+
+/* Locks slot for copying or modification of the event */
+static void
+_slot_lock( struct QueueSlot * slot ) {
+    int expected = 0;
+    while( !atomic_compare_exchange_weak_explicit( &slot->busy, &expected, 1
+                , memory_order_acquire, memory_order_relaxed ) ) {
+        expected = 0;
+    }
+}
+
+static void
+_slot_unlock( struct QueueSlot * slot ) {
+    atomic_store_explicit(&slot->busy, 0, memory_order_release);
+}
+
+/* Returns non-zero if events are of the same type and extension */
+static int
+_same_target( const struct ncrm_Event * a, const struct ncrm_Event * b ) {
+    if( a->type != b->type ) return 0;
+    if( !_is_for_extension(a->type) ) return 1;
+    return a->payload.forExtension.extensionID
+        == b->payload.forExtension.extensionID;
+}
+
+/* Claims free position in the ring. Returns NULL if ring is full. */
+static struct QueueSlot *
+_claim_slot( struct QueueRing * ring, unsigned long * posPtr ) {
+    struct QueueSlot * slot;
+    unsigned long pos = atomic_load_explicit(&ring->enqueuePos, memory_order_relaxed);
+    for(;;) {
+        slot = ring->slots + (pos & ring->mask);
+        unsigned long seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        long diff = (long) seq - (long) pos;
+        if( 0 == diff ) {
+            /* slot is free, try to claim it */
+            if( atomic_compare_exchange_weak_explicit( &ring->enqueuePos
+                        , &pos, pos + 1
+                        , memory_order_relaxed, memory_order_relaxed ) )
+                break;
+            /* `pos` is updated by failed CAS */
+        } else if( diff < 0 ) {
+            /* slot is still occupied by event of previous lap -- full */
+            return NULL;
         } else {
-            gQueue.tail->next = evListEntry;
-            gQueue.tail = gQueue.tail->next;
+            /* another producer claimed the position */
+            pos = atomic_load_explicit(&ring->enqueuePos, memory_order_relaxed);
+        }
+    }
+    /* update high-water mark */
+    unsigned long depth = pos + 1
+                - atomic_load_explicit(&ring->dequeuePos, memory_order_relaxed)
+                , hw = atomic_load_explicit(&ring->highWater, memory_order_relaxed);
+    if( depth > ring->mask + 1 ) depth = ring->mask + 1;  /* stale dequeuePos */
+    while( depth > hw
+        && !atomic_compare_exchange_weak_explicit( &ring->highWater, &hw, depth
+                    , memory_order_relaxed, memory_order_relaxed ) ) {}
+    *posPtr = pos;
+    return slot;
+}
+
+/* Applies "drop oldest" (replace != 0) or "coalesce" policy: finds the
+ * oldest (or latest) pending event of the same target and replaces it with
+ * given one (or counts given one in it). Returns number of events lost by
+ * replacement (the pending one could have been coalesced from many) or -1
+ * if no such event is pending. */
+static long
+_merge_into_pending( struct QueueRing * ring
+                   , const struct ncrm_Event * eventPtr
+                   , int replace ) {
+    unsigned long first = atomic_load(&ring->dequeuePos)
+                , last = atomic_load(&ring->enqueuePos)
+                ;
+    for( unsigned long n = 0; n < last - first; ++n ) {
+        unsigned long pos = replace ? first + n : last - 1 - n;
+        struct QueueSlot * slot = ring->slots + (pos & ring->mask);
+        _slot_lock(slot);
+        /* while slot is locked, consumer can not take the event, so if it
+         * is still published at this position, we may modify it */
+        if( atomic_load_explicit(&slot->seq, memory_order_acquire) == pos + 1
+         && _same_target(&slot->eventObject, eventPtr) ) {
+            long nLost = 0;
+            struct ncrm_Payload * replaced = NULL;
+            if( replace ) {
+                nLost = slot->eventObject.nCoalesced;
+                replaced = ncrm_event_payload(&slot->eventObject);
+                memcpy(&slot->eventObject, eventPtr, sizeof(struct ncrm_Event));
+                slot->eventObject.nCoalesced = 1;
+                clock_gettime(CLOCK_MONOTONIC, &slot->eventObject.enqueueTime);
+            } else {
+                ++slot->eventObject.nCoalesced;
+            }
+            _slot_unlock(slot);
+            ncrm_payload_unref(replaced);
+            return nLost;
+        }
+        _slot_unlock(slot);
+    }
+    return -1;
+}
+
+int
+ncrm_enqueue_from( struct ncrm_Producer * producer
+                 , struct ncrm_Event * eventPtr ) {
+    struct CoalescingTarget * target = NULL;
+    if( ncrm_event_is_coalescing(eventPtr) ) {
+        /* if event of the same target is pending, just count this one */
+        target = _coalescing_target(eventPtr);
+        if( target && atomic_fetch_add(&target->nPending, 1) ) {
+            atomic_fetch_add_explicit(&producer->nEnqueued, 1, memory_order_relaxed);
+            return 0;
         }
     }
-    pthread_cond_broadcast(&gQueue.cvQueueEmpty);
-    pthread_mutex_unlock(&(gQueue.mtxQueueEmpty));
-    /* ^^^ these two lines may be interchanged probably to gain a bit more
-     *     performance, see discussion in comments of
-     *     https://stackoverflow.com/a/5538447/1734499 */
+    struct QueueRing * ring = gQueue.rings + ncrm_event_class(eventPtr);
+    unsigned long pos;
+    struct QueueSlot * slot = _claim_slot(ring, &pos);
+    if( !slot ) {
+        /* ring is full, apply overflow policy */
+        long rc = -1;
+        switch( producer->overflowPolicy ) {
+            case ncrm_kOverflowBlock: {
+                struct timespec deadline;
+                clock_gettime(CLOCK_MONOTONIC, &deadline);
+                deadline.tv_sec  += producer->blockTimeoutMSec/1000;
+                deadline.tv_nsec += (producer->blockTimeoutMSec%1000)*1000000L;
+                if( deadline.tv_nsec >= 1000000000L ) {
+                    ++deadline.tv_sec;
+                    deadline.tv_nsec -= 1000000000L;
+                }
+                pthread_mutex_lock(&gQueue.slotsLock);
+                /* count self before checking the ring again; pairs with
+                 * the fence in consumer */
+                atomic_fetch_add(&gQueue.nProducersWaiting, 1);
+                atomic_thread_fence(memory_order_seq_cst);
+                while( !(slot = _claim_slot(ring, &pos))
+                    && !atomic_load(&producer->cancelled) ) {
+                    if( !producer->blockTimeoutMSec ) {  /* no limit */
+                        pthread_cond_wait(&gQueue.slotsFreed, &gQueue.slotsLock);
+                    } else if( ETIMEDOUT == pthread_cond_timedwait( &gQueue.slotsFreed
+                                                , &gQueue.slotsLock, &deadline ) ) {
+                        slot = _claim_slot(ring, &pos);
+                        break;
+                    }
+                }
+                atomic_fetch_sub(&gQueue.nProducersWaiting, 1);
+                pthread_mutex_unlock(&gQueue.slotsLock);
+            } break;
+            case ncrm_kOverflowDropOldest:
+                rc = _merge_into_pending(ring, eventPtr, 1);
+                break;
+            case ncrm_kOverflowCoalesce:
+                if( !ncrm_event_payload(eventPtr) )
+                    rc = _merge_into_pending(ring, eventPtr, 0);
+                break;
+            default:
+                break;
+        };
+        if( !slot ) {
+            if( target ) {
+                /* undo own increment only. Events of other producers
+                 * coalesced meanwhile into this one (that never got into
+                 * the ring) are lost with it; take their counts too, so
+                 * target does not stay pending with no event */
+                unsigned int nJoined = atomic_fetch_sub(&target->nPending, 1) - 1;
+                if( nJoined ) nJoined = atomic_exchange(&target->nPending, 0);
+                if( nJoined )
+                    atomic_fetch_add_explicit(&producer->nDropped, nJoined, memory_order_relaxed);
+            }
+            if( rc < 0 ) {
+                atomic_fetch_add_explicit(&producer->nDropped, 1, memory_order_relaxed);
+                ncrm_payload_unref(ncrm_event_payload(eventPtr));
+                return -1;
+            }
+            if( rc ) {  /* pending event(s) replaced */
+                atomic_fetch_add_explicit(&producer->nDropped, rc, memory_order_relaxed);
+            } else {  /* coalesced into pending one */
+                atomic_fetch_add_explicit(&producer->nOverflowMerged, 1, memory_order_relaxed);
+            }
+            atomic_fetch_add_explicit(&producer->nEnqueued, 1, memory_order_relaxed);
+            return 0;
+        }
+    }
+    memcpy(&slot->eventObject, eventPtr, sizeof(struct ncrm_Event));
+    /* ^^^ note that here we completely overwrite slot->eventObject */
+    slot->eventObject.nCoalesced = 1;
+    clock_gettime(CLOCK_MONOTONIC, &slot->eventObject.enqueueTime);
+    /* publish the event */
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    atomic_fetch_add_explicit(&producer->nEnqueued, 1, memory_order_relaxed);
+    /* wake consumer only if it sleeps (or is about to); pairs with the
+     * fence in consumer, so either it sees the event, or we see the flag */
+    atomic_thread_fence(memory_order_seq_cst);
+    if( atomic_load_explicit(&gQueue.consumerSleeping, memory_order_relaxed)
+     && atomic_exchange(&gQueue.consumerSleeping, 0) ) {
+        const uint64_t one = 1;
+        ssize_t rc = write(gQueue.wakeFd, &one, sizeof(one));
+        (void) rc;  /* counter overflow is not possible here */
+    }
     return 0;
 }
 
+int
+ncrm_enqueue( struct ncrm_Event * eventPtr ) {
+    return ncrm_enqueue_from(&gQueue.defaultProducer, eventPtr);
+}
+
+void
+ncrm_queue_stats( struct ncrm_QueueStats * stats ) {
+    memset(stats, 0, sizeof(*stats));
+    for( int nClass = 0; nClass < NCRM_N_EVENT_CLASSES; ++nClass ) {
+        struct QueueRing * ring = gQueue.rings + nClass;
+        unsigned long dequeuePos = atomic_load(&ring->dequeuePos)
+                    , enqueuePos = atomic_load(&ring->enqueuePos)
+                    ;
+        stats->depth[nClass] = enqueuePos > dequeuePos
+                             ? enqueuePos - dequeuePos : 0;
+        stats->highWater[nClass] = atomic_load(&ring->highWater);
+        stats->capacity[nClass] = ring->mask + 1;
+    }
+    for( struct ncrm_Producer * p = ncrm_producers(); p; p = p->next ) {
+        stats->nDropped += atomic_load(&p->nDropped);
+        stats->nOverflowMerged += atomic_load(&p->nOverflowMerged);
+    }
+}
+
 /*
  * Event consumer
  */
-#if 1
+
+/* Returns slot with next event of the ring or NULL if ring is empty */
+static struct QueueSlot *
+_next_published( struct QueueRing * ring ) {
+    unsigned long pos = atomic_load_explicit(&ring->dequeuePos, memory_order_relaxed);
+    struct QueueSlot * slot = ring->slots + (pos & ring->mask);
+    if( atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1 )
+        return NULL;
+    return slot;
+}
+
+/* Returns non-zero if there is at least one event in any ring */
+static int
+_has_events() {
+    for( int nClass = 0; nClass < NCRM_N_EVENT_CLASSES; ++nClass ) {
+        if( _next_published(gQueue.rings + nClass) ) return 1;
+    }
+    return 0;
+}
 
 int
-ncrm_do_with_events( void(*callback)(struct ncrm_Event *, void*)
-                   , void * userdata) {
-    pthread_mutex_lock(&gQueue.mtxQueueEmpty);
-    while(!gQueue.head)
-        pthread_cond_wait(&gQueue.cvQueueEmpty, &gQueue.mtxQueueEmpty);
-    /* Consume events from the queue */
-    while(gQueue.head) {
-        /* handle the event with callback */
-        callback(&gQueue.head->eventObject, userdata);
-        /* remove event from queue, memorizing the ptr */
-        struct EventListEntry * toFree = gQueue.head;
-        gQueue.head = gQueue.head->next;
-        /* mark it as free in pool (free evlist entry) */
-        _free_evlist_entry(toFree);
-    }
-    assert(!gQueue.head);
-    gQueue.tail = NULL;
-    pthread_mutex_unlock(&gQueue.mtxQueueEmpty);
+ncrm_queue_fd() {
+    return gQueue.wakeFd;
+}
+
+int
+ncrm_queue_sleep_begin() {
+    atomic_store(&gQueue.consumerSleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if( _has_events() ) {
+        /* event came in between */
+        atomic_store(&gQueue.consumerSleeping, 0);
+        return 1;
+    }
     return 0;
 }
 
-#else
-struct CalleeData {
-    void(*callback)(struct ncrm_Event *, void*);
-    void * userdata;
-};
+void
+ncrm_queue_sleep_end() {
+    uint64_t counter;
+    ssize_t nRead = read(gQueue.wakeFd, &counter, sizeof(counter));
+    (void) nRead;  /* EAGAIN is fine, we only reset the counter */
+    atomic_store(&gQueue.consumerSleeping, 0);
+}
 
-static void *
-_event_callee(void * calleeData_) {
-    struct CalleeData * calleeData
-        = (struct CalleeData *) calleeData_;
-    pthread_mutex_lock(&gQueue.mtxQueueEmpty);
-    while(!gQueue.head)
-        pthread_cond_wait(&gQueue.cvQueueEmpty, &gQueue.mtxQueueEmpty);
-    /* Consume events from the queue */
-    while(gQueue.head) {
-        /* handle the event with callback */
-        calleeData->callback( &gQueue.head->eventObject
-                            , calleeData->userdata
-                            );
-        /* remove event from queue, memorizing the ptr */
-        struct EventListEntry * toFree = gQueue.head;
-        gQueue.head = gQueue.head->next;
-        /* mark it as free in pool (free evlist entry) */
-        _free_evlist_entry(toFree);
-    }
-    assert(!gQueue.head);
-    gQueue.tail = NULL;
-    pthread_mutex_unlock(&gQueue.mtxQueueEmpty);
-    pthread_exit(NULL);
+/* Sleeps until producer wakes the consumer or deadline expires. Returns 1 if
+ * deadline expired with no events. */
+static int
+_wait_for_events( const struct timespec * deadline ) {
+    if( ncrm_queue_sleep_begin() ) return 0;
+    struct pollfd pfd = { gQueue.wakeFd, POLLIN, 0 };
+    struct timespec timeout, * timeoutPtr = NULL;
+    if( deadline ) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timeout.tv_sec = deadline->tv_sec - now.tv_sec;
+        timeout.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+        if( timeout.tv_nsec < 0 ) {
+            --timeout.tv_sec;
+            timeout.tv_nsec += 1000000000L;
+        }
+        if( timeout.tv_sec < 0 ) timeout.tv_sec = timeout.tv_nsec = 0;
+        timeoutPtr = &timeout;
+    }
+    int rc = ppoll(&pfd, 1, timeoutPtr, NULL);
+    ncrm_queue_sleep_end();
+    if( 0 == rc && !_has_events() ) return 1;
+    return 0;
+}
+
+/* Moves published events of the ring into the batch, releasing the slots.
+ * Not more than ring capacity is taken, so continuous flood of events won't
+ * hold consumer forever. Returns new number of events in the batch. */
+static unsigned int
+_drain_ring( struct QueueRing * ring, unsigned int nEvents ) {
+    struct QueueSlot * slot;
+    for( unsigned long n = 0
+       ; n <= ring->mask && (slot = _next_published(ring))
+       ; ++n ) {
+        unsigned long pos = atomic_load_explicit(&ring->dequeuePos, memory_order_relaxed);
+        struct ncrm_Event * event = gQueue.batch + nEvents++;
+        _slot_lock(slot);
+        memcpy( event, &slot->eventObject, sizeof(struct ncrm_Event) );
+        if( ncrm_event_is_coalescing(event) ) {
+            /* taking event unblocks producers of the target; as event is
+             * handled after this, updates made by producers before they
+             * counted their events will be seen by handler */
+            struct CoalescingTarget * target = _coalescing_target(event);
+            if( target ) {
+                unsigned int n = atomic_exchange(&target->nPending, 0);
+                if( n ) event->nCoalesced = n;
+            }
+        }
+        /* release the slot for producers of the next lap */
+        atomic_store_explicit( &slot->seq
+                             , pos + ring->mask + 1
+                             , memory_order_release );
+        _slot_unlock(slot);
+        atomic_store_explicit(&ring->dequeuePos, pos + 1, memory_order_relaxed);
+    }
+    return nEvents;
+}
+
+unsigned int
+ncrm_do_with_events_nowait( void(*callback)(struct ncrm_Event *, void*)
+                          , void * userdata ) {
+    /* Drain published events into the batch first, releasing the slots
+     * at once, so producers are not limited by the time callback takes.
+     * Higher classes go first, so input is handled before data updates
+     * queued earlier */
+    unsigned int nEvents = 0;
+    for( int nClass = 0; nClass < NCRM_N_EVENT_CLASSES; ++nClass )
+        nEvents = _drain_ring(gQueue.rings + nClass, nEvents);
+    /* wake producers waiting for released slots, if any; pairs with the
+     * fence in producer, so either it sees free slot, or we see it waits */
+    if( nEvents ) {
+        atomic_thread_fence(memory_order_seq_cst);
+        if( atomic_load_explicit(&gQueue.nProducersWaiting, memory_order_relaxed) ) {
+            pthread_mutex_lock(&gQueue.slotsLock);
+            pthread_cond_broadcast(&gQueue.slotsFreed);
+            pthread_mutex_unlock(&gQueue.slotsLock);
+        }
+    }
+    /* handle the events with callback */
+    for( unsigned int nEvent = 0; nEvent < nEvents; ++nEvent ) {
+        callback(gQueue.batch + nEvent, userdata);
+        ncrm_payload_unref(ncrm_event_payload(gQueue.batch + nEvent));
+    }
+    return nEvents;
+}
+
+int
+ncrm_do_with_events_until( void(*callback)(struct ncrm_Event *, void*)
+                         , void * userdata
+                         , const struct timespec * deadline ) {
+    while( !_has_events() ) {
+        if( _wait_for_events(deadline) ) return 1;
+    }
+    ncrm_do_with_events_nowait(callback, userdata);
+    return 0;
 }
 
 int
 ncrm_do_with_events( void(*callback)(struct ncrm_Event *, void*)
                    , void * userdata) {
-    pthread_t callee;
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    struct CalleeData calleeData = { callback, userdata };
-    pthread_create(&callee, &attr, _event_callee, &calleeData );
-    pthread_join(callee, NULL);
-    pthread_attr_destroy(&attr);
-    return 0;
+    return ncrm_do_with_events_until(callback, userdata, NULL);
 }
-#endif
@@ -0,0 +1,136 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "ncrm_reactor.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+/** (internal) event source */
+struct ReactorSource {
+    int fd;
+    ncrm_ReactorCallback callback;
+    void * userData;
+    /** Set for timers created by reactor (closed on free) */
+    int ownFd:1;
+};
+
+static struct {
+    int epollFd;
+    struct ReactorSource sources[NCRM_REACTOR_MAX_SOURCES];
+} gReactor;
+
+void
+ncrm_reactor_init() {
+    gReactor.epollFd = epoll_create1(EPOLL_CLOEXEC);
+    assert( gReactor.epollFd >= 0 );
+    for( int i = 0; i < NCRM_REACTOR_MAX_SOURCES; ++i )
+        gReactor.sources[i].fd = -1;
+}
+
+void
+ncrm_reactor_free() {
+    for( int i = 0; i < NCRM_REACTOR_MAX_SOURCES; ++i ) {
+        struct ReactorSource * src = gReactor.sources + i;
+        if( src->fd >= 0 && src->ownFd ) close(src->fd);
+        src->fd = -1;
+    }
+    close(gReactor.epollFd);
+    gReactor.epollFd = -1;
+}
+
+static struct ReactorSource *
+_add( int fd, ncrm_ReactorCallback callback, void * userData ) {
+    struct ReactorSource * src = gReactor.sources;
+    while( src != gReactor.sources + NCRM_REACTOR_MAX_SOURCES && src->fd >= 0 )
+        ++src;
+    if( src == gReactor.sources + NCRM_REACTOR_MAX_SOURCES ) return NULL;
+    struct epoll_event ev = { EPOLLIN, { .ptr = src } };
+    if( epoll_ctl(gReactor.epollFd, EPOLL_CTL_ADD, fd, &ev) ) return NULL;
+    src->fd = fd;
+    src->callback = callback;
+    src->userData = userData;
+    src->ownFd = 0x0;
+    return src;
+}
+
+int
+ncrm_reactor_add( int fd, ncrm_ReactorCallback callback, void * userData ) {
+    return _add(fd, callback, userData) ? 0 : -1;
+}
+
+void
+ncrm_reactor_remove( int fd ) {
+    for( int i = 0; i < NCRM_REACTOR_MAX_SOURCES; ++i ) {
+        struct ReactorSource * src = gReactor.sources + i;
+        if( src->fd != fd ) continue;
+        epoll_ctl(gReactor.epollFd, EPOLL_CTL_DEL, fd, NULL);
+        if( src->ownFd ) close(src->fd);
+        src->fd = -1;
+        return;
+    }
+}
+
+int
+ncrm_reactor_add_timer( unsigned int periodMSec
+                      , ncrm_ReactorCallback callback, void * userData ) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if( fd < 0 ) return -1;
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = periodMSec/1000;
+    spec.it_interval.tv_nsec = (periodMSec%1000)*1000000L;
+    spec.it_value = spec.it_interval;
+    struct ReactorSource * src;
+    if( timerfd_settime(fd, 0, &spec, NULL)
+     || !(src = _add(fd, callback, userData)) ) {
+        close(fd);
+        return -1;
+    }
+    src->ownFd = 0x1;
+    return fd;
+}
+
+int
+ncrm_reactor_run_until( const struct timespec * deadline ) {
+    int timeoutMSec = -1;
+    if( deadline ) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long msec = (deadline->tv_sec - now.tv_sec)*1000L
+                  + (deadline->tv_nsec - now.tv_nsec + 999999L)/1000000L;
+        timeoutMSec = msec > 0 ? msec : 0;
+    }
+    struct epoll_event events[NCRM_REACTOR_MAX_SOURCES];
+    int nEvents = epoll_wait( gReactor.epollFd, events
+                            , NCRM_REACTOR_MAX_SOURCES, timeoutMSec );
+    if( nEvents < 0 ) {
+        assert( EINTR == errno );
+        nEvents = 0;
+    }
+    int nHandled = 0;
+    for( int i = 0; i < nEvents; ++i ) {
+        struct ReactorSource * src = (struct ReactorSource *) events[i].data.ptr;
+        if( src->fd < 0 ) continue;  /* removed by previous callback */
+        src->callback(src->fd, src->userData);
+        ++nHandled;
+    }
+    return nHandled ? 0 : 1;
+}
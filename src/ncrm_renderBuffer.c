@@ -0,0 +1,143 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ncrm_renderBuffer.h"
+#include "ncrm_utf8.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+void
+ncrm_rb_init( struct ncrm_RenderBuffer * rb ) {
+    bzero(rb, sizeof(struct ncrm_RenderBuffer));
+}
+
+void
+ncrm_rb_free( struct ncrm_RenderBuffer * rb ) {
+    free(rb->clearRows);
+    free(rb->spans);
+    free(rb->text);
+    ncrm_rb_init(rb);
+}
+
+void
+ncrm_rb_reset( struct ncrm_RenderBuffer * rb, uint16_t nRows ) {
+    if( nRows != rb->nRows ) {
+        rb->clearRows = realloc(rb->clearRows, nRows);
+        rb->nRows = nRows;
+    }
+    if( nRows ) bzero(rb->clearRows, nRows);
+    rb->erase = 0x0;
+    rb->scroll = 0;
+    rb->nSpans = 0;
+    rb->textLen = 0;
+}
+
+int
+ncrm_rb_is_empty( const struct ncrm_RenderBuffer * rb ) {
+    if( rb->erase || rb->scroll || rb->nSpans ) return 0;
+    for( uint16_t i = 0; i < rb->nRows; ++i )
+        if( rb->clearRows[i] ) return 0;
+    return 1;
+}
+
+void
+ncrm_rb_clear_row( struct ncrm_RenderBuffer * rb, uint16_t row ) {
+    assert( row < rb->nRows );
+    rb->clearRows[row] = 0x1;
+}
+
+static struct ncrm_RenderSpan *
+_new_span( struct ncrm_RenderBuffer * rb
+         , uint16_t row, uint16_t col, attr_t attrs
+         , size_t nBytes ) {
+    assert( row < rb->nRows );
+    if( rb->nSpans == rb->nSpansAllocated ) {
+        rb->nSpansAllocated += NCRM_RENDER_BUFFER_INC;
+        rb->spans = realloc( rb->spans
+                           , rb->nSpansAllocated*sizeof(struct ncrm_RenderSpan) );
+    }
+    if( rb->textLen + nBytes > rb->textAllocated ) {
+        while( rb->textLen + nBytes > rb->textAllocated )
+            rb->textAllocated += NCRM_RENDER_BUFFER_INC;
+        rb->text = realloc(rb->text, rb->textAllocated);
+    }
+    struct ncrm_RenderSpan * span = rb->spans + rb->nSpans++;
+    span->row = row;
+    span->col = col;
+    span->attrs = attrs;
+    span->acs = '\0';
+    span->len = nBytes;
+    span->textOffset = rb->textLen;
+    rb->textLen += nBytes;
+    return span;
+}
+
+uint16_t
+ncrm_rb_put( struct ncrm_RenderBuffer * rb
+           , uint16_t row, uint16_t col, attr_t attrs
+           , const char * text, size_t nBytes ) {
+    if( !nBytes ) return 0;
+    struct ncrm_RenderSpan * span = _new_span(rb, row, col, attrs, nBytes);
+    memcpy(rb->text + span->textOffset, text, nBytes);
+    return ncrm_u8_width(text, nBytes);
+}
+
+void
+ncrm_rb_fill( struct ncrm_RenderBuffer * rb
+            , uint16_t row, uint16_t col, attr_t attrs
+            , char c, uint16_t n ) {
+    if( !n ) return;
+    struct ncrm_RenderSpan * span = _new_span(rb, row, col, attrs, n);
+    memset(rb->text + span->textOffset, c, n);
+}
+
+void
+ncrm_rb_put_acs( struct ncrm_RenderBuffer * rb
+               , uint16_t row, uint16_t col, attr_t attrs
+               , char acs ) {
+    _new_span(rb, row, col, attrs, 0)->acs = acs;
+}
+
+void
+ncrm_rb_draw( const struct ncrm_RenderBuffer * rb, WINDOW * w ) {
+    if( rb->erase ) {
+        werase(w);
+    } else if( rb->scroll ) {
+        /* scrolling is enabled only here, as otherwise writing to the
+         * bottom right corner would scroll the window */
+        scrollok(w, TRUE);
+        wscrl(w, rb->scroll);
+        scrollok(w, FALSE);
+    }
+    for( uint16_t row = 0; row < rb->nRows; ++row ) {
+        if( !rb->clearRows[row] ) continue;
+        wmove(w, row, 0);
+        wclrtoeol(w);
+    }
+    for( const struct ncrm_RenderSpan * span = rb->spans
+       ; span != rb->spans + rb->nSpans
+       ; ++span ) {
+        wattrset(w, span->attrs);
+        if( span->acs ) {
+            mvwaddch(w, span->row, span->col, NCURSES_ACS(span->acs));
+        } else {
+            mvwaddnstr(w, span->row, span->col, rb->text + span->textOffset, span->len);
+        }
+    }
+    wattrset(w, A_NORMAL);
+}
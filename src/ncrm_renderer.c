@@ -0,0 +1,246 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ncrm_renderer.h"
+#include "ncrm_extension.h"
+
+#include <pthread.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** (internal) events and buffers state of an extension */
+struct RendererInbox {
+    /** Events accumulated till next prepare call */
+    struct ncrm_Event * events;
+    unsigned int nEvents, nAllocated;
+    /** Number of accumulated events without payload (limited by
+     * `NCRM_RENDERER_MAX_EVENTS`; ones with payload are not limited) */
+    unsigned int nPlain;
+    /** Buffer to prepare content in */
+    uint8_t nBack;
+    /** Buffer prepared and not yet presented, -1 if none */
+    int8_t nReady;
+    /** Durations of `prepare()` calls */
+    struct ncrm_LatencyHistogram prepareLatency;
+    /** Set for extension currently shown */
+    int active:1;
+};
+
+static struct {
+    struct ncrm_Extension ** extensions;
+    uint16_t nExtensions;
+    struct RendererInbox * inboxes;
+    /** Guards inboxes; condition is signaled on new events and presented
+     * buffers */
+    pthread_mutex_t lock;
+    pthread_cond_t cv;
+    int keepGoing:1;
+    pthread_t thread;
+    /** Producer of "ready" events; they must not be lost (extension would
+     * never be presented again), so producer waits for free slot */
+    struct ncrm_Producer producer;
+} gRenderer;
+
+/* Returns number of extension having events to prepare, -1 if none.
+ * Background extensions are prepared only to release absorbed payloads.
+ * Extension is not prepared while its ready buffer waits to be presented
+ * (background one keeps it till activation), so events accumulate
+ * meanwhile */
+static int
+_next_pending() {
+    for( uint16_t nExt = 0; nExt < gRenderer.nExtensions; ++nExt ) {
+        const struct RendererInbox * inbox = gRenderer.inboxes + nExt;
+        if( !inbox->nEvents || inbox->nReady >= 0 ) continue;
+        if( inbox->active
+         || inbox->nEvents - inbox->nPlain >= NCRM_RENDERER_BACKGROUND_PAYLOADS )
+            return nExt;
+    }
+    return -1;
+}
+
+static void *
+_render_thread( void * _ ) {
+    /* buffer of taken events; swapped with inbox's one */
+    struct ncrm_Event * events = NULL;
+    unsigned int nAllocated = 0;
+    pthread_mutex_lock(&gRenderer.lock);
+    while( gRenderer.keepGoing ) {
+        int nExt = _next_pending();
+        if( nExt < 0 ) {
+            pthread_cond_wait(&gRenderer.cv, &gRenderer.lock);
+            continue;
+        }
+        struct RendererInbox * inbox = gRenderer.inboxes + nExt;
+        struct ncrm_Extension * ext = gRenderer.extensions[nExt];
+        /* take accumulated events, giving inbox the buffer of previous
+         * take */
+        const unsigned int nEvents = inbox->nEvents;
+        struct ncrm_Event * taken = inbox->events;
+        const unsigned int nTakenAllocated = inbox->nAllocated;
+        inbox->events = events;
+        inbox->nAllocated = nAllocated;
+        inbox->nEvents = inbox->nPlain = 0;
+        events = taken;
+        nAllocated = nTakenAllocated;
+        const uint8_t nBack = inbox->nBack;
+        pthread_mutex_unlock(&gRenderer.lock);
+
+        struct timespec started, finished;
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        int rc = ext->prepare(ext, events, nEvents, nBack);
+        clock_gettime(CLOCK_MONOTONIC, &finished);
+        for( unsigned int i = 0; i < nEvents; ++i )
+            ncrm_payload_unref(ncrm_event_payload(events + i));
+
+        pthread_mutex_lock(&gRenderer.lock);
+        ncrm_lh_add_interval(&inbox->prepareLatency, &started, &finished);
+        if( !rc ) continue;  /* nothing to present */
+        /* front buffer was presented before this prepare (see
+         * `_next_pending()`), publish the back one */
+        inbox->nReady = nBack;
+        inbox->nBack = nBack ? 0 : 1;
+        /* wake main thread; main thread posts events while holding queue
+         * lock, so enqueueing is done without renderer lock to not
+         * deadlock */
+        pthread_mutex_unlock(&gRenderer.lock);
+        struct ncrm_Event readyEvent = { ncrm_kEventExtensionReady };
+        readyEvent.payload.forExtension.extensionID = nExt;
+        ncrm_enqueue_from(&gRenderer.producer, &readyEvent);
+        pthread_mutex_lock(&gRenderer.lock);
+    }
+    pthread_mutex_unlock(&gRenderer.lock);
+    free(events);
+    return NULL;
+}
+
+void
+ncrm_renderer_init( struct ncrm_Extension ** extensions ) {
+    gRenderer.extensions = extensions;
+    gRenderer.nExtensions = 0;
+    for( struct ncrm_Extension ** extPtr = extensions
+       ; *extPtr
+       ; ++extPtr ) ++gRenderer.nExtensions;
+    gRenderer.inboxes = calloc( gRenderer.nExtensions
+                              , sizeof(struct RendererInbox) );
+    for( uint16_t nExt = 0; nExt < gRenderer.nExtensions; ++nExt )
+        gRenderer.inboxes[nExt].nReady = -1;
+    ncrm_producer_init( &gRenderer.producer, "renderer"
+                      , ncrm_kOverflowBlock, 1000 );
+    pthread_mutex_init(&gRenderer.lock, NULL);
+    pthread_cond_init(&gRenderer.cv, NULL);
+    gRenderer.keepGoing = 0x1;
+    pthread_create(&gRenderer.thread, NULL, _render_thread, NULL);
+}
+
+void
+ncrm_renderer_free() {
+    pthread_mutex_lock(&gRenderer.lock);
+    gRenderer.keepGoing = 0x0;
+    pthread_cond_broadcast(&gRenderer.cv);
+    pthread_mutex_unlock(&gRenderer.lock);
+    pthread_join(gRenderer.thread, NULL);
+    pthread_cond_destroy(&gRenderer.cv);
+    pthread_mutex_destroy(&gRenderer.lock);
+    for( uint16_t nExt = 0; nExt < gRenderer.nExtensions; ++nExt ) {
+        struct RendererInbox * inbox = gRenderer.inboxes + nExt;
+        for( unsigned int i = 0; i < inbox->nEvents; ++i )
+            ncrm_payload_unref(ncrm_event_payload(inbox->events + i));
+        free(inbox->events);
+    }
+    free(gRenderer.inboxes);
+    gRenderer.inboxes = NULL;
+}
+
+int
+ncrm_renderer_post( uint16_t nExt, const struct ncrm_Event * event ) {
+    assert( nExt < gRenderer.nExtensions );
+    assert( gRenderer.extensions[nExt]->prepare );
+    int rc = 0;
+    pthread_mutex_lock(&gRenderer.lock); {
+        struct RendererInbox * inbox = gRenderer.inboxes + nExt;
+        struct ncrm_Payload * payload = ncrm_event_payload(event);
+        struct ncrm_Event * slot = NULL;
+        if( ncrm_kEventKeypress != event->type && !payload ) {
+            /* coalesce with pending event of the same type */
+            for( unsigned int i = 0; i < inbox->nEvents; ++i ) {
+                if( inbox->events[i].type == event->type
+                 && !ncrm_event_payload(inbox->events + i) ) {
+                    slot = inbox->events + i;
+                    break;
+                }
+            }
+        }
+        /* events with payload are kept all, in order: they carry data
+         * (like journal entries) that would be lost otherwise */
+        if( !slot && ( payload || inbox->nPlain < NCRM_RENDERER_MAX_EVENTS ) ) {
+            if( inbox->nEvents == inbox->nAllocated ) {
+                inbox->nAllocated = inbox->nAllocated
+                                  ? inbox->nAllocated*2
+                                  : NCRM_RENDERER_MAX_EVENTS;
+                inbox->events = realloc( inbox->events
+                                       , inbox->nAllocated*sizeof(struct ncrm_Event) );
+                assert(inbox->events);
+            }
+            slot = inbox->events + inbox->nEvents++;
+            if( !payload ) ++inbox->nPlain;
+        }
+        if( slot ) {
+            memcpy(slot, event, sizeof(struct ncrm_Event));
+            ncrm_payload_ref(payload);
+            pthread_cond_broadcast(&gRenderer.cv);
+        } else {
+            rc = 1;
+        }
+    } pthread_mutex_unlock(&gRenderer.lock);
+    return rc;
+}
+
+void
+ncrm_renderer_activate( uint16_t nExt, int active ) {
+    assert( nExt < gRenderer.nExtensions );
+    pthread_mutex_lock(&gRenderer.lock);
+    gRenderer.inboxes[nExt].active = active ? 0x1 : 0x0;
+    pthread_cond_broadcast(&gRenderer.cv);
+    pthread_mutex_unlock(&gRenderer.lock);
+}
+
+int
+ncrm_renderer_ready( uint16_t nExt ) {
+    assert( nExt < gRenderer.nExtensions );
+    int nReady;
+    pthread_mutex_lock(&gRenderer.lock);
+    nReady = gRenderer.inboxes[nExt].nReady;
+    pthread_mutex_unlock(&gRenderer.lock);
+    return nReady;
+}
+
+void
+ncrm_renderer_presented( uint16_t nExt ) {
+    assert( nExt < gRenderer.nExtensions );
+    pthread_mutex_lock(&gRenderer.lock);
+    gRenderer.inboxes[nExt].nReady = -1;
+    pthread_cond_broadcast(&gRenderer.cv);
+    pthread_mutex_unlock(&gRenderer.lock);
+}
+
+void
+ncrm_renderer_latency( uint16_t nExt, struct ncrm_LatencyHistogram * dest ) {
+    assert( nExt < gRenderer.nExtensions );
+    pthread_mutex_lock(&gRenderer.lock);
+    memcpy(dest, &gRenderer.inboxes[nExt].prepareLatency, sizeof(*dest));
+    pthread_mutex_unlock(&gRenderer.lock);
+}
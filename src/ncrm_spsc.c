@@ -0,0 +1,126 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "ncrm_spsc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <sched.h>
+
+/** Number of retries before blocking push/pop goes to sleep */
+#define NCRM_SPSC_SPIN 64
+
+void
+ncrm_spsc_init( struct ncrm_SPSCQueue * q, size_t capacity ) {
+    size_t size = 1;
+    while( size < capacity ) size <<= 1;
+    q->items = malloc(size*sizeof(void *));
+    assert(q->items);
+    q->mask = size - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->nSleeping, 0);
+    atomic_init(&q->closed, 0);
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cv, NULL);
+}
+
+void
+ncrm_spsc_free( struct ncrm_SPSCQueue * q ) {
+    pthread_cond_destroy(&q->cv);
+    pthread_mutex_destroy(&q->lock);
+    free(q->items);
+    q->items = NULL;
+}
+
+/* Wakes up other side, if it sleeps. Sleeper announces itself before
+ * re-checking the queue, so either it sees the change, or it is seen
+ * here (both sides use sequentially consistent operations) */
+static void
+_wake( struct ncrm_SPSCQueue * q ) {
+    if( !atomic_load(&q->nSleeping) ) return;
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_broadcast(&q->cv);
+    pthread_mutex_unlock(&q->lock);
+}
+
+int
+ncrm_spsc_try_push( struct ncrm_SPSCQueue * q, void * item ) {
+    const size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if( tail - atomic_load(&q->head) > q->mask ) return 1;  /* full */
+    q->items[tail & q->mask] = item;
+    atomic_store(&q->tail, tail + 1);
+    _wake(q);
+    return 0;
+}
+
+int
+ncrm_spsc_try_pop( struct ncrm_SPSCQueue * q, void ** item ) {
+    const size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if( head == atomic_load(&q->tail) ) return 1;  /* empty */
+    *item = q->items[head & q->mask];
+    atomic_store(&q->head, head + 1);
+    _wake(q);
+    return 0;
+}
+
+int
+ncrm_spsc_push( struct ncrm_SPSCQueue * q, void * item ) {
+    for( int nSpin = 0; nSpin < NCRM_SPSC_SPIN; ++nSpin ) {
+        if( !ncrm_spsc_try_push(q, item) ) return 0;
+        sched_yield();
+    }
+    while( ncrm_spsc_try_push(q, item) ) {
+        pthread_mutex_lock(&q->lock);
+        atomic_fetch_add(&q->nSleeping, 1);
+        while( !atomic_load(&q->closed)
+            && atomic_load(&q->tail) - atomic_load(&q->head) > q->mask )
+            pthread_cond_wait(&q->cv, &q->lock);
+        atomic_fetch_sub(&q->nSleeping, 1);
+        pthread_mutex_unlock(&q->lock);
+        if( atomic_load(&q->closed) ) return 1;
+    }
+    return 0;
+}
+
+int
+ncrm_spsc_pop( struct ncrm_SPSCQueue * q, void ** item ) {
+    for( int nSpin = 0; nSpin < NCRM_SPSC_SPIN; ++nSpin ) {
+        if( !ncrm_spsc_try_pop(q, item) ) return 0;
+        sched_yield();
+    }
+    while( ncrm_spsc_try_pop(q, item) ) {
+        pthread_mutex_lock(&q->lock);
+        atomic_fetch_add(&q->nSleeping, 1);
+        while( !atomic_load(&q->closed)
+            && atomic_load(&q->head) == atomic_load(&q->tail) )
+            pthread_cond_wait(&q->cv, &q->lock);
+        atomic_fetch_sub(&q->nSleeping, 1);
+        pthread_mutex_unlock(&q->lock);
+        /* what was pushed before closing is still given */
+        if( atomic_load(&q->closed) ) return ncrm_spsc_try_pop(q, item);
+    }
+    return 0;
+}
+
+void
+ncrm_spsc_close( struct ncrm_SPSCQueue * q ) {
+    pthread_mutex_lock(&q->lock);
+    atomic_store(&q->closed, 1);
+    pthread_cond_broadcast(&q->cv);
+    pthread_mutex_unlock(&q->lock);
+}
@@ -0,0 +1,173 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ncrm_timestampFormat.h"
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+/* Writes zero-padded decimal number, returns ptr past the last char */
+static char *
+_put_uint( char * dest, unsigned long v, int width ) {
+    char bf[24];
+    int n = 0;
+    do { bf[n++] = '0' + v%10; v /= 10; } while(v);
+    while( n < width ) bf[n++] = '0';
+    while( n ) *dest++ = bf[--n];
+    return dest;
+}
+
+static int
+_append_literal( struct ncrm_JournalTimestampFormat * fmt
+               , uint8_t * nLiterals
+               , char c ) {
+    if( *nLiterals == NCRM_TIMESTAMP_FORMAT_MAX_LITERALS ) return -1;
+    struct ncrm_TimestampFormatOp * last = fmt->nOps ? fmt->ops + fmt->nOps - 1 : NULL;
+    if( !(last && !last->code && last->litOffset + last->litLen == *nLiterals) ) {
+        /* start new literal operation */
+        if( fmt->nOps == NCRM_TIMESTAMP_FORMAT_MAX_OPS ) return -1;
+        last = fmt->ops + fmt->nOps++;
+        last->code = 0;
+        last->litOffset = *nLiterals;
+        last->litLen = 0;
+    }
+    fmt->literals[(*nLiterals)++] = c;
+    ++last->litLen;
+    return 0;
+}
+
+int
+ncrm_tsf_compile( struct ncrm_JournalTimestampFormat * fmt
+                , const char * spec
+                , enum ncrm_TimestampMode mode ) {
+    bzero(fmt, sizeof(struct ncrm_JournalTimestampFormat));
+    fmt->callback = ncrm_tsf_format;
+    fmt->reference = 0;
+    ncrm_tsf_set_mode(fmt, mode);
+    uint8_t nLiterals = 0
+          , inPrefix = 1
+          ;
+    for( const char * c = spec; *c; ++c ) {
+        if( '%' != *c || '%' == c[1] ) {
+            if( _append_literal(fmt, &nLiterals, *c) ) return -1;
+            if( '%' == *c ) ++c;
+        } else {
+            ++c;
+            switch( *c ) {
+                case 'D':
+                    fmt->hasDays = 1;
+                    /* fall through */
+                case 'H':
+                case 'M':
+                    break;
+                case 'S':
+                case 'f':
+                    inPrefix = 0;
+                    break;
+                default:
+                    return -1;  /* unsupported conversion */
+            };
+            if( fmt->nOps == NCRM_TIMESTAMP_FORMAT_MAX_OPS ) return -1;
+            fmt->ops[fmt->nOps++].code = *c;
+        }
+        if( inPrefix ) fmt->nPrefixOps = fmt->nOps;
+    }
+    return 0;
+}
+
+void
+ncrm_tsf_set_mode( struct ncrm_JournalTimestampFormat * fmt
+                 , enum ncrm_TimestampMode mode ) {
+    fmt->mode = mode;
+    fmt->prefixMinute = ULONG_MAX;
+    fmt->prefixLen = 0;
+}
+
+/* Writes result of a single operation for value of `v` msec */
+static char *
+_put_op( const struct ncrm_JournalTimestampFormat * fmt
+       , const struct ncrm_TimestampFormatOp * op
+       , unsigned long v
+       , struct tm ** tmPtr, struct tm * tmBuf
+       , char * dest ) {
+    if( !op->code ) {
+        memcpy(dest, fmt->literals + op->litOffset, op->litLen);
+        return dest + op->litLen;
+    }
+    if( 'S' == op->code ) return _put_uint(dest, (v/1000)%60, 2);
+    if( 'f' == op->code ) return _put_uint(dest, v%1000, 3);
+    if( ncrm_kTimestampWallClock == fmt->mode ) {
+        if( !*tmPtr ) {
+            time_t t = v/1000;
+            *tmPtr = localtime_r(&t, tmBuf);
+        }
+        switch( op->code ) {
+            case 'D': return _put_uint(dest, (*tmPtr)->tm_mday, 2);
+            case 'H': return _put_uint(dest, (*tmPtr)->tm_hour, 2);
+            case 'M': return _put_uint(dest, (*tmPtr)->tm_min, 2);
+        };
+    } else {
+        switch( op->code ) {
+            case 'D': return _put_uint(dest, v/(24*60*60*1000UL), 0);
+            case 'H': return _put_uint(dest, fmt->hasDays ? (v/(60*60*1000UL))%24
+                                                          :  v/(60*60*1000UL), 2);
+            case 'M': return _put_uint(dest, (v/(60*1000UL))%60, 2);
+        };
+    }
+    assert(0);  /* unsupported op code (shall be denied by compile) */
+    return dest;
+}
+
+uint16_t
+ncrm_tsf_format( struct ncrm_JournalTimestampFormat * fmt
+               , char * dest
+               , ncrm_Timestamp_t timest
+               , ncrm_Timestamp_t prevTimest ) {
+    unsigned long v;
+    switch( fmt->mode ) {
+        case ncrm_kTimestampRelative:
+            v = timest > fmt->reference ? timest - fmt->reference : 0;
+            break;
+        case ncrm_kTimestampElapsed:
+            v = (NCRM_TIMESTAMP_NONE == prevTimest || prevTimest > timest)
+              ? 0 : timest - prevTimest;
+            break;
+        default:
+            v = timest;
+    };
+    struct tm tmBuf, * tmPtr = NULL;
+    char * c = dest;
+    const unsigned long minute = v/(60*1000UL);
+    if( fmt->nPrefixOps ) {
+        if( minute == fmt->prefixMinute ) {
+            /* high-order part did not change */
+            memcpy(c, fmt->prefix, fmt->prefixLen);
+            c += fmt->prefixLen;
+        } else {
+            for( uint8_t i = 0; i < fmt->nPrefixOps; ++i )
+                c = _put_op(fmt, fmt->ops + i, v, &tmPtr, &tmBuf, c);
+            if( c - dest <= NCRM_TIMESTAMP_FORMAT_MAX_PREFIX ) {
+                fmt->prefixLen = c - dest;
+                memcpy(fmt->prefix, dest, fmt->prefixLen);
+                fmt->prefixMinute = minute;
+            }
+        }
+    }
+    for( uint8_t i = fmt->nPrefixOps; i < fmt->nOps; ++i )
+        c = _put_op(fmt, fmt->ops + i, v, &tmPtr, &tmBuf, c);
+    return c - dest;
+}
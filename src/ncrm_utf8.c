@@ -0,0 +1,131 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE 700  /* wcwidth() */
+
+#include "ncrm_utf8.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#define _ONES  0x0101010101010101ULL
+#define _HIGHS 0x8080808080808080ULL
+/* non-zero if any byte of the word is zero */
+#define _has_zero(w) (((w) - _ONES) & ~(w) & _HIGHS)
+/* non-zero if word has any byte stopping ASCII run: non-ASCII, newline or
+ * null */
+#define _has_stop(w) (((w) & _HIGHS) | _has_zero(w) | _has_zero((w) ^ (_ONES*'\n')))
+
+size_t
+ncrm_u8_ascii_run( const char * s, size_t nBytes ) {
+    const char * c = s, * end = s + nBytes;
+    /* bytewise till the word boundary */
+    for( ; c < end && ((uintptr_t) c) & (sizeof(uint64_t) - 1); ++c ) {
+        if( (*c & 0x80) || '\n' == *c || '\0' == *c ) return c - s;
+    }
+    /* word per iteration, never reading past `nBytes` */
+    for( ; end - c >= (ptrdiff_t) sizeof(uint64_t); c += sizeof(uint64_t) ) {
+        uint64_t w;
+        memcpy(&w, c, sizeof(w));
+        if( _has_stop(w) ) break;
+    }
+    /* locate the stop byte within the word or the tail */
+    for( ; c < end && !((*c & 0x80) || '\n' == *c || '\0' == *c); ++c ) {}
+    return c - s;
+}
+
+/* Decodes UTF-8 char of at most `nBytes` bytes, see `ncrm_u8_next()` */
+static int
+_u8_next( const char * s, size_t nBytes, int * width ) {
+    const unsigned char * c = (const unsigned char *) s;
+    wchar_t wc;
+    int n;
+    if( c[0] < 0x80 ) {
+        *width = 1;
+        return 1;
+    } else if( (c[0] & 0xE0) == 0xC0 ) {
+        wc = c[0] & 0x1F; n = 2;
+    } else if( (c[0] & 0xF0) == 0xE0 ) {
+        wc = c[0] & 0x0F; n = 3;
+    } else if( (c[0] & 0xF8) == 0xF0 ) {
+        wc = c[0] & 0x07; n = 4;
+    } else {
+        *width = 1;  /* stray byte */
+        return 1;
+    }
+    for( int i = 1; i < n; ++i ) {
+        if( (size_t) i >= nBytes || (c[i] & 0xC0) != 0x80 ) {
+            *width = 1;  /* truncated sequence */
+            return 1;
+        }
+        wc = (wc << 6) | (c[i] & 0x3F);
+    }
+    *width = wcwidth(wc);
+    if( *width < 0 ) *width = 1;  /* non-printable */
+    return n;
+}
+
+int
+ncrm_u8_next( const char * s, int * width ) {
+    /* null-terminated: sequence is cut by the null, at the latest */
+    return _u8_next(s, 4, width);
+}
+
+size_t
+ncrm_u8_width( const char * s, size_t nBytes ) {
+    size_t cols = 0;
+    const char * c = s, * end = s + nBytes;
+    while( c < end && *c ) {
+        size_t n = ncrm_u8_ascii_run(c, end - c);
+        if( n ) {
+            c += n;
+            cols += n;
+            continue;
+        }
+        if( '\n' == *c ) {
+            ++c;
+            ++cols;
+            continue;
+        }
+        int w;
+        c += _u8_next(c, end - c, &w);
+        cols += w;
+    }
+    return cols;
+}
+
+size_t
+ncrm_u8_fit( const char * s, size_t nBytes, size_t maxCols, size_t * cols_ ) {
+    size_t cols = 0;
+    const char * c = s, * end = s + nBytes;
+    while( cols < maxCols && c < end && *c && '\n' != *c ) {
+        /* ASCII char takes single column */
+        size_t n = ncrm_u8_ascii_run( c, (size_t) (end - c) < maxCols - cols
+                                         ? (size_t) (end - c) : maxCols - cols );
+        if( n ) {
+            c += n;
+            cols += n;
+            continue;
+        }
+        int w, nCharBytes = _u8_next(c, end - c, &w);
+        if( cols + w > maxCols ) break;  /* wide char does not fit */
+        c += nCharBytes;
+        cols += w;
+    }
+    if( cols_ ) *cols_ = cols;
+    return c - s;
+}
@@ -0,0 +1,122 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Producer blocking with no time limit (like journal's appender) must not
+ * lose any update with payload while data ring stays full, however long
+ * consumer lags, and must sleep meanwhile; once cancelled, it must give up
+ * waiting */
+
+#include "ncrm_queue.h"
+#include "ncrm_payload.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+static int gNFailed = 0;
+
+#define CHECK(cond) if( !(cond) ) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        ++gNFailed; }
+
+/* Number of updates sent, several times the data ring capacity */
+#define N_UPDATES (4*NCRM_MAX_DATA_EVENTS)
+
+static struct ncrm_Producer gProducer;
+
+/* Sends updates carrying their sequence numbers */
+static void *
+_produce( void * nUpdates_ ) {
+    const unsigned long nUpdates = *(const unsigned long *) nUpdates_;
+    for( unsigned long i = 0; i < nUpdates; ++i ) {
+        struct ncrm_Event event = { ncrm_kEventExtension };
+        event.payload.forExtension.data
+            = ncrm_payload_new(sizeof(unsigned long), NULL);
+        *(unsigned long *) ncrm_payload_data(event.payload.forExtension.data) = i;
+        if( ncrm_enqueue_from(&gProducer, &event) ) break;
+    }
+    return NULL;
+}
+
+/* Waits (up to a few seconds) till data ring is full */
+static int
+_wait_full_ring() {
+    static const struct timespec pause = { 0, 1000000L };
+    for( int i = 0; i < 5000; ++i ) {
+        struct ncrm_QueueStats qs;
+        ncrm_queue_stats(&qs);
+        if( qs.depth[ncrm_kEventClassData] == qs.capacity[ncrm_kEventClassData] )
+            return 1;
+        nanosleep(&pause, NULL);
+    }
+    return 0;
+}
+
+/* Checks updates come in order, counting them */
+static void
+_consume( struct ncrm_Event * event, void * nReceived_ ) {
+    unsigned long * nReceived = nReceived_;
+    struct ncrm_Payload * payload = ncrm_event_payload(event);
+    CHECK( payload );
+    if( !payload ) return;
+    CHECK( *nReceived == *(unsigned long *) ncrm_payload_data(payload) );
+    ++*nReceived;
+}
+
+int
+main(int argc, char * argv[]) {
+    ncrm_queue_init();
+    ncrm_producer_init(&gProducer, "test", ncrm_kOverflowBlock, 0);
+    pthread_t producer;
+
+    /* consumer lags longer than any finite timeout would reasonably be */
+    unsigned long nUpdates = N_UPDATES, nReceived = 0;
+    pthread_create(&producer, NULL, _produce, &nUpdates);
+    CHECK( _wait_full_ring() );
+    struct timespec cpuBefore, cpuAfter;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuBefore);
+    static const struct timespec lag = { 1, 500000000L };
+    nanosleep(&lag, NULL);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuAfter);
+    /* waiting producer does not poll the ring (less than 1% of CPU) */
+    CHECK( (cpuAfter.tv_sec - cpuBefore.tv_sec)*1000000000L
+         + (cpuAfter.tv_nsec - cpuBefore.tv_nsec) < 15000000L );
+    static const struct timespec pause = { 0, 1000000L };
+    for( int i = 0; nReceived < N_UPDATES && i < 5000; ++i ) {
+        if( !ncrm_do_with_events_nowait(_consume, &nReceived) )
+            nanosleep(&pause, NULL);
+    }
+    pthread_join(producer, NULL);
+    CHECK( N_UPDATES == nReceived );
+    CHECK( N_UPDATES == atomic_load(&gProducer.nEnqueued) );
+    CHECK( 0 == atomic_load(&gProducer.nDropped) );
+
+    /* consumer stops draining: cancelled producer drops the update it was
+     * blocked on */
+    nUpdates = NCRM_MAX_DATA_EVENTS + 1;
+    pthread_create(&producer, NULL, _produce, &nUpdates);
+    CHECK( _wait_full_ring() );
+    ncrm_producer_cancel(&gProducer);
+    pthread_join(producer, NULL);
+    CHECK( 1 == atomic_load(&gProducer.nDropped) );
+
+    ncrm_queue_free();
+    if( gNFailed ) {
+        fprintf(stderr, "%d check(s) failed.\n", gNFailed);
+        return 1;
+    }
+    return 0;
+}
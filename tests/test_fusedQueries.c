@@ -0,0 +1,83 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Fused query of several views must select for every view exactly what
+ * its own query does, whatever bounds other views have */
+
+#include "ncrm_journalEntries.h"
+
+#include <limits.h>
+#include <stdio.h>
+
+static int gNFailed = 0;
+
+#define CHECK(cond) if( !(cond) ) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        ++gNFailed; }
+
+static struct ncrm_JournalEntry gEntries[] = {
+    {  10, 100, 0, "a", "first"  },
+    {  50, 300, 0, "a", "second" },
+    { 150, 500, 0, "b", "third"  },
+    { 300, 700, 0, "b", "fourth" },
+};
+static const unsigned long gNEntries = sizeof(gEntries)/sizeof(*gEntries);
+
+/* Selects entries with two queries (in given order) and checks number of
+ * entries each one got */
+static void
+_check_two_views( const struct ncrm_QueryParams * q1, unsigned long n1
+                , const struct ncrm_QueryParams * q2, unsigned long n2 ) {
+    struct ncrm_JournalSelection sel1, sel2;
+    ncrm_je_selection_init(&sel1);
+    ncrm_je_selection_init(&sel2);
+    const struct ncrm_QueryParams * qps[2] = { q1, q2 };
+    struct ncrm_JournalSelection * dests[2] = { &sel1, &sel2 };
+    unsigned long nCommon[2];
+    ncrm_je_select(gEntries, gNEntries, qps, dests, nCommon, 2);
+    CHECK( n1 == sel1.n );
+    CHECK( n2 == sel2.n );
+    ncrm_je_selection_free(&sel1);
+    ncrm_je_selection_free(&sel2);
+}
+
+int
+main(int argc, char * argv[]) {
+    const struct ncrm_QueryParams unbounded = { NULL, NULL, { -1, -1 }
+                                              , { ULONG_MAX, ULONG_MAX } }
+                                , after100  = { NULL, NULL, { -1, -1 }
+                                              , { 100, ULONG_MAX } }
+                                , before100 = { NULL, NULL, { -1, -1 }
+                                              , { ULONG_MAX, 100 } }
+                                , levels    = { NULL, NULL, { 200, 600 }
+                                              , { ULONG_MAX, ULONG_MAX } }
+                                ;
+    /* lower time bound of one view must not cut entries of the other */
+    _check_two_views(&after100, 2, &unbounded, 4);
+    _check_two_views(&unbounded, 4, &after100, 2);
+    /* same for upper time bound and levels */
+    _check_two_views(&before100, 2, &unbounded, 4);
+    _check_two_views(&unbounded, 4, &before100, 2);
+    _check_two_views(&levels, 2, &unbounded, 4);
+    _check_two_views(&unbounded, 4, &levels, 2);
+    /* disjoint bounds */
+    _check_two_views(&after100, 2, &before100, 2);
+    if( gNFailed ) {
+        fprintf(stderr, "%d check(s) failed.\n", gNFailed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,299 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Values written with `ncrm_mp_write_*()` must be read back by
+ * `ncrm_mp_read_*()` and skipped by `ncrm_mp_skip()` in every format
+ * width. Reader parses network input, so truncated and malformed data and
+ * too deep nesting must be rejected, leaving cursor unchanged */
+
+#include "ncrm_msgpack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int gNFailed = 0;
+
+#define CHECK(cond) if( !(cond) ) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        ++gNFailed; }
+
+/* Readers of a single value, for checks common for all types */
+typedef int (*Reader)(struct ncrm_MsgpackCursor *);
+
+static int
+_read_uint( struct ncrm_MsgpackCursor * c ) {
+    uint64_t v;
+    return ncrm_mp_read_uint(c, &v);
+}
+
+static int
+_read_int( struct ncrm_MsgpackCursor * c ) {
+    int64_t v;
+    return ncrm_mp_read_int(c, &v);
+}
+
+static int
+_read_str( struct ncrm_MsgpackCursor * c ) {
+    const char * s;
+    uint32_t len;
+    return ncrm_mp_read_str(c, &s, &len);
+}
+
+static int
+_read_map( struct ncrm_MsgpackCursor * c ) {
+    uint32_t n;
+    return ncrm_mp_read_map(c, &n);
+}
+
+static int
+_read_array( struct ncrm_MsgpackCursor * c ) {
+    uint32_t n;
+    return ncrm_mp_read_array(c, &n);
+}
+
+/* Checks that reader fails on every prefix of encoded value shorter than
+ * `nNeeded` bytes (for long strings, on the shortest and the longest ones
+ * only), leaving cursor unchanged; skip is checked on every prefix of the
+ * whole encoded value */
+static void
+_check_truncated( const struct ncrm_MsgpackBuffer * b, size_t nNeeded
+                , Reader read ) {
+    for( size_t n = 0; n < b->size; ++n ) {
+        if( n > 16 && n + 16 < b->size ) continue;
+        struct ncrm_MsgpackCursor c;
+        ncrm_mp_cursor_init(&c, b->data, n);
+        if( n < nNeeded ) {
+            CHECK( read(&c) );
+            CHECK( c.cur == b->data );
+        }
+        CHECK( ncrm_mp_skip(&c) );
+        CHECK( c.cur == b->data );
+    }
+}
+
+/* Checks that value is skipped as a whole */
+static void
+_check_skip( const struct ncrm_MsgpackBuffer * b ) {
+    struct ncrm_MsgpackCursor c;
+    ncrm_mp_cursor_init(&c, b->data, b->size);
+    CHECK( !ncrm_mp_skip(&c) );
+    CHECK( ncrm_mp_at_end(&c) );
+}
+
+static void
+_check_uints() {
+    static const struct { uint64_t v; size_t size; } cases[] = {
+        { 0, 1 }, { 0x7f, 1 },
+        { 0x80, 2 }, { 0xff, 2 },
+        { 0x100, 3 }, { 0xffff, 3 },
+        { 0x10000, 5 }, { 0xffffffffULL, 5 },
+        { 0x100000000ULL, 9 }, { INT64_MAX, 9 }, { UINT64_MAX, 9 },
+    };
+    struct ncrm_MsgpackBuffer b;
+    ncrm_mp_buffer_init(&b);
+    for( size_t i = 0; i < sizeof(cases)/sizeof(*cases); ++i ) {
+        ncrm_mp_buffer_reset(&b);
+        ncrm_mp_write_uint(&b, cases[i].v);
+        CHECK( cases[i].size == b.size );
+        struct ncrm_MsgpackCursor c;
+        uint64_t u;
+        ncrm_mp_cursor_init(&c, b.data, b.size);
+        CHECK( !ncrm_mp_read_uint(&c, &u) && cases[i].v == u );
+        CHECK( ncrm_mp_at_end(&c) );
+        /* as signed, unless it does not fit */
+        int64_t v;
+        ncrm_mp_cursor_init(&c, b.data, b.size);
+        if( cases[i].v <= INT64_MAX ) {
+            CHECK( !ncrm_mp_read_int(&c, &v) && (int64_t) cases[i].v == v );
+        } else {
+            CHECK( ncrm_mp_read_int(&c, &v) && c.cur == b.data );
+        }
+        _check_skip(&b);
+        _check_truncated(&b, b.size, _read_uint);
+    }
+    ncrm_mp_buffer_free(&b);
+}
+
+static void
+_check_ints() {
+    static const struct { int64_t v; size_t size; } cases[] = {
+        { -1, 1 }, { -32, 1 },
+        { -33, 2 }, { INT8_MIN, 2 },
+        { INT8_MIN - 1, 3 }, { INT16_MIN, 3 },
+        { INT16_MIN - 1, 5 }, { INT32_MIN, 5 },
+        { INT32_MIN - 1LL, 9 }, { INT64_MIN, 9 },
+        /* non-negative ones use unsigned formats */
+        { 0, 1 }, { INT64_MAX, 9 },
+    };
+    struct ncrm_MsgpackBuffer b;
+    ncrm_mp_buffer_init(&b);
+    for( size_t i = 0; i < sizeof(cases)/sizeof(*cases); ++i ) {
+        ncrm_mp_buffer_reset(&b);
+        ncrm_mp_write_int(&b, cases[i].v);
+        CHECK( cases[i].size == b.size );
+        struct ncrm_MsgpackCursor c;
+        int64_t v;
+        ncrm_mp_cursor_init(&c, b.data, b.size);
+        CHECK( !ncrm_mp_read_int(&c, &v) && cases[i].v == v );
+        CHECK( ncrm_mp_at_end(&c) );
+        /* negative ones are not read as unsigned */
+        uint64_t u;
+        ncrm_mp_cursor_init(&c, b.data, b.size);
+        if( cases[i].v < 0 ) {
+            CHECK( ncrm_mp_read_uint(&c, &u) && c.cur == b.data );
+        } else {
+            CHECK( !ncrm_mp_read_uint(&c, &u) && (uint64_t) cases[i].v == u );
+        }
+        _check_skip(&b);
+        _check_truncated(&b, b.size, _read_int);
+    }
+    ncrm_mp_buffer_free(&b);
+}
+
+static void
+_check_strs() {
+    static const struct { uint32_t len; size_t nHeader; } cases[] = {
+        { 0, 1 }, { 31, 1 },
+        { 32, 2 }, { UINT8_MAX, 2 },
+        { UINT8_MAX + 1, 3 }, { UINT16_MAX, 3 },
+        { UINT16_MAX + 1, 5 },
+    };
+    struct ncrm_MsgpackBuffer b;
+    ncrm_mp_buffer_init(&b);
+    char * s = malloc(UINT16_MAX + 1);
+    for( uint32_t i = 0; i <= UINT16_MAX; ++i ) s[i] = 'a' + i%26;
+    for( size_t i = 0; i < sizeof(cases)/sizeof(*cases); ++i ) {
+        ncrm_mp_buffer_reset(&b);
+        ncrm_mp_write_str(&b, s, cases[i].len);
+        CHECK( cases[i].nHeader + cases[i].len == b.size );
+        struct ncrm_MsgpackCursor c;
+        const char * ptr;
+        uint32_t len;
+        ncrm_mp_cursor_init(&c, b.data, b.size);
+        CHECK( !ncrm_mp_read_str(&c, &ptr, &len) );
+        CHECK( cases[i].len == len && !memcmp(s, ptr, len) );
+        CHECK( ncrm_mp_at_end(&c) );
+        /* not a number */
+        uint64_t u;
+        ncrm_mp_cursor_init(&c, b.data, b.size);
+        CHECK( ncrm_mp_read_uint(&c, &u) && c.cur == b.data );
+        _check_skip(&b);
+        _check_truncated(&b, b.size, _read_str);
+    }
+    free(s);
+    ncrm_mp_buffer_free(&b);
+}
+
+/* Checks map or array (`isMap`) headers; containers are filled with
+ * integers to be skipped */
+static void
+_check_containers( int isMap ) {
+    static const struct { uint32_t n; size_t nHeader; } cases[] = {
+        { 0, 1 }, { 15, 1 },
+        { 16, 3 }, { UINT16_MAX, 3 },
+        { UINT16_MAX + 1, 5 },
+    };
+    struct ncrm_MsgpackBuffer b;
+    ncrm_mp_buffer_init(&b);
+    for( size_t i = 0; i < sizeof(cases)/sizeof(*cases); ++i ) {
+        ncrm_mp_buffer_reset(&b);
+        if( isMap ) ncrm_mp_write_map(&b, cases[i].n);
+        else ncrm_mp_write_array(&b, cases[i].n);
+        CHECK( cases[i].nHeader == b.size );
+        const uint32_t nItems = isMap ? 2*cases[i].n : cases[i].n;
+        for( uint32_t j = 0; j < nItems; ++j )
+            ncrm_mp_write_int(&b, j%2 ? -1 : 1);
+        struct ncrm_MsgpackCursor c;
+        uint32_t n;
+        ncrm_mp_cursor_init(&c, b.data, b.size);
+        CHECK( !(isMap ? ncrm_mp_read_map : ncrm_mp_read_array)(&c, &n) );
+        CHECK( cases[i].n == n );
+        CHECK( b.data + cases[i].nHeader == c.cur );
+        /* map is not an array and vice versa */
+        ncrm_mp_cursor_init(&c, b.data, b.size);
+        CHECK( (isMap ? ncrm_mp_read_array : ncrm_mp_read_map)(&c, &n) );
+        CHECK( c.cur == b.data );
+        _check_skip(&b);
+        _check_truncated(&b, cases[i].nHeader, isMap ? _read_map : _read_array);
+    }
+    ncrm_mp_buffer_free(&b);
+}
+
+/* Checks that skip accepts nesting up to the limit, and rejects deeper one
+ * leaving cursor unchanged */
+static void
+_check_depth_limit() {
+    struct ncrm_MsgpackBuffer b;
+    ncrm_mp_buffer_init(&b);
+    for( int nLevels = NCRM_MP_MAX_SKIP_DEPTH - 1
+       ; nLevels <= NCRM_MP_MAX_SKIP_DEPTH
+       ; ++nLevels ) {
+        ncrm_mp_buffer_reset(&b);
+        /* {"k": [{"k": [...]}]}, innermost container holds an integer */
+        for( int i = 0; i < nLevels; ++i ) {
+            if( i%2 ) {
+                ncrm_mp_write_array(&b, 1);
+            } else {
+                ncrm_mp_write_map(&b, 1);
+                ncrm_mp_write_str(&b, "k", 1);
+            }
+        }
+        ncrm_mp_write_uint(&b, 1);
+        struct ncrm_MsgpackCursor c;
+        ncrm_mp_cursor_init(&c, b.data, b.size);
+        if( nLevels < NCRM_MP_MAX_SKIP_DEPTH ) {
+            CHECK( !ncrm_mp_skip(&c) && ncrm_mp_at_end(&c) );
+        } else {
+            CHECK( ncrm_mp_skip(&c) && c.cur == b.data );
+        }
+    }
+    ncrm_mp_buffer_free(&b);
+}
+
+/* Checks that never used type code and container claiming more items than
+ * there are are rejected */
+static void
+_check_malformed() {
+    static const uint8_t neverUsed[] = { 0xc1 }
+                       , shortArray[] = { 0x93, 0x01, 0x02 }
+                       , hugeMap[] = { 0xdf, 0xff, 0xff, 0xff, 0xff, 0x01 }
+                       ;
+    struct ncrm_MsgpackCursor c;
+    ncrm_mp_cursor_init(&c, neverUsed, sizeof(neverUsed));
+    CHECK( ncrm_mp_skip(&c) && c.cur == neverUsed );
+    CHECK( _read_int(&c) && c.cur == neverUsed );
+    ncrm_mp_cursor_init(&c, shortArray, sizeof(shortArray));
+    CHECK( ncrm_mp_skip(&c) && c.cur == shortArray );
+    ncrm_mp_cursor_init(&c, hugeMap, sizeof(hugeMap));
+    CHECK( ncrm_mp_skip(&c) && c.cur == hugeMap );
+}
+
+int
+main(int argc, char * argv[]) {
+    _check_uints();
+    _check_ints();
+    _check_strs();
+    _check_containers(1);
+    _check_containers(0);
+    _check_depth_limit();
+    _check_malformed();
+    if( gNFailed ) {
+        fprintf(stderr, "%d check(s) failed.\n", gNFailed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Renderer's inbox must keep every event with payload (like journal's
+ * deltas) while extension can not be prepared: its ready buffer waits to be
+ * presented, or it is in background. All of them must reach `prepare()`, in
+ * order */
+
+#include "ncrm_renderer.h"
+#include "ncrm_extension.h"
+#include "ncrm_payload.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+static int gNFailed = 0;
+
+#define CHECK(cond) if( !(cond) ) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        ++gNFailed; }
+
+/* Number of deltas posted while extension is not prepared, several times
+ * of what inbox used to hold */
+#define N_FLOOD 5000
+
+/* Sequence number of the next delta expected by `prepare()` */
+static atomic_ulong gNPrepared;
+/* Number of deltas that came out of order (set on render thread) */
+static atomic_ulong gNDisordered;
+
+static int
+_prepare( struct ncrm_Extension * ext
+        , const struct ncrm_Event * events, unsigned int nEvents
+        , int nBuffer ) {
+    for( unsigned int i = 0; i < nEvents; ++i ) {
+        struct ncrm_Payload * payload = ncrm_event_payload(events + i);
+        if( !payload ) continue;
+        if( *(unsigned long *) ncrm_payload_data(payload)
+                != atomic_load(&gNPrepared) )
+            atomic_fetch_add(&gNDisordered, 1);
+        atomic_fetch_add(&gNPrepared, 1);
+    }
+    return 1;  /* every buffer has to be presented */
+}
+
+static struct ncrm_Extension gExtension = {
+    "test", 't', NULL,
+    NULL, NULL,
+    _prepare, NULL, NULL,
+    NULL
+};
+
+/* Posts delta with given sequence number */
+static int
+_post_delta( unsigned long seq ) {
+    struct ncrm_Event event = { ncrm_kEventExtension };
+    event.payload.forExtension.data
+        = ncrm_payload_new(sizeof(unsigned long), NULL);
+    *(unsigned long *) ncrm_payload_data(event.payload.forExtension.data) = seq;
+    int rc = ncrm_renderer_post(0, &event);
+    /* inbox took own reference */
+    ncrm_payload_unref(event.payload.forExtension.data);
+    return rc;
+}
+
+static void
+_discard_event( struct ncrm_Event * event, void * _ ) {}
+
+/* Acts as main thread (presents ready buffers, drains "ready" events) till
+ * `prepare()` gets given number of deltas or a few seconds pass; if
+ * `present` is not set, only waits for a buffer to be ready */
+static void
+_run_main( unsigned long nExpected, int present ) {
+    static const struct timespec pause = { 0, 1000000L };
+    for( int i = 0; i < 5000; ++i ) {
+        ncrm_do_with_events_nowait(_discard_event, NULL);
+        if( ncrm_renderer_ready(0) >= 0 ) {
+            if( !present ) return;
+            ncrm_renderer_presented(0);
+        }
+        if( present && atomic_load(&gNPrepared) == nExpected ) return;
+        nanosleep(&pause, NULL);
+    }
+}
+
+int
+main(int argc, char * argv[]) {
+    struct ncrm_Extension * extensions[] = { &gExtension, NULL };
+    ncrm_queue_init();
+    ncrm_renderer_init(extensions);
+    unsigned long nPosted = 0;
+
+    /* active extension: deltas keep coming while its buffer waits to be
+     * presented */
+    ncrm_renderer_activate(0, 1);
+    CHECK( !_post_delta(nPosted++) );
+    _run_main(nPosted, 0);
+    CHECK( ncrm_renderer_ready(0) >= 0 );
+    for( int i = 0; i < N_FLOOD; ++i )
+        CHECK( !_post_delta(nPosted++) );
+    _run_main(nPosted, 1);
+    CHECK( nPosted == atomic_load(&gNPrepared) );
+
+    /* background extension keeps its ready buffer till activation */
+    CHECK( !_post_delta(nPosted++) );
+    _run_main(nPosted, 0);
+    ncrm_renderer_activate(0, 0);
+    for( int i = 0; i < N_FLOOD; ++i )
+        CHECK( !_post_delta(nPosted++) );
+    ncrm_renderer_activate(0, 1);
+    _run_main(nPosted, 1);
+    CHECK( nPosted == atomic_load(&gNPrepared) );
+
+    CHECK( 0 == atomic_load(&gNDisordered) );
+    ncrm_renderer_free();
+    ncrm_queue_free();
+    if( gNFailed ) {
+        fprintf(stderr, "%d check(s) failed.\n", gNFailed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,599 @@
+/* Copyright (C) 2022, Renat R. Dusaev
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Synthetic load generator for journal extension: publishes journal messages
+ * (see `ncrm_JournalExtensionConfig` for the protocol) at given rate, with
+ * given level mix, categories, lateness and bursts. Messages are generated
+ * from seed and timestamped by schedule (not by clock), so the same options
+ * produce the same stream. Optionally serves snapshot and resend requests,
+ * captures published frames to a file and replays captured sessions with
+ * their original timing. */
+
+#include "ncrm_msgpack.h"
+
+#include <zmq.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Number of messages kept for snapshot and resend requests */
+#define NCRM_LOADGEN_HISTORY (1 << 16)
+/** Max number of entries in a message of snapshot reply */
+#define NCRM_LOADGEN_SNAPSHOT_CHUNK 1024
+/** Max number of levels in mix */
+#define NCRM_LOADGEN_MAX_LEVELS 16
+/** Period status items are published with, msec */
+#define NCRM_LOADGEN_STATUS_PERIOD_MSEC 1000
+/** Messages sent between polls of service socket when not waiting */
+#define NCRM_LOADGEN_POLL_EVERY 64
+
+/** Generated journal entry; message text is derived from its number */
+struct GenEntry {
+    uint64_t timest;
+    int32_t level;
+    uint32_t nCategory;
+};
+
+static struct {
+    /* options */
+    const char * pubAddress, * serviceAddress
+             , * capturePath, * replayPath
+             ;
+    double rate;
+    unsigned int entriesPerMsg, textLen, nCategories;
+    unsigned long nMessages;
+    unsigned int maxLateness;
+    unsigned int burstSize, burstPeriod;
+    unsigned int dropEvery;
+    unsigned int startDelay;
+    uint64_t seed;
+    int withTopics;
+    int32_t levels[NCRM_LOADGEN_MAX_LEVELS];
+    unsigned int weights[NCRM_LOADGEN_MAX_LEVELS], nLevels, totalWeight;
+
+    /* state */
+    void * zmqContext, * publisher, * service;
+    FILE * capture;
+    struct timespec start;
+    uint64_t rng;
+    /** History of generated messages: entries of message of sequence number
+     * `seq` start at `((seq - 1) % NCRM_LOADGEN_HISTORY)*entriesPerMsg` */
+    struct GenEntry * history;
+    uint64_t lastSeq, latest;
+    struct ncrm_MsgpackBuffer buf;
+    char * text;
+    /* counters */
+    unsigned long nSent, nEntriesSent, nDropped, nBytes
+                , nSnapshots, nResent
+                ;
+    volatile sig_atomic_t keepGoing;
+} g;
+
+static void
+_on_signal( int sig ) {
+    (void) sig;
+    g.keepGoing = 0;
+}
+
+/* xorshift64* -- fast and good enough; deterministic for given seed */
+static uint64_t
+_rand() {
+    g.rng ^= g.rng >> 12;
+    g.rng ^= g.rng << 25;
+    g.rng ^= g.rng >> 27;
+    return g.rng * 2685821657736338717ULL;
+}
+
+/* Returns nanoseconds since start */
+static uint64_t
+_elapsed_nsec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - g.start.tv_sec)*1000000000ULL
+         + ts.tv_nsec - g.start.tv_nsec;
+}
+
+/* Sleeps till given time since start, nsec */
+static void
+_sleep_till( uint64_t nsec ) {
+    struct timespec ts = g.start;
+    ts.tv_sec  += nsec/1000000000ULL;
+    ts.tv_nsec += nsec%1000000000ULL;
+    if( ts.tv_nsec >= 1000000000L ) {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000L;
+    }
+    while( EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+        && g.keepGoing ) {}
+}
+
+/* Level class of topic, as journal extension derives it */
+static char
+_level_class( int32_t level ) {
+    if( level <= 0 ) return '0';
+    return level > 800 ? '9' : '0' + (level + 99)/100;
+}
+
+/* Picks level by mix weights */
+static int32_t
+_pick_level() {
+    unsigned int w = _rand()%g.totalWeight;
+    for( unsigned int i = 0; i < g.nLevels; ++i ) {
+        if( w < g.weights[i] ) return g.levels[i];
+        w -= g.weights[i];
+    }
+    return g.levels[g.nLevels - 1];
+}
+
+/* Parses level mix "<level>:<weight>,...". Returns non-zero on error */
+static int
+_parse_level_mix( const char * s ) {
+    g.nLevels = g.totalWeight = 0;
+    while( *s ) {
+        char * end;
+        if( NCRM_LOADGEN_MAX_LEVELS == g.nLevels ) return 1;
+        g.levels[g.nLevels] = strtol(s, &end, 10);
+        if( end == s || ':' != *end ) return 1;
+        s = end + 1;
+        g.weights[g.nLevels] = strtoul(s, &end, 10);
+        if( end == s || (*end && ',' != *end) ) return 1;
+        g.totalWeight += g.weights[g.nLevels++];
+        s = *end ? end + 1 : end;
+    }
+    return g.totalWeight ? 0 : 1;
+}
+
+/* Sends frame of journal message over publisher, writing it to capture
+ * file, if any. Capture record is `[msec since start][size][more][data]`
+ * (host byte order) */
+static void
+_publish_frame( const void * data, size_t size, int more ) {
+    zmq_send(g.publisher, data, size, more ? ZMQ_SNDMORE : 0);
+    g.nBytes += size;
+    if( !g.capture ) return;
+    uint32_t hdr[2] = { _elapsed_nsec()/1000000, size };
+    uint8_t moreFlag = more ? 1 : 0;
+    fwrite(hdr, sizeof(hdr), 1, g.capture);
+    fwrite(&moreFlag, 1, 1, g.capture);
+    fwrite(data, size, 1, g.capture);
+}
+
+/* Fills text buffer with message of entry #`nEntry` */
+static uint32_t
+_entry_text( uint64_t nEntry ) {
+    static const char filler[] = " lorem ipsum dolor sit amet, consectetur"
+                                 " adipiscing elit, sed do eiusmod tempor";
+    int len = snprintf(g.text, g.textLen + 1, "entry #%lu", (unsigned long) nEntry);
+    if( len > (int) g.textLen ) return g.textLen;
+    for( int i = 0; len < (int) g.textLen; ++len, ++i )
+        g.text[len] = filler[i%(sizeof(filler) - 1)];
+    return len;
+}
+
+/* Writes journal entry of history to the buffer */
+static void
+_write_entry( struct ncrm_MsgpackBuffer * b, uint64_t nEntry ) {
+    const struct GenEntry * e = g.history
+            + nEntry%((uint64_t) NCRM_LOADGEN_HISTORY*g.entriesPerMsg);
+    char category[32];
+    int categoryLen = snprintf(category, sizeof(category), "cat%u", e->nCategory);
+    ncrm_mp_write_array(b, 4);
+    ncrm_mp_write_uint(b, e->timest);
+    ncrm_mp_write_int(b, e->level);
+    ncrm_mp_write_str(b, category, categoryLen);
+    ncrm_mp_write_str(b, g.text, _entry_text(nEntry));
+}
+
+/* Writes journal message of given sequence number from history to the
+ * buffer: `{"seq": <seq>, "j": [...]}` */
+static void
+_write_message( struct ncrm_MsgpackBuffer * b, uint64_t seq ) {
+    ncrm_mp_write_map(b, 2);
+    ncrm_mp_write_str(b, "seq", 3);
+    ncrm_mp_write_uint(b, seq);
+    ncrm_mp_write_str(b, "j", 1);
+    ncrm_mp_write_array(b, g.entriesPerMsg);
+    for( unsigned int i = 0; i < g.entriesPerMsg; ++i )
+        _write_entry(b, (seq - 1)*g.entriesPerMsg + i);
+}
+
+/* Generates next message scheduled at given time (msec) and publishes it
+ * (unless it is dropped to imitate a gap) */
+static void
+_generate( uint64_t msec ) {
+    const uint64_t seq = ++g.lastSeq;
+    struct GenEntry * entries = g.history
+            + ((seq - 1)%NCRM_LOADGEN_HISTORY)*g.entriesPerMsg;
+    /* with topics, all entries of message share level and category */
+    const int32_t msgLevel = _pick_level();
+    const uint32_t msgCategory = _rand()%g.nCategories;
+    for( unsigned int i = 0; i < g.entriesPerMsg; ++i ) {
+        struct GenEntry * e = entries + i;
+        e->level = g.withTopics ? msgLevel : _pick_level();
+        e->nCategory = g.withTopics ? msgCategory : _rand()%g.nCategories;
+        const uint64_t lateness = g.maxLateness ? _rand()%(g.maxLateness + 1) : 0;
+        e->timest = msec > lateness ? msec - lateness : 0;
+    }
+    if( msec > g.latest ) g.latest = msec;
+    if( g.dropEvery && 0 == seq%g.dropEvery ) {
+        ++g.nDropped;
+        return;
+    }
+    if( g.withTopics ) {
+        char topic[40];
+        int topicLen = snprintf( topic, sizeof(topic), "%c:cat%u"
+                               , _level_class(msgLevel), msgCategory );
+        _publish_frame(topic, topicLen, 1);
+    }
+    ncrm_mp_buffer_reset(&g.buf);
+    _write_message(&g.buf, seq);
+    _publish_frame(g.buf.data, g.buf.size, 0);
+    ++g.nSent;
+    g.nEntriesSent += g.entriesPerMsg;
+}
+
+/* Publishes status items: `{"status": [...], "progress": [...],
+ * "elapsedTime": ...}` */
+static void
+_publish_status( uint64_t msec ) {
+    char bf[64];
+    int len = snprintf( bf, sizeof(bf), "loadgen: %lu msgs, %lu dropped"
+                      , g.nSent, g.nDropped );
+    ncrm_mp_buffer_reset(&g.buf);
+    ncrm_mp_write_map(&g.buf, g.lastSeq ? 3 : 2);
+    ncrm_mp_write_str(&g.buf, "status", 6);
+    ncrm_mp_write_array(&g.buf, 2);
+    ncrm_mp_write_str(&g.buf, bf, len);
+    ncrm_mp_write_uint(&g.buf, 0);
+    ncrm_mp_write_str(&g.buf, "elapsedTime", 11);
+    ncrm_mp_write_uint(&g.buf, msec);
+    if( g.lastSeq ) {
+        /* monitor derives processing speed from it, so never zero */
+        ncrm_mp_write_str(&g.buf, "progress", 8);
+        ncrm_mp_write_array(&g.buf, 2);
+        ncrm_mp_write_uint(&g.buf, g.lastSeq);
+        ncrm_mp_write_uint(&g.buf, g.nMessages);
+    }
+    _publish_frame(g.buf.data, g.buf.size, 0);
+}
+
+/* Sends reply frame to requester of given identity */
+static void
+_reply( const void * id, size_t idLen, const struct ncrm_MsgpackBuffer * b ) {
+    zmq_send(g.service, id, idLen, ZMQ_SNDMORE);
+    zmq_send(g.service, b->data, b->size, 0);
+}
+
+/* Replies to snapshot request with entries of history within time span and
+ * levels range, followed by `{"snapshotEnd": <seq>}` */
+static void
+_serve_snapshot( const void * id, size_t idLen
+               , uint64_t span, int64_t levelMin, int64_t levelMax ) {
+    struct ncrm_MsgpackBuffer * b = &g.buf;
+    const uint64_t firstSeq = g.lastSeq > NCRM_LOADGEN_HISTORY
+                            ? g.lastSeq - NCRM_LOADGEN_HISTORY + 1 : 1
+                 , since = span && g.latest > span ? g.latest - span : 0
+                 ;
+    uint64_t chunk[NCRM_LOADGEN_SNAPSHOT_CHUNK];
+    unsigned int n = 0;
+    for( uint64_t seq = firstSeq; seq <= g.lastSeq; ++seq ) {
+        for( unsigned int i = 0; i < g.entriesPerMsg; ++i ) {
+            const uint64_t nEntry = (seq - 1)*g.entriesPerMsg + i;
+            const struct GenEntry * e = g.history
+                    + nEntry%((uint64_t) NCRM_LOADGEN_HISTORY*g.entriesPerMsg);
+            if( e->timest < since
+             || (levelMin > -1 && e->level < levelMin)
+             || (levelMax > -1 && e->level > levelMax) ) continue;
+            chunk[n++] = nEntry;
+            if( NCRM_LOADGEN_SNAPSHOT_CHUNK != n ) continue;
+            ncrm_mp_buffer_reset(b);
+            ncrm_mp_write_map(b, 1);
+            ncrm_mp_write_str(b, "j", 1);
+            ncrm_mp_write_array(b, n);
+            for( unsigned int k = 0; k < n; ++k ) _write_entry(b, chunk[k]);
+            _reply(id, idLen, b);
+            n = 0;
+        }
+    }
+    ncrm_mp_buffer_reset(b);
+    ncrm_mp_write_map(b, n ? 2 : 1);
+    if( n ) {
+        ncrm_mp_write_str(b, "j", 1);
+        ncrm_mp_write_array(b, n);
+        for( unsigned int k = 0; k < n; ++k ) _write_entry(b, chunk[k]);
+    }
+    ncrm_mp_write_str(b, "snapshotEnd", 11);
+    ncrm_mp_write_uint(b, g.lastSeq);
+    _reply(id, idLen, b);
+    ++g.nSnapshots;
+}
+
+/* Replies to resend request with messages still kept in history */
+static void
+_serve_resend( const void * id, size_t idLen, uint64_t first, uint64_t last ) {
+    if( last > g.lastSeq ) last = g.lastSeq;
+    if( g.lastSeq > NCRM_LOADGEN_HISTORY
+     && first <= g.lastSeq - NCRM_LOADGEN_HISTORY )
+        first = g.lastSeq - NCRM_LOADGEN_HISTORY + 1;
+    if( !first ) first = 1;
+    for( uint64_t seq = first; seq <= last; ++seq ) {
+        ncrm_mp_buffer_reset(&g.buf);
+        _write_message(&g.buf, seq);
+        _reply(id, idLen, &g.buf);
+        ++g.nResent;
+    }
+}
+
+/* Handles pending service requests, waiting for them up to given time,
+ * msec */
+static void
+_serve( long timeout ) {
+    zmq_pollitem_t item = { g.service, 0, ZMQ_POLLIN, 0 };
+    while( g.keepGoing && zmq_poll(&item, 1, timeout) > 0 ) {
+        char id[256];
+        uint8_t request[256];
+        int idLen = zmq_recv(g.service, id, sizeof(id), ZMQ_DONTWAIT);
+        if( idLen < 0 ) break;
+        int len = zmq_recv(g.service, request, sizeof(request), ZMQ_DONTWAIT);
+        if( len < 0 ) break;
+        if( idLen > (int) sizeof(id) || len > (int) sizeof(request) ) continue;
+        struct ncrm_MsgpackCursor c;
+        ncrm_mp_cursor_init(&c, request, len);
+        uint32_t nPairs, nItems;
+        uint64_t span = 0, first = 0, last = 0;
+        int64_t levelMin = -1, levelMax = -1;
+        int isSnapshot = 0, isResend = 0, rc = ncrm_mp_read_map(&c, &nPairs);
+        for( uint32_t i = 0; !rc && i < nPairs; ++i ) {
+            const char * key;
+            uint32_t keyLen;
+            if( (rc = ncrm_mp_read_str(&c, &key, &keyLen)) ) break;
+            if( 8 == keyLen && !memcmp(key, "snapshot", 8) ) {
+                rc = ncrm_mp_read_uint(&c, &span);
+                isSnapshot = 1;
+            } else if( 6 == keyLen && !memcmp(key, "levels", 6) ) {
+                rc = ncrm_mp_read_array(&c, &nItems) || 2 != nItems
+                  || ncrm_mp_read_int(&c, &levelMin)
+                  || ncrm_mp_read_int(&c, &levelMax);
+            } else if( 6 == keyLen && !memcmp(key, "resend", 6) ) {
+                rc = ncrm_mp_read_array(&c, &nItems) || 2 != nItems
+                  || ncrm_mp_read_uint(&c, &first)
+                  || ncrm_mp_read_uint(&c, &last);
+                isResend = 1;
+            } else {
+                rc = ncrm_mp_skip(&c);
+            }
+        }
+        if( rc ) {
+            fprintf(stderr, "Malformed service request ignored.\n");
+        } else if( isSnapshot ) {
+            _serve_snapshot(id, idLen, span, levelMin, levelMax);
+        } else if( isResend ) {
+            _serve_resend(id, idLen, first, last);
+        }
+        timeout = 0;
+    }
+}
+
+/* Generates messages by schedule: steady stream at given rate plus bursts,
+ * timestamped by scheduled time */
+static void
+_run_generator() {
+    const uint64_t step = g.rate > 0 ? 1e9/g.rate : 0
+                 , burstStep = g.burstPeriod*1000000ULL
+                 ;
+    uint64_t nextSteady = 0, nextBurst = burstStep, nextStatus = 0
+           , nSinceServed = 0;
+    while( g.keepGoing && (!g.nMessages || g.lastSeq < g.nMessages) ) {
+        const int isBurst = g.burstSize && nextBurst < nextSteady;
+        uint64_t next = isBurst ? nextBurst : nextSteady;
+        if( !step && !isBurst ) next = _elapsed_nsec();
+        uint64_t now = _elapsed_nsec();
+        if( g.service ) {
+            if( next > now + 1000000 ) {
+                _serve((next - now)/1000000);
+                nSinceServed = 0;
+            } else if( ++nSinceServed == NCRM_LOADGEN_POLL_EVERY ) {
+                _serve(0);
+                nSinceServed = 0;
+            }
+        }
+        if( next > now ) _sleep_till(next);
+        if( next >= nextStatus ) {
+            _publish_status(nextStatus/1000000);
+            nextStatus += NCRM_LOADGEN_STATUS_PERIOD_MSEC*1000000ULL;
+        }
+        if( isBurst ) {
+            for( unsigned int i = 0; i < g.burstSize && g.keepGoing
+                 && (!g.nMessages || g.lastSeq < g.nMessages); ++i )
+                _generate(next/1000000);
+            nextBurst += burstStep;
+        } else {
+            _generate(next/1000000);
+            nextSteady += step;
+        }
+    }
+    _publish_status(_elapsed_nsec()/1000000);
+}
+
+/* Replays captured session, keeping its timing */
+static int
+_run_replay() {
+    FILE * f = fopen(g.replayPath, "rb");
+    if( !f ) {
+        fprintf(stderr, "Can't open \"%s\": %s\n", g.replayPath, strerror(errno));
+        return 1;
+    }
+    uint32_t hdr[2];
+    uint8_t more;
+    void * data = NULL;
+    size_t nAllocated = 0;
+    while( g.keepGoing && 1 == fread(hdr, sizeof(hdr), 1, f)
+        && 1 == fread(&more, 1, 1, f) ) {
+        if( hdr[1] > nAllocated ) {
+            nAllocated = hdr[1];
+            data = realloc(data, nAllocated);
+            assert(data);
+        }
+        if( hdr[1] && 1 != fread(data, hdr[1], 1, f) ) break;
+        _sleep_till(hdr[0]*1000000ULL);
+        _publish_frame(data, hdr[1], more);
+        if( !more ) ++g.nSent;
+    }
+    free(data);
+    fclose(f);
+    return 0;
+}
+
+static void
+_usage( const char * appName ) {
+    fprintf( stderr, "Usage:\n    %s [options]\n"
+        "Publishes synthetic journal messages for ncrm.\n"
+        "  -a <address>  publisher address to bind (tcp://127.0.0.1:5598)\n"
+        "  -R <address>  snapshot/resend service address to bind (none)\n"
+        "  -r <n>        messages per second, 0 for as fast as possible (100)\n"
+        "  -n <n>        number of messages to send, 0 for endless (0)\n"
+        "  -e <n>        entries per message (10)\n"
+        "  -s <n>        length of entry's message text, bytes (48)\n"
+        "  -c <n>        number of categories (8)\n"
+        "  -l <mix>      levels and weights (700:80,500:15,400:4,200:1)\n"
+        "  -L <msec>     max lateness of entries (out of order), msec (0)\n"
+        "  -b <n>:<msec> burst of n extra messages every msec (none)\n"
+        "  -D <n>        drop every n-th message to imitate gaps (none)\n"
+        "  -t            prefix messages with topics\n"
+        "  -x <seed>     seed of generator (1)\n"
+        "  -W <msec>     delay before publishing, for slow joiners (0)\n"
+        "  -w <file>     capture published frames to file\n"
+        "  -p <file>     replay captured session instead of generating\n"
+        , appName );
+}
+
+int
+main(int argc, char * argv[]) {
+    g.pubAddress = "tcp://127.0.0.1:5598";
+    g.rate = 100;
+    g.entriesPerMsg = 10;
+    g.textLen = 48;
+    g.nCategories = 8;
+    g.seed = 1;
+    _parse_level_mix("700:80,500:15,400:4,200:1");
+    {  /* Parse command line options */
+        int opt;
+        char * end;
+        while( -1 != (opt = getopt(argc, argv, "a:R:r:n:e:s:c:l:L:b:D:tx:W:w:p:")) ) {
+            switch(opt) {
+                case 'a': g.pubAddress = optarg; break;
+                case 'R': g.serviceAddress = optarg; break;
+                case 'r': g.rate = atof(optarg); break;
+                case 'n': g.nMessages = strtoul(optarg, NULL, 0); break;
+                case 'e': g.entriesPerMsg = atoi(optarg); break;
+                case 's': g.textLen = atoi(optarg); break;
+                case 'c': g.nCategories = atoi(optarg); break;
+                case 'l':
+                    if( _parse_level_mix(optarg) ) {
+                        fprintf(stderr, "Bad level mix: \"%s\"\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    break;
+                case 'L': g.maxLateness = atoi(optarg); break;
+                case 'b':
+                    g.burstSize = strtoul(optarg, &end, 10);
+                    if( ':' != *end || !(g.burstPeriod = atoi(end + 1)) ) {
+                        fprintf(stderr, "Bad burst pattern: \"%s\"\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    break;
+                case 'D': g.dropEvery = atoi(optarg); break;
+                case 't': g.withTopics = 1; break;
+                case 'x': g.seed = strtoull(optarg, NULL, 0); break;
+                case 'W': g.startDelay = atoi(optarg); break;
+                case 'w': g.capturePath = optarg; break;
+                case 'p': g.replayPath = optarg; break;
+                default:
+                    _usage(argv[0]);
+                    return EXIT_FAILURE;
+            }
+        }
+    }
+    if( !g.entriesPerMsg || !g.nCategories || g.rate < 0 ) {
+        _usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if( g.replayPath && g.serviceAddress ) {
+        fputs("Replay can not serve snapshots.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    g.rng = g.seed ? g.seed : 1;
+    g.history = calloc( (size_t) NCRM_LOADGEN_HISTORY*g.entriesPerMsg
+                      , sizeof(struct GenEntry) );
+    g.text = malloc(g.textLen + 1);
+    assert(g.history && g.text);
+    ncrm_mp_buffer_init(&g.buf);
+
+    g.zmqContext = zmq_ctx_new();
+    g.publisher = zmq_socket(g.zmqContext, ZMQ_PUB);
+    int linger = 1000;
+    zmq_setsockopt(g.publisher, ZMQ_LINGER, &linger, sizeof(linger));
+    if( zmq_bind(g.publisher, g.pubAddress) ) {
+        fprintf(stderr, "zmq_bind(\"%s\"): %s\n", g.pubAddress, zmq_strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if( g.serviceAddress ) {
+        g.service = zmq_socket(g.zmqContext, ZMQ_ROUTER);
+        zmq_setsockopt(g.service, ZMQ_LINGER, &linger, sizeof(linger));
+        if( zmq_bind(g.service, g.serviceAddress) ) {
+            fprintf(stderr, "zmq_bind(\"%s\"): %s\n", g.serviceAddress, zmq_strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    if( g.capturePath && !(g.capture = fopen(g.capturePath, "wb")) ) {
+        fprintf(stderr, "Can't open \"%s\": %s\n", g.capturePath, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if( g.startDelay ) usleep(g.startDelay*1000);
+
+    g.keepGoing = 1;
+    signal(SIGINT, _on_signal);
+    signal(SIGTERM, _on_signal);
+    clock_gettime(CLOCK_MONOTONIC, &g.start);
+    int rc = g.replayPath ? _run_replay() : (_run_generator(), 0);
+    const double elapsed = _elapsed_nsec()/1e9;
+    /* serve requests still coming shortly after the end */
+    if( g.service && g.keepGoing ) _serve(NCRM_LOADGEN_STATUS_PERIOD_MSEC);
+
+    fprintf( stderr, "%lu messages (%lu entries, %lu bytes) sent in %.3fs:"
+             " %.1f msg/s, %.1f entries/s; %lu dropped, %lu snapshots"
+             " served, %lu messages re-sent\n"
+           , g.nSent, g.nEntriesSent, g.nBytes, elapsed
+           , elapsed > 0 ? g.nSent/elapsed : 0
+           , elapsed > 0 ? g.nEntriesSent/elapsed : 0
+           , g.nDropped, g.nSnapshots, g.nResent );
+
+    if( g.capture ) fclose(g.capture);
+    zmq_close(g.publisher);
+    if( g.service ) zmq_close(g.service);
+    zmq_ctx_term(g.zmqContext);
+    ncrm_mp_buffer_free(&g.buf);
+    free(g.text);
+    free(g.history);
+    return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}